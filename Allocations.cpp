@@ -0,0 +1,29 @@
+#ifdef ALLOCCOUNT
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include "Allocations.h"
+
+static std::atomic<unsigned long long> allocations(0);
+
+unsigned long long AllocationCount(){
+  return allocations.load(std::memory_order_relaxed);
+}
+
+void *operator new(size_t bytes){
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void *p = malloc(bytes ? bytes : 1);
+  if(!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef ALLOCATIONS_H
+#define ALLOCATIONS_H
+/*
+   Heap allocation counter for the benchmarks. Allocations.cpp replaces the global operator new
+   and delete with ones that count calls and go straight to malloc and free; everything else,
+   including new[] and the nothrow forms, reaches them through the standard library's defaults.
+   malloc called directly is not counted.
+
+   The replacement puts an atomic add on every allocation, so it is only compiled in when
+   ALLOCCOUNT is defined (premake4 --alloccount gmake); otherwise the count is always 0.
+ */
+
+#ifdef ALLOCCOUNT
+
+/* operator new calls on every thread since the program started */
+unsigned long long AllocationCount();
+
+#else
+
+inline unsigned long long AllocationCount() { return 0; }
+
+#endif
+
+#endif
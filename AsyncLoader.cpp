@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AsyncLoader.h"
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+struct AsyncJob {
+  std::function<void()> work, done;
+};
+
+/* Ring of jobs for exactly one producer and one consumer. head is only written by the consumer
+   and tail only by the producer; the release/acquire pairs publish the slot contents. */
+struct JobRing {
+  AsyncJob *slots[ASYNC_QUEUE_SIZE];
+  std::atomic<size_t> head, tail;
+
+  bool Push(AsyncJob *job){
+    size_t t = tail.load(std::memory_order_relaxed);
+    if(t - head.load(std::memory_order_acquire) == ASYNC_QUEUE_SIZE)
+      return false;
+    slots[t % ASYNC_QUEUE_SIZE] = job;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  AsyncJob *Pop(){
+    size_t h = head.load(std::memory_order_relaxed);
+    if(h == tail.load(std::memory_order_acquire))
+      return NULL;
+    AsyncJob *job = slots[h % ASYNC_QUEUE_SIZE];
+    head.store(h + 1, std::memory_order_release);
+    return job;
+  }
+
+  bool Empty(){
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+};
+
+static JobRing requests, completions;   /* Render thread to loader, and back */
+static std::thread loader;
+static std::mutex sleeplock;            /* Only for the loader's idle wait; the rings need no lock */
+static std::condition_variable wakeup;
+static std::atomic<bool> quit(false), stopped(false), abandon(false);
+
+/* Render-thread side of the file watches; the loader refers to them by index */
+static std::vector<std::function<void()> > watchcallbacks;
+
+/* Loader-thread side */
+struct Watch {
+  std::string path, directory, name;
+  size_t callback;
+  time_t mtime;
+  int wd;
+};
+static std::vector<Watch> watches;
+#ifdef __linux__
+static int inotifyfd = -1;
+#endif
+
+static void Complete(AsyncJob *job){
+  while(!completions.Push(job)){ /* The render thread drains this every frame */
+    if(abandon){
+      delete job;
+      return;
+    }
+    std::this_thread::yield();
+  }
+}
+
+static time_t ModificationTime(const std::string &path){
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? st.st_mtime : 0;
+}
+
+static void AddWatch(const std::string &path, size_t callback){
+  Watch w;
+  size_t slash = path.find_last_of("/\\");
+  w.path = path;
+  w.directory = slash == std::string::npos ? "." : path.substr(0, slash);
+  w.name = slash == std::string::npos ? path : path.substr(slash + 1);
+  w.callback = callback;
+  w.mtime = ModificationTime(path);
+  w.wd = -1;
+#ifdef __linux__
+  if(inotifyfd < 0)
+    inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  /* Watch the directory rather than the file, so saves that replace the file are seen too.
+     inotify returns the same descriptor when the directory is already watched. */
+  if(inotifyfd >= 0)
+    w.wd = inotify_add_watch(inotifyfd, w.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+#endif
+  watches.push_back(w);
+}
+
+static void CheckWatches(){
+  std::vector<bool> changed(watches.size(), false);
+#ifdef __linux__
+  if(inotifyfd >= 0){
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while((length = read(inotifyfd, buffer, sizeof(buffer))) > 0)
+      for(char *p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len){
+        const struct inotify_event *event = (const struct inotify_event *)p;
+        for(size_t i = 0; i<watches.size(); i++)
+          if(event->len && watches[i].wd == event->wd && watches[i].name == event->name)
+            changed[i] = true;
+      }
+  }
+#endif
+  for(size_t i = 0; i<watches.size(); i++){
+    if(watches[i].wd >= 0)
+      continue;
+    time_t mtime = ModificationTime(watches[i].path);
+    if(mtime != watches[i].mtime){
+      watches[i].mtime = mtime;
+      changed[i] = true;
+    }
+  }
+  for(size_t i = 0; i<watches.size(); i++)
+    if(changed[i]){
+      size_t callback = watches[i].callback;
+      AsyncJob *job = new AsyncJob;
+      job->done = [callback]{ watchcallbacks[callback](); };
+      Complete(job);
+    }
+}
+
+static void Loader(){
+  std::chrono::steady_clock::time_point lastcheck = std::chrono::steady_clock::now();
+  for(;;){
+    AsyncJob *job;
+    while((job = requests.Pop())){
+      if(job->work)
+        job->work();
+      Complete(job);
+    }
+    if(quit)
+      break;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(!watches.empty() && now - lastcheck >= std::chrono::milliseconds(WATCH_POLL_MILLISECONDS)){
+      CheckWatches();
+      lastcheck = now;
+    }
+    std::unique_lock<std::mutex> guard(sleeplock);
+    wakeup.wait_for(guard, std::chrono::milliseconds(WATCH_POLL_MILLISECONDS), []{ return quit || !requests.Empty(); });
+  }
+#ifdef __linux__
+  if(inotifyfd >= 0)
+    close(inotifyfd);
+  inotifyfd = -1;
+#endif
+  watches.clear();
+  stopped = true;
+}
+
+void RunAsync(std::function<void()> work, std::function<void()> done){
+  if(!loader.joinable()){
+    quit = false;
+    stopped = false;
+    loader = std::thread(Loader);
+  }
+  AsyncJob *job = new AsyncJob;
+  job->work = work;
+  job->done = done;
+  while(!requests.Push(job)){
+    PollAsyncLoads(); /* Make room in case the loader is waiting on us */
+    std::this_thread::yield();
+  }
+  /* Taking the lock orders this push before the loader's next check for work, so it cannot
+     go to sleep having missed it */
+  { std::lock_guard<std::mutex> guard(sleeplock); }
+  wakeup.notify_one();
+}
+
+int PollAsyncLoads(){
+  int count = 0;
+  AsyncJob *job;
+  while((job = completions.Pop())){
+    if(job->done)
+      job->done();
+    delete job;
+    count++;
+  }
+  return count;
+}
+
+void WatchFile(const char *path, std::function<void()> changed){
+  size_t callback = watchcallbacks.size();
+  std::string file = path;
+  watchcallbacks.push_back(changed);
+  RunAsync([file, callback]{ AddWatch(file, callback); }, std::function<void()>());
+}
+
+void StopAsyncLoader(){
+  if(!loader.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> guard(sleeplock);
+    quit = true;
+  }
+  wakeup.notify_one();
+  while(!stopped){ /* Keep draining so the loader never blocks on a full completion ring */
+    PollAsyncLoads();
+    std::this_thread::yield();
+  }
+  loader.join();
+  PollAsyncLoads();
+  watchcallbacks.clear();
+}
+
+/* A program that exits without StopAsyncLoader must still join the thread, or its destructor
+   aborts. Nothing is left to run the done halves by then, so the loader just drops them. Being
+   defined last, this is destroyed before the rest of the file's statics. */
+static struct LoaderShutdown {
+  ~LoaderShutdown(){
+    if(!loader.joinable())
+      return;
+    abandon = true;
+    {
+      std::lock_guard<std::mutex> guard(sleeplock);
+      quit = true;
+    }
+    wakeup.notify_one();
+    loader.join();
+  }
+} loadershutdown;
@@ -0,0 +1,27 @@
+#ifndef ASYNCLOADER_H
+#define ASYNCLOADER_H
+/*
+   Background loading. One loader thread runs the work half of each job (file reads, mapping,
+   preprocessing: anything that blocks but makes no GL calls) and hands the job back to the
+   render thread, which runs the done half from PollAsyncLoads at a frame boundary. Jobs travel
+   through two single-producer single-consumer lock-free rings, so neither side ever waits on
+   the other's locks; the loader only sleeps on a condition variable when it has nothing to do.
+
+   The loader thread also watches files: WatchFile calls changed on the render thread (from
+   PollAsyncLoads) after the file is rewritten. Linux uses inotify on the file's directory, which
+   also catches editors that save by renaming; elsewhere the loader polls modification times.
+ */
+#include <functional>
+
+#define ASYNC_QUEUE_SIZE 256          /* Jobs in flight in each direction */
+#define WATCH_POLL_MILLISECONDS 100   /* How often the loader looks for file changes */
+
+/* Run work on the loader thread, then done on the render thread. Either may be empty. */
+void RunAsync(std::function<void()> work, std::function<void()> done);
+/* Run the done half of every finished job and the callbacks of changed files. Render thread only. */
+int PollAsyncLoads();
+void WatchFile(const char *path, std::function<void()> changed);
+/* Finish the jobs already queued, then stop the loader thread */
+void StopAsyncLoader();
+
+#endif
@@ -14,27 +14,38 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <float.h>
 #include <stddef.h> /* must include for the offsetof macro */
-/*
- *
- * Include files for Windows, Linux and OSX
- * __APPLE is defined if OSX, otherwise Windows and Linux.
- *
- */
-
-#ifdef __APPLE__
-#define GLFW_INCLUDE_GLCOREARB 1
-#include <GLFW/glfw3.h>
-#else
-#include <GL/glew.h>
-#include <GLFW/glfw3.h>
-#endif
+#include "Platform.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+#include <atomic>
+
+#include "Mesh.h"
+#include "ShaderCache.h"
+#include "Subdivide.h"
+#include "ThreadPool.h"
+#include "FrameStats.h"
+#include "Headless.h"
+#include "Profiler.h"
+#include "SoftRaster.h"
+#include "SceneGraph.h"
+#include "AsyncLoader.h"
+#include "StreamBuffer.h"
+#include "MatrixBatch.h"
+#include "MeshOptimise.h"
+#include "LOD.h"
+#include "LightClusters.h"
+#include "Simulation.h"
+#include "Primitives.h"
+#include "Allocations.h"
 
 #include <stdlib.h>
 #include <math.h>
@@ -60,60 +71,37 @@ void Check(const char *where) { // Function to check OpenGL error status
   exit(1);
 }
 
-void CheckShader(int sp, const char *x){
-  int length;
-  char text[1001];
-  glGetProgramInfoLog(sp, 1000, &length, text);   // Check for errors
-  if(length > 0) {
-    fprintf(stderr, "Validate Shader Program\nMessage from:%s\n%s\n", x, text );
-    exit(1);
-  }
-}
-
-char* filetobuf(char *file) { /* A simple function that will read a file into an allocated char pointer buffer */
-  FILE *fptr;
-  long length;
-  char *buf;
-  fprintf(stderr, "Loading %s\n", file);
-        #pragma warning (disable : 4996)
-  fptr = fopen(file, "rb");   /* Open file for reading */
-  if (!fptr) {   /* Return NULL on failure */
-    fprintf(stderr, "failed to open %s\n", file);
-    return NULL;
-  }
-  fseek(fptr, 0, SEEK_END);   /* Seek to the end of the file */
-  length = ftell(fptr);   /* Find out how many bytes into the file we are */
-  buf = (char*)malloc(length + 1);   /* Allocate a buffer for the entire length of the file and a null terminator */
-  fseek(fptr, 0, SEEK_SET);   /* Go back to the beginning of the file */
-  fread(buf, length, 1, fptr);   /* Read the contents of the file in to the buffer */
-  fclose(fptr);   /* Close the file */
-  buf[length] = 0;   /* Null terminator */
-  return buf;   /* Return the buffer */
-}
-
-
-struct Vertex {
-  Vertex(): color{0,1,0} {};
-  GLfloat position[3];
-  GLfloat color[3];
-};
-
 typedef struct{
   Vertex p1, p2, p3;
 } Facet;
-/* These pointers will receive the contents of our shader source code files */
-GLchar *vertexsource, *fragmentsource;
-/* These are handles used to reference the shaders */
-GLuint vertexshader, fragmentshader;
-/* This is a handle to the shader program */
-GLuint shaderprogram;
-GLuint vao, conevao, cylindervao, vbo[1], conevbo[1], cylindervbo[1]; /* Create handles for our Vertex Array Object and One Vertex Buffer Object */
-std::vector<Vertex> v, conev, cylinderv;
+/* This is the shader program in use, with its uniform locations already resolved */
+const ShaderProgram *shaderprogram;
+bool programinstanced;  /* Whether shaderprogram takes per-instance model matrices */
+bool programtessellated; /* Whether shaderprogram draws patches, so meshes become their patches */
+/* Shared meshes from the registry in Mesh.cpp. They are built on first use and never rebuilt. */
+const Mesh *sphere, *cone, *cylinder;
+/* The coarse control meshes the tessellation shaders refine in their place */
+const Mesh *spherepatches, *conepatches, *cylinderpatches;
 
 int mode = 0;
 /* Mode 0 corresponds to a wireframe sphere, and is accessed by pressing A.
    Mode 1 corresponds to a lighted sphere, and is accessed by pressing B.
-   Mode 2 corresponds to a basic wireframe rocket, and is accessed by pressing C.*/
+   Mode 2 corresponds to a basic wireframe rocket, and is accessed by pressing C.
+   Mode 3 corresponds to a sphere deformed every frame, and is accessed by pressing D.*/
+
+bool instancing = true; /* Draw each mesh once with per-instance model matrices; toggled with I */
+int rockets = 1;        /* Number of rockets mode 2 draws, laid out on a grid (--rockets N) */
+int spherelevel = 5;    /* Subdivision level of the sphere mesh (--sphere-level N) */
+bool softbackend = false; /* --backend soft: meshes stay on the CPU and SoftRaster.cpp draws them */
+bool asyncshaders = false; /* Build the programs of later mode switches on the loader thread (window only) */
+bool spinrockets = false; /* Turn every rocket about its own axis in mode 2 (--spin, toggled with S) */
+bool impostors = false; /* Ray-cast the spheres of modes 1 and 2 on one quad each (--impostors, toggled with P) */
+bool tessellation = false; /* Refine coarse patches on the GPU instead of drawing meshes (--tessellation, toggled with T) */
+bool lod = true;        /* Draw each rocket part at the level of detail its size on screen needs (--no-lod, toggled with L) */
+int pointlights = 0;    /* Point lights circling the sphere of mode 1, shaded by clustered forward lighting (--lights N) */
+bool simthread = true;  /* Step the animation on its own thread and interpolate its snapshots (--no-sim-thread) */
+std::atomic<int> simmode(0); /* mode, for the simulation thread */
+int viewportwidth = 640, viewportheight = 480;
 
 /* Return the midpoint of two vectors */
 Vertex Midpoint(Vertex p1, Vertex p2){
@@ -151,7 +139,7 @@ int CreateUnitSphere(int iterations, Facet *facets){/* Algorithm to calculate ve
   p3.position[0] = -1.0; p3.position[1] = -1.0; p3.position[2] = 0.0;
   p4.position[0] = 1.0; p4.position[1] = -1.0; p4.position[2] = 0.0;
   p5.position[0] = 1.0; p5.position[1] = 1.0; p5.position[2] = 0.0;
-  p6.position[0] = -1.0; p4.position[1] = -1.0; p4.position[2] = 0.0;
+  p6.position[0] = -1.0; p6.position[1] = 1.0; p6.position[2] = 0.0;
   Normalise(&p1); Normalise(&p2); Normalise(&p3); Normalise(&p4); Normalise(&p5); Normalise(&p6);
 
   facets[0].p1 = p1;facets[0].p2 = p4;facets[0].p3 = p5;
@@ -202,7 +190,95 @@ int CreateUnitSphere(int iterations, Facet *facets){/* Algorithm to calculate ve
   return(n);
 }
 
-void CreateCone(){
+/* Return the index of the midpoint of edge a-b, creating the vertex on first use. Every edge is
+   shared by two facets, so the cache computes each midpoint once and both facets reference it.
+ */
+GLuint MidpointIndex(GLuint a, GLuint b, std::vector<Vertex> &vertices, std::unordered_map<unsigned long long, GLuint> &cache){
+  unsigned long long key = a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+  std::unordered_map<unsigned long long, GLuint>::iterator it = cache.find(key);
+  if(it != cache.end())
+    return it->second;
+  GLuint index = vertices.size();
+  vertices.push_back(Midpoint(vertices[a], vertices[b]));
+  cache[key] = index;
+  return index;
+}
+
+/* Indexed version of CreateUnitSphere. It subdivides the same octahedron in the same facet order,
+  but emits each vertex once into vertices and each facet as three entries of indices.
+  Returns the number of facets.
+ */
+int CreateUnitSphereIndexed(int iterations, std::vector<Vertex> &vertices, std::vector<GLuint> &indices){
+  static const GLfloat octahedron[6][3] = {{0,0,1}, {0,0,-1}, {-1,-1,0}, {1,-1,0}, {1,1,0}, {-1,1,0}};
+  static const GLuint seed[24] = {0,3,4, 0,4,5, 0,5,2, 0,2,3, 1,4,3, 1,5,4, 1,2,5, 1,3,2};
+  size_t i, j, n, nstart;
+  size_t nfacets = 8, nvertices = 6;
+  for(i = 1; i<(size_t)iterations; i++){
+    nvertices += nfacets * 3 / 2; /* One new vertex per edge */
+    nfacets *= 4;
+  }
+  std::unordered_map<unsigned long long, GLuint> cache;
+  cache.reserve(nfacets * 3 / 8);
+  vertices.clear();
+  vertices.reserve(nvertices);
+  indices.assign(nfacets * 3, 0);
+
+  Vertex p;
+  for(i = 0; i<6; i++){
+    p.position[0] = octahedron[i][0]; p.position[1] = octahedron[i][1]; p.position[2] = octahedron[i][2];
+    Normalise(&p);
+    vertices.push_back(p);
+  }
+  memcpy(indices.data(), seed, sizeof(seed));
+
+  n = 8;
+
+  for(i = 1; i<(size_t)iterations; i++){
+    nstart = n;
+
+    for(j = 0; j<nstart; j++){
+      GLuint *f = &indices[j*3];
+      GLuint a = f[0], b = f[1], c = f[2];
+
+      /* Calculate the midpoints */
+      GLuint m1 = MidpointIndex(a, b, vertices, cache);
+      GLuint m2 = MidpointIndex(b, c, vertices, cache);
+      GLuint m3 = MidpointIndex(c, a, vertices, cache);
+
+      /* Replace the current facet and append the three new ones */
+      f[1] = m1; f[2] = m3;
+      GLuint *g = &indices[n*3];
+      g[0] = m1; g[1] = b;  g[2] = m2;
+      g[3] = m3; g[4] = m2; g[5] = c;
+      g[6] = m1; g[7] = m2; g[8] = m3;
+      n += 3;
+    }
+    cache.clear();
+  }
+  for(j = 0; j<vertices.size(); j++)
+    Normalise(&vertices[j]);
+  return(n);
+}
+
+/* The slice counts CreateCone and CreateCylinder have compiled tables for: their levels of detail */
+#define CONE_LEVELS 32, 16, 8, 4
+#define CYLINDER_LEVELS 50, 25, 12, 6
+
+/* A cone as a triangle fan (ConeKernel), from a compiled table when slices is one of CONE_LEVELS */
+void CreateCone(int slices, MeshData *mesh){
+  mesh->vertices.resize(ConeVertexCount(slices));
+  mesh->normals.resize(3 * ConeVertexCount(slices));
+  Vertex *vertices = mesh->vertices.data();
+  GLfloat *normals = mesh->normals.data();
+  if(!SliceTables<CONE_LEVELS>::Run(slices, [&](const auto &table){ ConeKernel(table, slices, vertices, normals); }))
+    ConeKernel(RuntimeSliceTable(slices), slices, vertices, normals);
+  mesh->primitive = GL_TRIANGLE_FAN;
+}
+
+/* The cone and cylinder generators as they were before Primitives.h, growing their vectors one
+   vertex at a time, kept for BenchmarkGenerators to compare against. The cone's rim is a float
+   angle stepped past a full turn, so it gets one vertex more than it needs, or two. */
+void CreateConePushBack(int lod, MeshData *mesh){
   float cf = 0.0;
   Vertex t;
   t.color[0] = cf;
@@ -211,8 +287,9 @@ void CreateCone(){
   cf = 1. - cf;
   t.color[2] = cf;
   cf = 1. - cf;
-  conev.push_back(t); // Apex
-  int lod = 32;
+  t.position[0] = 0.0; t.position[1] = 0.0; t.position[2] = 0.0;
+  mesh->vertices.push_back(t); // Apex
+  mesh->normals.push_back(0.0); mesh->normals.push_back(0.0); mesh->normals.push_back(-1.0);
   float step = 2. * 3.141596 / float(lod);
   float Radius = 1.;
   for(float a = 0; a <= (2. * 3.141596 + step); a += step) {
@@ -227,185 +304,934 @@ void CreateCone(){
     cf = 1. - cf;
     t.color[2] = cf;
     cf = 1. - cf;
-    conev.push_back(t);
+    mesh->vertices.push_back(t);
+    /* The side is x^2 + y^2 = (z/2)^2, whose outward normal at the rim is (2c, 2s, -1) */
+    float length = sqrt(4. * c * c + 4. * s * s + 1.);
+    mesh->normals.push_back(2. * c / length); mesh->normals.push_back(2. * s / length); mesh->normals.push_back(-1. / length);
+  }
+  mesh->primitive = GL_TRIANGLE_FAN;
+}
+
+void CreateCylinderPushBack(int slices, MeshData *mesh){
+  Vertex t;
+  float radius = 1.0, halfLength = 2;
+  // Vertices at middle of both ends
+  t.position[0]=0.0; t.position[1]=halfLength; t.position[2]=0.0;
+  mesh->vertices.push_back(t);
+  t.position[1]=-halfLength;
+  mesh->vertices.push_back(t);
+  for(int i = 0; i<slices; i++){
+    float theta = ((float)i) * 2.0 * M_PI/slices;
+    // Vertices at edges of circle, top then bottom
+    t.position[0]=radius*cos(theta); t.position[1]=halfLength; t.position[2]=radius*sin(theta);
+    mesh->vertices.push_back(t);
+    t.position[1]=-halfLength;
+    mesh->vertices.push_back(t);
+  }
+  for(int i = 0; i<slices; i++){
+    GLuint top = 2 + 2 * i, bottom = top + 1;
+    GLuint nexttop = 2 + 2 * ((i + 1) % slices), nextbottom = nexttop + 1;
+    GLuint triangles[12] = {0, nexttop, top,               // Top end
+                            top, nexttop, bottom,          // Side
+                            bottom, nexttop, nextbottom,
+                            1, bottom, nextbottom};        // Bottom end
+    mesh->indices.insert(mesh->indices.end(), triangles, triangles + 12);
+  }
+  mesh->primitive = GL_TRIANGLES;
+}
+
+/* Fill mesh with the first vertexcount vertices of sphere and the facets in indices, which it takes */
+void SphereMesh(const SubdividedSphere &sphere, size_t vertexcount, std::vector<GLuint> &indices, MeshData *mesh){
+  mesh->vertices.resize(vertexcount);
+  for(size_t i = 0; i<vertexcount; i++){
+    mesh->vertices[i].position[0] = sphere.x[i];
+    mesh->vertices[i].position[1] = sphere.y[i];
+    mesh->vertices[i].position[2] = sphere.z[i];
   }
-  printf("cone v Size %d\n", conev.size());
+  mesh->indices.swap(indices);
+  mesh->primitive = GL_TRIANGLES;
 }
 
-void CreateSphere(){/* Actually implementing the sphere */
-  int i;
-  int n = 5;
-  Facet *f = NULL;
-  f = (Facet *)malloc((int)pow(4,n) * 8 * sizeof(Facet)); // I added *8 because that's the expected number of facets
-  n = CreateUnitSphere(n,f);
+void CreateSphere(int iterations, MeshData *mesh){/* Actually implementing the sphere */
+  SubdividedSphere sphere;
+  int n = SubdivideSphere(iterations, &sphere);
+  SphereMesh(sphere, sphere.x.size(), sphere.indices, mesh);
   printf("%d facets generated\n", n);
+  printf("v Size %zu, indices Size %zu\n", mesh->vertices.size(), mesh->indices.size());
+}
 
-  for(i = 0; i<n; i++){
-    v.push_back(f[i].p1);
-    v.push_back(f[i].p2);
-    v.push_back(f[i].p3);
+/* The spheres of several distinct levels from one subdivision up to the finest of them. Every
+   level it passes through is kept, and its vertices are a prefix of the finest level's, so each
+   mesh is the one CreateSphere would build for its level. */
+void CreateSphereChain(const int *levels, int count, MeshData *meshes){
+  int finest = 1;
+  for(int i = 0; i<count; i++)
+    finest = std::max(finest, levels[i]);
+  SubdividedSphere sphere;
+  int n = SubdivideSphere(finest, &sphere, true);
+  for(int i = 0; i<count; i++){
+    if(levels[i] >= finest)
+      SphereMesh(sphere, sphere.x.size(), sphere.indices, &meshes[i]);
+    else
+      SphereMesh(sphere, sphere.coarservertices[levels[i] - 1], sphere.coarser[levels[i] - 1], &meshes[i]);
   }
-  printf("v Size %d\n", v.size());
+  printf("%d facets generated, with %d coarser level%s kept\n", n, count - 1, count == 2 ? "" : "s");
 }
 
-void CreateCylinder(){
+/* A closed cylinder as an indexed triangle list: the two end centres, then a top and a bottom
+   vertex per slice */
+void CreateCylinder(int slices, MeshData *mesh){
+  mesh->vertices.resize(CylinderVertexCount(slices));
+  mesh->indices.resize(CylinderIndexCount(slices));
+  Vertex *vertices = mesh->vertices.data();
+  GLuint *indices = mesh->indices.data();
+  if(!SliceTables<CYLINDER_LEVELS>::Run(slices, [&](const auto &table){ CylinderKernel(table, slices, vertices, indices); }))
+    CylinderKernel(RuntimeSliceTable(slices), slices, vertices, indices);
+  mesh->primitive = GL_TRIANGLES;
+}
+
+/* The quad a sphere impostor is drawn on, corners at (+-1, +-1). sphere_impostor.vert turns it
+   to face the eye and sizes it to the sphere's silhouette. */
+void CreateImpostorQuad(int /*param*/, MeshData *mesh){
+  static const GLfloat corners[4][2] = {{-1,-1}, {1,-1}, {-1,1}, {1,1}};
   Vertex t;
-  float radius = 1.0, halfLength = 2;
-  int slices = 50;
-  for(int i = 0; i<slices; i++){
-    float theta = ((float)i) * 2.0 * M_PI/slices;
-    float nextTheta = ((float)i+1) * 2.0 * M_PI/slices;
-    // Vertex at middle of end
-    t.position[0]=0.0; t.position[1]=halfLength; t.position[2]=0.0;
-    cylinderv.push_back(t);
-    // Vertices at edges of circle
-    t.position[0]=radius*cos(theta); t.position[1]=halfLength; t.position[2]=radius*sin(theta);
-    cylinderv.push_back(t);
-    t.position[0]=radius*cos(nextTheta); t.position[1]=halfLength; t.position[2]=radius*sin(nextTheta);
-    cylinderv.push_back(t);
-    // Same vertices at bottom of cylinder
-    t.position[0]=radius*cos(theta); t.position[1]=-halfLength; t.position[2]=radius*sin(theta);
-    cylinderv.push_back(t);
-    t.position[0]=radius*cos(nextTheta); t.position[1]=-halfLength; t.position[2]=radius*sin(nextTheta);
-    cylinderv.push_back(t);
-    // Vertex at middle of end of bottom
-    t.position[0]=0.0; t.position[1]=-halfLength; t.position[2]=0.0;
-    cylinderv.push_back(t);
+  for(int i = 0; i<4; i++){
+    t.position[0] = corners[i][0]; t.position[1] = corners[i][1]; t.position[2] = 0.0;
+    mesh->vertices.push_back(t);
   }
+  mesh->primitive = GL_TRIANGLE_STRIP;
 }
 
-void SetupGeometry() {
-  if(mode == 0 || mode == 1){
-    int i;
-    int n = 5;
-    Facet *f = NULL;
-    f = (Facet *)malloc((int)pow(4,n) * 8 * sizeof(Facet));
-    n = CreateUnitSphere(n,f);
-    printf("%d facets generated\n", n);
-
-    for(i = 0; i<n; i++){ // Place vertices into vertex array
-      v.push_back(f[i].p1);
-      v.push_back(f[i].p2);
-      v.push_back(f[i].p3);
+/* Coarse control meshes for the tessellation path, drawn as three-vertex patches. patches.tese
+   puts the new vertices on the surface, so only the octahedron and a few slices are uploaded. */
+#define TESS_SLICES 8
+#define TESS_EDGE_PIXELS 8.0f /* On-screen length of a tessellated edge */
+
+void CreateSpherePatches(int /*param*/, MeshData *mesh){
+  CreateSphere(1, mesh);
+  mesh->primitive = GL_PATCHES;
+}
+
+void CreateConePatches(int slices, MeshData *mesh){
+  CreateCone(slices, mesh);
+  IndexTriangles(mesh);
+  mesh->primitive = GL_PATCHES;
+}
+
+void CreateCylinderPatches(int slices, MeshData *mesh){
+  CreateCylinder(slices, mesh);
+  mesh->primitive = GL_PATCHES;
+}
+
+/* Levels of detail of the rocket parts, finest first. Each halves the segments around the
+   shape's circles: the cone's slices, the cylinder's slices, and the sphere's subdivision level
+   (the octahedron's equator has 4 edges, and every level splits each one). */
+static const int conelevels[MAX_LOD_LEVELS] = {CONE_LEVELS};
+static const int cylinderlevels[MAX_LOD_LEVELS] = {CYLINDER_LEVELS};
+LODChain spherelods, conelods, cylinderlods;
+
+/* The sphere levels of the chain whose finest is level, and their segments. Returns how many. */
+int SphereLevels(int level, int *levels, int *segments) {
+  int count = 0;
+  for(; level >= 1 && count < MAX_LOD_LEVELS; level--, count++){
+    levels[count] = level;
+    segments[count] = 2 << level;
+  }
+  return count;
+}
+
+void BuildRocketScene();
+
+/* Start reading the baked meshes while the context is created; GetMesh picks them up */
+void PrefetchMeshes() {
+  int levels[MAX_LOD_LEVELS], segments[MAX_LOD_LEVELS];
+  int count = SphereLevels(spherelevel, levels, segments);
+  for(int i = 0; i<count; i++)
+    PrefetchMeshFile("sphere", levels[i]);
+  for(int i = 0; i<MAX_LOD_LEVELS; i++){
+    PrefetchMeshFile("cone", conelevels[i]);
+    PrefetchMeshFile("cylinder", cylinderlevels[i]);
+  }
+}
+
+/* Write every mesh SetupGeometry asks for to the mesh directory, so later runs can skip the generators */
+void BakeMeshes() {
+  int levels[MAX_LOD_LEVELS], segments[MAX_LOD_LEVELS];
+  int count = SphereLevels(spherelevel, levels, segments);
+  bool ok = true;
+  for(int i = 0; i<count; i++)
+    ok = BakeMesh("sphere", CreateSphere, levels[i]) && ok;
+  for(int i = 0; i<MAX_LOD_LEVELS; i++){
+    ok = BakeMesh("cone", CreateCone, conelevels[i]) && ok;
+    ok = BakeMesh("cylinder", CreateCylinder, cylinderlevels[i]) && ok;
+  }
+  if(!ok)
+    exit( EXIT_FAILURE );
+}
+
+/* Mode 3 rewrites every vertex of a CreateUnitSphere facet soup each frame. On the GL the
+   vertices go straight into a persistently mapped StreamBuffer; the software backend takes them
+   as a MeshData.
+ */
+std::vector<Facet> deformbase;
+std::atomic<bool> deformready(false); /* deformbase is built and will not change again */
+StreamBuffer deformstream;
+GLuint deformvao;
+MeshData deformdata;
+
+/* Sphere impostors: the spheres of modes 1 and 2 as one instanced quad each, on which
+   sphere_impostor.frag ray-casts the exact sphere and writes its depth. GL backend only. */
+#define IMPOSTOR_VERTEX "./sphere_impostor.vert"
+#define IMPOSTOR_FRAGMENT "./sphere_impostor.frag"
+const Mesh *impostorquad;
+const ShaderProgram *impostorprogram; /* NULL until built; the spheres are drawn as meshes until then */
+
+void SetupImpostors() {
+  if(!impostors || softbackend)
+    return;
+  impostorquad = GetMesh("impostor", CreateImpostorQuad, 0);
+  if(!impostorprogram)
+    impostorprogram = asyncshaders ? RequestShaderProgram(IMPOSTOR_VERTEX, IMPOSTOR_FRAGMENT)
+                                   : GetShaderProgram(IMPOSTOR_VERTEX, IMPOSTOR_FRAGMENT);
+}
+
+static bool TessellationSupported() {
+#ifdef __APPLE__
+  return true; /* Core since GL 4.0 */
+#else
+  return GLEW_VERSION_4_0 || GLEW_ARB_tessellation_shader;
+#endif
+}
+
+/* Fetch the patches of the meshes the current mode draws. GL backend only. */
+void SetupTessellation() {
+  if(!tessellation || softbackend)
+    return;
+  if(!TessellationSupported()){
+    printf("Tessellation needs GL 4.0 or ARB_tessellation_shader; drawing meshes\n");
+    tessellation = false;
+    return;
+  }
+  glPatchParameteri(GL_PATCH_VERTICES, 3);
+  spherepatches = GetMesh("sphere-patches", CreateSpherePatches, 0);
+  if(mode == 2){
+    conepatches = GetMesh("cone-patches", CreateConePatches, TESS_SLICES);
+    cylinderpatches = GetMesh("cylinder-patches", CreateCylinderPatches, TESS_SLICES);
+  }
+}
+
+/* The mesh to draw for mesh: its patches when the bound program tessellates. Sets the axis of
+   the patches' surface (see patches.tese) at the same time. */
+const Mesh *DrawnMesh(const Mesh *mesh) {
+  if(!programtessellated)
+    return mesh;
+  static const GLfloat axes[3][3] = {{0, 0, 0}, {0, 0, 1}, {0, 1, 0}};
+  int surface = mesh == cone ? 1 : (mesh == cylinder ? 2 : 0);
+  glUniform3fv(shaderprogram->uniforms[UNIFORM_AXIS], 1, axes[surface]);
+  return surface == 1 ? conepatches : (surface == 2 ? cylinderpatches : spherepatches);
+}
+
+/* Whether this frame's spheres are impostors */
+bool DrawingImpostors() {
+  return impostors && impostorprogram && impostorquad;
+}
+
+/* Generate the base sphere's facets at level on the loader thread, for SetupDeformedSphere to
+   take once they are done */
+void PrepareDeformedSphere(int level) {
+  static bool pending = false;
+  if(!deformbase.empty() || pending)
+    return;
+  pending = true;
+  std::vector<Facet> *facets = new std::vector<Facet>;
+  RunAsync([facets, level]{
+    facets->resize(UnitSphereFacets(level));
+    CreateUnitSphere(level, facets->data());
+  }, [facets]{
+    if(deformbase.empty())
+      deformbase.swap(*facets);
+    delete facets;
+    pending = false;
+  });
+}
+
+void SetupDeformedSphere() {
+  if(deformready)
+    return;
+  if(deformbase.empty()){ /* Not prepared by PrepareDeformedSphere */
+    deformbase.resize(UnitSphereFacets(spherelevel));
+    CreateUnitSphere(spherelevel, deformbase.data());
+  }
+  deformready = true;
+  if(softbackend){
+    deformdata.primitive = GL_TRIANGLES;
+    deformdata.vertices.resize(deformbase.size() * 3);
+    return;
+  }
+  CreateStreamBuffer(&deformstream, deformbase.size() * sizeof(Facet));
+  glGenVertexArrays(1, &deformvao);
+  glBindVertexArray(deformvao);
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1); /* The pointers move every frame, so DrawDeformedSphere sets them */
+  glBindVertexArray(0);
+}
+
+/* Push each vertex of the base sphere in or out along its normal by a moving ripple, and colour it
+   by how far it moved. out receives three vertices per facet.
+ */
+void DeformSphere(Vertex *out, float t) {
+  ParallelFor(deformbase.size(), 1024, [&](size_t first, size_t last){
+    for(size_t i = first; i<last; i++){
+      const Vertex *in = &deformbase[i].p1;
+      for(int k = 0; k<3; k++){
+        const GLfloat *p = in[k].position;
+        float d = 0.15f * sinf(5 * p[0] + 2 * t) * sinf(5 * p[1] + 1.5f * t) * sinf(5 * p[2] + t);
+        Vertex &v = out[i * 3 + k];
+        v.position[0] = p[0] * (1 + d);
+        v.position[1] = p[1] * (1 + d);
+        v.position[2] = p[2] * (1 + d);
+        v.color[0] = 0.5f + 3 * d;
+        v.color[1] = 0.6f;
+        v.color[2] = 0.5f - 3 * d;
+      }
     }
+  });
+}
 
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    /* Allocate and assign One Vertex Buffer Object to our handle */
-    glGenBuffers(1, vbo);
-    /* Bind our VBO as being the active buffer and storing vertex attributes (coordinates + colors) */
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    /* Copy the vertex data from cone to our buffer */
-    /* v,size() * sizeof(GLfloat) is the size of the cone array, since it contains 12 Vertex values */
-    glBufferData ( GL_ARRAY_BUFFER, v.size() * sizeof ( struct Vertex ), v.data(), GL_STATIC_DRAW );
-    /* Specify that our coordinate data is going into attribute index 0, and contains three doubles per vertex */
-    /* Note stride = sizeof ( struct Vertex ) and pointer = ( const GLvoid* ) 0 */
-    glVertexAttribPointer ( ( GLuint ) 0, 3, GL_FLOAT, GL_FALSE,  sizeof ( struct Vertex ), ( const GLvoid* ) offsetof (struct Vertex, position) );
-    /* Enable attribute index 0 as being used */
-    glEnableVertexAttribArray(0);
-    /* Specify that our color data is going into attribute index 1, and contains three floats per vertex */
-    /* Note stride = sizeof ( struct Vertex ) and pointer = ( const GLvoid* ) ( 3 * sizeof ( GLdouble ) ) i.e. the size (in bytes)
-       occupied by the first attribute (position) */
-    glVertexAttribPointer ( ( GLuint ) 1, 3, GL_FLOAT, GL_FALSE, sizeof ( struct Vertex ), ( const GLvoid* ) offsetof(struct Vertex, color) );   // bug );
-    /* Enable attribute index 1 as being used */
-    glEnableVertexAttribArray ( 1 );  /* Bind our second VBO as being the active buffer and storing vertex attributes (colors) */
-    glBindVertexArray(0);
+void ReleaseDeformedSphere() {
+  if(deformvao){
+    glDeleteVertexArrays(1, &deformvao);
+    DestroyStreamBuffer(&deformstream);
+    deformvao = 0;
   }
+  PrintStreamStats();
+}
 
+/* Fetch the meshes the current mode draws. The registry builds each one on first use only, so
+   calling this again after a mode switch costs a lookup and allocates nothing. The sphere's
+   levels of detail all come out of one subdivision; the cone's and cylinder's are cheap enough
+   to generate one by one.
+ */
+void SetupGeometry() {
+  PROFILE_ZONE("SetupGeometry");
+  const Mesh *meshes[MAX_LOD_LEVELS];
+  int levels[MAX_LOD_LEVELS], segments[MAX_LOD_LEVELS];
+  int count = SphereLevels(spherelevel, levels, segments);
+  GetMeshChain("sphere", CreateSphere, CreateSphereChain, levels, count, meshes);
+  SetLODChain(&spherelods, meshes, segments, count);
+  sphere = meshes[0];
   if(mode == 2){
-    CreateSphere();
-    CreateCone();
-    CreateCylinder();
-
-    // VAO settings for sphere
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    glGenBuffers(1, vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glBufferData ( GL_ARRAY_BUFFER, v.size() * sizeof ( struct Vertex ), v.data(), GL_STATIC_DRAW );
-    glVertexAttribPointer ( ( GLuint ) 0, 3, GL_FLOAT, GL_FALSE,  sizeof ( struct Vertex ), ( const GLvoid* ) offsetof (struct Vertex, position) );
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer ( ( GLuint ) 1, 3, GL_FLOAT, GL_FALSE, sizeof ( struct Vertex ), ( const GLvoid* ) offsetof(struct Vertex, color) );   // bug );
-    glEnableVertexAttribArray ( 1 );
-    glBindVertexArray(0);
-
-    // VAO settings for cone
-    glGenVertexArrays(1, &conevao);
-    glBindVertexArray(conevao);
-    glGenBuffers(1, conevbo);
-    glBindBuffer(GL_ARRAY_BUFFER, conevbo[0]);
-    glBufferData ( GL_ARRAY_BUFFER, conev.size() * sizeof ( struct Vertex ), conev.data(), GL_STATIC_DRAW );
-    glVertexAttribPointer ( ( GLuint ) 0, 3, GL_FLOAT, GL_FALSE,  sizeof ( struct Vertex ), ( const GLvoid* ) offsetof (struct Vertex, position) );
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer ( ( GLuint ) 1, 3, GL_FLOAT, GL_FALSE, sizeof ( struct Vertex ), ( const GLvoid* ) offsetof(struct Vertex, color) );
-    glEnableVertexAttribArray ( 1 );
-    glBindVertexArray(0);
-
-    // VAO settings for cylinder
-    glGenVertexArrays(1, &cylindervao);
-    glBindVertexArray(cylindervao);
-    glGenBuffers(1, cylindervbo);
-    glBindBuffer(GL_ARRAY_BUFFER, cylindervbo[0]);
-    glBufferData ( GL_ARRAY_BUFFER, cylinderv.size() * sizeof ( struct Vertex ), cylinderv.data(), GL_STATIC_DRAW );
-    glVertexAttribPointer ( ( GLuint ) 0, 3, GL_FLOAT, GL_FALSE,  sizeof ( struct Vertex ), ( const GLvoid* ) offsetof (struct Vertex, position) );
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer ( ( GLuint ) 1, 3, GL_FLOAT, GL_FALSE, sizeof ( struct Vertex ), ( const GLvoid* ) offsetof(struct Vertex, color) );
-    glEnableVertexAttribArray ( 1 );
-    glBindVertexArray(0);
+    GetMeshChain("cone", CreateCone, NULL, conelevels, MAX_LOD_LEVELS, meshes);
+    SetLODChain(&conelods, meshes, conelevels, MAX_LOD_LEVELS);
+    cone = meshes[0];
+    GetMeshChain("cylinder", CreateCylinder, NULL, cylinderlevels, MAX_LOD_LEVELS, meshes);
+    SetLODChain(&cylinderlods, meshes, cylinderlevels, MAX_LOD_LEVELS);
+    cylinder = meshes[0];
+    BuildRocketScene();
   }
+  if(mode == 1 || mode == 2)
+    SetupImpostors();
+  if(mode != 3)
+    SetupTessellation();
+  if(mode == 3)
+    SetupDeformedSphere();
+}
+
+/* The files of the program SetupShaders last asked for, until it is bound */
+const char *wantedvertex, *wantedfragment;
+bool wantedinstanced, wantedtessellated;
+bool programpending = false;
+
+void BindProgram(const ShaderProgram *program, bool instanced, bool tessellated) {
+  shaderprogram = program;
+  programinstanced = instanced;
+  programtessellated = tessellated;
+  glUseProgram(program->program);
+  glUniform2f(program->uniforms[UNIFORM_VIEWPORT], viewportwidth, viewportheight);
+  if(tessellated)
+    glUniform1f(program->uniforms[UNIFORM_EDGEPIXELS], TESS_EDGE_PIXELS);
+}
+
+/* The wanted program, or with request NULL until a build started on the loader thread is done.
+   Tessellated programs put the patch shaders between the vertex and fragment stages, and take
+   their vertex shader from patches.vert or patches_instanced.vert. */
+const ShaderProgram *WantedProgram(bool request) {
+  if(!wantedtessellated)
+    return request ? RequestShaderProgram(wantedvertex, wantedfragment) : GetShaderProgram(wantedvertex, wantedfragment);
+  const char *vertexfile = wantedinstanced ? "./patches_instanced.vert" : "./patches.vert";
+  return request ? RequestTessellationProgram(vertexfile, "./patches.tesc", "./patches.tese", wantedfragment)
+                 : GetTessellationProgram(vertexfile, "./patches.tesc", "./patches.tese", wantedfragment);
+}
+
+/* Bind the program built from the two files. With asyncshaders a program that is not built yet is
+   requested instead, and the previous one stays bound until FrameBoundary finds the new one ready.
+ */
+void UseProgram(const char *vertexfile, const char *fragmentfile) {
+  wantedvertex = vertexfile;
+  wantedfragment = fragmentfile;
+  wantedinstanced = instancing && mode != 3;
+  wantedtessellated = tessellation && mode != 3 && !(mode == 1 && pointlights); /* The point lights need clustered.vert's view-space outputs */
+  const ShaderProgram *program = WantedProgram(asyncshaders && shaderprogram);
+  programpending = !program;
+  if(program)
+    BindProgram(program, wantedinstanced, wantedtessellated);
 }
 
+/* Both programs come from the cache in ShaderCache.cpp, so only the first call for each pair of
+   files reads and compiles them; after that a mode switch just binds the existing program.
+ */
 void SetupShaders(void) {
-  /* Read our shaders into the appropriate buffers */
-  vertexsource = filetobuf("./mode1_mode3.vert");
-  fragmentsource = filetobuf("./mode1_mode3.frag");
-  /* Assign our handles a "name" to new shader objects */
-  vertexshader = glCreateShader(GL_VERTEX_SHADER);
-  fragmentshader = glCreateShader(GL_FRAGMENT_SHADER);
-  /* Associate the source code buffers with each handle */
-  glShaderSource(vertexshader, 1, (const GLchar**)&vertexsource, 0);
-  glShaderSource(fragmentshader, 1, (const GLchar**)&fragmentsource, 0);
-  /* Compile our shader objects */
-  glCompileShader(vertexshader);
-  glCompileShader(fragmentshader);
-  /* Assign our program handle a "name" */
-  shaderprogram = glCreateProgram();
-  glAttachShader(shaderprogram, vertexshader);  /* Attach our shaders to our program */
-  glAttachShader(shaderprogram, fragmentshader);
-  glBindAttribLocation(shaderprogram, 0, "in_Position");   /* Bind attribute 0 (coordinates) to in_Position and attribute 1 (colors) to in_Color */
-  glBindAttribLocation(shaderprogram, 1, "in_Color");
-  glLinkProgram(shaderprogram);  /* Link our program, and set it as being actively used */
-  CheckShader(shaderprogram, "Basic Shader");
-  glUseProgram(shaderprogram);
+  PROFILE_ZONE("SetupShaders");
+  if(softbackend){
+    SoftShade(SOFT_SHADE_COLOUR);
+    programinstanced = instancing && mode != 3;
+    return;
+  }
+  if(instancing && mode != 3) /* The deformed sphere is one draw with its own MVP */
+    UseProgram("./mode1_mode3_instanced.vert", "./mode1_mode3.frag");
+  else
+    UseProgram("./mode1_mode3.vert", "./mode1_mode3.frag");
 }
 
 void SetupShaders2(void) {
-  vertexsource = filetobuf("./mode2.vert");
-  fragmentsource = filetobuf("./mode2.frag");
-  vertexshader = glCreateShader(GL_VERTEX_SHADER);
-  fragmentshader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(vertexshader, 1, (const GLchar**)&vertexsource, 0);
-  glShaderSource(fragmentshader, 1, (const GLchar**)&fragmentsource, 0);
-  glCompileShader(vertexshader);
-  glCompileShader(fragmentshader);
-  shaderprogram = glCreateProgram();
-  glAttachShader(shaderprogram, vertexshader);
-  glAttachShader(shaderprogram, fragmentshader);
-  glBindAttribLocation(shaderprogram, 0, "in_Position");
-  glBindAttribLocation(shaderprogram, 1, "in_Color");
-  glLinkProgram(shaderprogram);
-  CheckShader(shaderprogram, "Basic Shader");
-  glUseProgram(shaderprogram);
+  PROFILE_ZONE("SetupShaders");
+  if(softbackend){
+    SoftShade(SOFT_SHADE_LAMBERT);
+    programinstanced = instancing;
+    return;
+  }
+  if(pointlights)
+    UseProgram(instancing ? "./clustered_instanced.vert" : "./clustered.vert", "./clustered.frag");
+  else if(instancing)
+    UseProgram("./mode2_instanced.vert", "./mode2.frag");
+  else
+    UseProgram("./mode2.vert", "./mode2.frag");
+}
+
+/* Between frames: finish background loads, then bind the program SetupShaders asked for once it
+   has been built, or its replacement after a hot reload.
+ */
+void FrameBoundary() {
+  PROFILE_ZONE("FrameBoundary");
+  PollAsyncLoads();
+  if(softbackend)
+    return;
+  bool reloaded = UpdateShaderPrograms();
+  if((reloaded || programpending) && wantedvertex){
+    const ShaderProgram *program = WantedProgram(true);
+    programpending = !program;
+    if(program)
+      BindProgram(program, wantedinstanced, wantedtessellated);
+  }
+  if(reloaded)
+    impostorprogram = NULL;
+  if(impostors && !impostorprogram)
+    impostorprogram = RequestShaderProgram(IMPOSTOR_VERTEX, IMPOSTOR_FRAGMENT);
+  const ShaderProgram *inuse[2] = {shaderprogram, impostorprogram};
+  ReleaseSupersededPrograms(inuse, 2);
+}
+
+/* Model matrices of the parts of one rocket relative to the rocket. They never change, so they are
+   built once by SetupRocket rather than every frame.
+ */
+glm::mat4 rocketspheres[3], rocketcones[3], rocketcylinder;
+/* Instance matrices gathered each frame, one list per level of detail; they keep their capacity so
+   steady state allocates nothing */
+std::vector<glm::mat4> sphereinstances[MAX_LOD_LEVELS], coneinstances[MAX_LOD_LEVELS], cylinderinstances[MAX_LOD_LEVELS];
+std::vector<glm::mat4> directmatrices; /* MVP of each visible part when instancing is off */
+std::vector<unsigned char> directlods;  /* And its level of detail */
+
+/* The rocket field as a scene graph: square clusters of ROCKET_CLUSTER x ROCKET_CLUSTER rockets,
+   each rocket a group node over its seven parts. Unless the rockets spin nothing in it moves (the
+   animation is all in the view), so the world matrices and bounds are computed once when it is
+   built. */
+#define ROCKET_CLUSTER 8
+int scenerockets = -1;  /* Rockets in the scene graph; -1 until it is built */
+std::vector<int> visiblenodes;
+std::vector<int> rocketnodes;            /* Group node of each rocket */
+std::vector<glm::mat4> rocketplacements, rocketlocals; /* Grid position, and that with this frame's spin */
+/* Per-thread instance matrices of the sphere, cylinder and cone at each level, merged into the
+   vectors above */
+ThreadBuffers<glm::mat4> instancebuffers[3][MAX_LOD_LEVELS];
+/* Level of detail of every scene node when it was last drawn, for SelectLOD's hysteresis */
+std::vector<unsigned char> nodelods;
+/* This frame's chains of the sphere, cylinder and cone, cut to one level where LOD is off, and the
+   projection's pixels per unit of radius over clip w */
+LODChain drawnlods[3];
+float lodpixelscale;
+
+void SetupRocket() {
+  glm::mat4 Model = glm::mat4(1.0);
+  rocketspheres[0] = Model;
+
+  // Cylinder
+  Model = glm::translate(Model, glm::vec3(0.f, 2.f, 0.f));
+  rocketcylinder = Model;
+
+  // Cone
+  Model = glm::mat4(1.0);
+  GLfloat cone_angle = M_PI/2;
+  Model = glm::rotate(Model, cone_angle * 1.0f, glm::vec3(1.f, 0.f, 0.f));
+  Model = glm::translate(Model, glm::vec3(0.f, 0.f, -6.f));
+  rocketcones[0] = Model;
+
+  // Second sphere
+  Model = glm::mat4(1.0);
+  Model = glm::translate(Model, glm::vec3(1.5f, 3.75f, 0.0f));
+  Model = glm::scale(Model, glm::vec3(0.5f, 0.5f, 0.5f));
+  rocketspheres[1] = Model;
+
+  // Third sphere
+  Model = glm::mat4(1.0);
+  Model = glm::translate(Model, glm::vec3(-1.5f, 3.75f, 0.0f));
+  Model = glm::scale(Model, glm::vec3(0.5f, 0.5f, 0.5f));
+  rocketspheres[2] = Model;
+
+  // Second cone
+  Model = glm::mat4(1.0);
+  Model = glm::rotate(Model, cone_angle * 1.0f, glm::vec3(1.f, 0.f, 0.f));
+  Model = glm::translate(Model, glm::vec3(1.5f, 0.f, -5.f));
+  Model = glm::scale(Model, glm::vec3(0.5f, 0.5f, 0.5f));
+  rocketcones[1] = Model;
+
+  // Third cone
+  Model = glm::mat4(1.0);
+  Model = glm::rotate(Model, cone_angle * 1.0f, glm::vec3(1.f, 0.f, 0.f));
+  Model = glm::translate(Model, glm::vec3(-1.5f, 0.f, -5.f));
+  Model = glm::scale(Model, glm::vec3(0.5f, 0.5f, 0.5f));
+  rocketcones[2] = Model;
+}
+
+/* Placement of rocket i on a square grid centred on the origin; rocket 0 of 1 sits at the origin */
+glm::mat4 RocketTransform(int i) {
+  int side = (int)ceil(sqrt((double)rockets));
+  float spacing = 10.f;
+  float x = (i % side - (side - 1) / 2.f) * spacing;
+  float y = (i / side - (side - 1) / 2.f) * spacing;
+  return glm::translate(glm::mat4(1.0), glm::vec3(x, y, 0.f));
+}
+
+/* (Re)build the scene graph when the number of rockets has changed */
+void BuildRocketScene() {
+  if(scenerockets == rockets)
+    return;
+  ClearScene();
+  rocketnodes.resize(rockets);
+  rocketplacements.resize(rockets);
+  rocketlocals.resize(rockets);
+  int side = (int)ceil(sqrt((double)rockets));
+  int clusters = (side + ROCKET_CLUSTER - 1) / ROCKET_CLUSTER;
+  std::vector<int> clusternodes(clusters * clusters, -1);
+  for(int r = 0; r<rockets; r++){
+    int c = (r / side / ROCKET_CLUSTER) * clusters + (r % side) / ROCKET_CLUSTER;
+    if(clusternodes[c] < 0)
+      clusternodes[c] = AddSceneNode(-1, glm::mat4(1.0), NULL);
+    rocketplacements[r] = RocketTransform(r);
+    int rocket = rocketnodes[r] = AddSceneNode(clusternodes[c], rocketplacements[r], NULL);
+    for(int i = 0; i<3; i++)
+      AddSceneNode(rocket, rocketspheres[i], sphere);
+    AddSceneNode(rocket, rocketcylinder, cylinder);
+    for(int i = 0; i<3; i++)
+      AddSceneNode(rocket, rocketcones[i], cone);
+  }
+  UpdateScene();
+  nodelods.assign(SceneNodeCount(), 0);
+  scenerockets = rockets;
+}
+
+/* Turn every rocket by angle about its vertical axis. The new local matrices are composed in
+   parallel batches; UpdateScene then redoes the rockets' subtrees. */
+void SpinRockets(float angle) {
+  PROFILE_ZONE("SpinRockets");
+  glm::mat4 spin = glm::rotate(glm::mat4(1.0), angle, glm::vec3(0.f, 1.f, 0.f));
+  ParallelFor(rocketplacements.size(), 1024, [&](size_t begin, size_t end){
+    MultiplyMatrices(rocketplacements.data() + begin, 1, &spin, 0, rocketlocals.data() + begin, end - begin);
+  });
+  for(size_t r = 0; r<rocketnodes.size(); r++)
+    SetSceneNodeTransform(rocketnodes[r], rocketlocals[r]);
+}
+
+static double Seconds() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const double starttime = Seconds(); /* Animation clock; works with or without GLFW */
+#define ANIMATION_PERIOD 400. /* Seconds after which the animation starts over */
+
+/* Print the time from start-up to the first finished frame, once */
+void ReportFirstFrame() {
+  static bool reported = false;
+  if(reported)
+    return;
+  reported = true;
+  printf("First frame after %.1f ms\n", (Seconds() - starttime) * 1000);
+}
+
+GLenum polygonmode = GL_FILL; /* As last set by SetPolygonMode */
+
+/* The GL state changes Render makes, sent to whichever backend is drawing */
+void SetPolygonMode(GLenum newmode) {
+  polygonmode = newmode;
+  if(softbackend)
+    SoftPolygonMode(polygonmode);
+  else
+    glPolygonMode(GL_FRONT_AND_BACK, polygonmode);
+}
+
+void ClearFrame() {
+  static const GLfloat black[3] = {0, 0, 0};
+  if(softbackend)
+    SoftClear(black);
+  else {
+    glClearColor(0.0, 0.0, 0.0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  }
+}
+
+/* Draw everything submitted this frame and wait for it: glFinish, or the software raster pass */
+void FinishFrame() {
+  if(softbackend)
+    SoftFinish();
+  else
+    glFinish();
+}
+
+glm::mat4 softviewprojection; /* The software backend's viewprojection "uniform" */
+
+void SetViewProjection(const glm::mat4 &VP) {
+  if(softbackend){
+    softviewprojection = VP;
+    return;
+  }
+  glUniformMatrix4fv(shaderprogram->uniforms[UNIFORM_VIEWPROJECTION], 1, GL_FALSE, glm::value_ptr(VP));
+  framestats.bytesuploaded += sizeof(glm::mat4);
+}
+
+/* Draw count instances of mesh with the viewprojection from SetViewProjection */
+void DrawInstances(const Mesh *mesh, const glm::mat4 *models, GLsizei count) {
+  if(!count)
+    return;
+  if(!softbackend){
+    DrawMeshInstanced(DrawnMesh(mesh), glm::value_ptr(models[0]), count);
+    return;
+  }
+  for(GLsizei i = 0; i<count; i++)
+    SoftDraw(mesh->data, glm::value_ptr(softviewprojection * models[i]));
+}
+
+/* Draw several meshes' instances together: one multi-draw call per arena and primitive on the GL.
+   Patches need their own axis each, so they are drawn one mesh at a time. */
+void DrawBatches(const MeshBatch *batches, int count) {
+  if(!softbackend && !programtessellated){
+    DrawMeshBatches(batches, count);
+    return;
+  }
+  for(int b = 0; b<count; b++)
+    DrawInstances(batches[b].mesh, (const glm::mat4 *)batches[b].models, batches[b].count);
+}
+
+/* Draw one object with its own MVP uniform, the path used when instancing is off */
+void DrawDirect(const Mesh *mesh, const glm::mat4 &MVP) {
+  if(softbackend){
+    SoftDraw(mesh->data, glm::value_ptr(MVP));
+    return;
+  }
+  /* Bind our modelmatrix variable to be a uniform called mvpmatrix in our shaderprogram */
+  glUniformMatrix4fv(shaderprogram->uniforms[UNIFORM_MVPMATRIX], 1, GL_FALSE, glm::value_ptr(MVP));
+  framestats.bytesuploaded += sizeof(glm::mat4);
+  DrawMesh(DrawnMesh(mesh));
+}
+
+/* Draw count spheres as impostors, one instanced quad each. The quads are always filled, and the
+   program Render bound is bound again afterwards. */
+void DrawImpostors(const glm::mat4 &Projection, const glm::mat4 &View, const glm::mat4 *models, GLsizei count) {
+  if(!count)
+    return;
+  glUseProgram(impostorprogram->program);
+  glUniformMatrix4fv(impostorprogram->uniforms[UNIFORM_VIEW], 1, GL_FALSE, glm::value_ptr(View));
+  glUniformMatrix4fv(impostorprogram->uniforms[UNIFORM_PROJECTION], 1, GL_FALSE, glm::value_ptr(Projection));
+  framestats.bytesuploaded += 2 * sizeof(glm::mat4);
+  if(polygonmode != GL_FILL)
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  DrawMeshInstanced(impostorquad, glm::value_ptr(models[0]), count);
+  if(polygonmode != GL_FILL)
+    glPolygonMode(GL_FRONT_AND_BACK, polygonmode);
+  if(shaderprogram)
+    glUseProgram(shaderprogram->program);
+}
+
+/* The deformed sphere for this frame: alpha of the way between the two states of snapshot when
+   both have it, or deformed here for time t */
+void FillDeformedSphere(Vertex *out, float t, const SceneSnapshot *snapshot, float alpha) {
+  size_t count = deformbase.size() * 3;
+  if(!snapshot || snapshot->from.deformed.size() != count || snapshot->to.deformed.size() != count){
+    DeformSphere(out, t);
+    return;
+  }
+  const Vertex *from = snapshot->from.deformed.data(), *to = snapshot->to.deformed.data();
+  ParallelFor(count, 3072, [&](size_t first, size_t last){
+    for(size_t i = first; i<last; i++)
+      for(int k = 0; k<3; k++){
+        out[i].position[k] = from[i].position[k] + (to[i].position[k] - from[i].position[k]) * alpha;
+        out[i].color[k] = from[i].color[k] + (to[i].color[k] - from[i].color[k]) * alpha;
+      }
+  });
+}
+
+/* Deform the sphere into this frame's part of the stream buffer and draw it */
+void DrawDeformedSphere(const glm::mat4 &MVP, float t, const SceneSnapshot *snapshot, float alpha) {
+  PROFILE_ZONE("DrawDeformedSphere");
+  GLsizei count = deformbase.size() * 3;
+  if(softbackend){
+    FillDeformedSphere(deformdata.vertices.data(), t, snapshot, alpha);
+    SoftDraw(&deformdata, glm::value_ptr(MVP));
+    return;
+  }
+  GLintptr offset;
+  StreamBeginFrame(&deformstream);
+  Vertex *vertices = (Vertex *)StreamMap(&deformstream, count * sizeof(Vertex), &offset);
+  FillDeformedSphere(vertices, t, snapshot, alpha);
+  StreamUnmap(&deformstream);
+  glBindVertexArray(deformvao);
+  glBindBuffer(GL_ARRAY_BUFFER, deformstream.buffer);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)(offset + offsetof(Vertex, position)));
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)(offset + offsetof(Vertex, color)));
+  glUniformMatrix4fv(shaderprogram->uniforms[UNIFORM_MVPMATRIX], 1, GL_FALSE, glm::value_ptr(MVP));
+  glDrawArrays(GL_TRIANGLES, 0, count);
+  glBindVertexArray(0);
+  StreamEndFrame(&deformstream);
+  framestats.drawcalls++;
+  framestats.vertices += count;
+  framestats.triangles += count / 3;
+  framestats.bytesuploaded += sizeof(glm::mat4);
+}
+
+/* Visible nodes sorted into instance lists per parallel chunk */
+#define INSTANCE_GRAIN 2048
+
+/* Set up this frame's levels of detail. Tessellation refines its patches by itself and
+   impostors are exact, so those draw everything at level 0. */
+void ChooseLODChains(const glm::mat4 &Projection, bool impostorspheres) {
+  const LODChain *chains[3] = {&spherelods, &cylinderlods, &conelods};
+  for(int p = 0; p<3; p++){
+    drawnlods[p] = *chains[p];
+    if(!lod || programtessellated || (p == 0 && impostorspheres))
+      drawnlods[p].count = 1;
+  }
+  lodpixelscale = Projection[1][1] * viewportheight / 2;
+  nodelods.resize(SceneNodeCount(), 0);
+}
+
+/* Which of the sphere (0), cylinder (1) and cone (2) a rocket part is */
+static inline int RocketPart(const SceneNode &node) {
+  return node.mesh == sphere ? 0 : (node.mesh == cone ? 2 : 1);
+}
+
+/* Pick the level of detail of scene node id for this frame and remember it. Nodes are only ever
+   written by the chunk that holds them. */
+static inline int NodeLOD(int id, const SceneNode &node, int part, const glm::mat4 &VP) {
+  const LODChain &chain = drawnlods[part];
+  if(chain.count < 2)
+    return 0;
+  int level = SelectLOD(chain, ProjectedRadius(VP, lodpixelscale, node.bounds), nodelods[id]);
+  nodelods[id] = level;
+  return level;
+}
+
+/* Update and cull the rocket field, then build what the draws need from the visible parts: the
+   instance lists per part and level of detail, or with instanced false one MVP and level per part
+   in directmatrices and directlods. All of it runs on the thread pool and comes out the same for
+   any number of threads. ChooseLODChains must have been called for the frame.
+ */
+void BuildRocketDrawLists(const glm::mat4 &VP, bool instanced) {
+  int p, l;
+  visiblenodes.clear();
+  {
+    PROFILE_ZONE("CullScene");
+    UpdateScene();
+    framestats.nodestested += CullScene(VP, visiblenodes);
+  }
+  if(!instanced){
+    PROFILE_ZONE("BuildMatrices");
+    directmatrices.resize(visiblenodes.size());
+    directlods.resize(visiblenodes.size());
+    ParallelFor(visiblenodes.size(), INSTANCE_GRAIN, [&](size_t begin, size_t end){
+      for(size_t n = begin; n<end; n += MATRIX_BATCH){
+        glm::mat4 worlds[MATRIX_BATCH];
+        size_t count = std::min(end - n, (size_t)MATRIX_BATCH);
+        for(size_t k = 0; k<count; k++){
+          const SceneNode &node = GetSceneNode(visiblenodes[n + k]);
+          worlds[k] = node.world;
+          directlods[n + k] = NodeLOD(visiblenodes[n + k], node, RocketPart(node), VP);
+        }
+        MultiplyMatrices(&VP, 0, worlds, 1, directmatrices.data() + n, count);
+      }
+    });
+    return;
+  }
+  {
+    /* Every thread sorts its chunks of the visible list into its own buffers; the merge puts the
+       chunks back in order, so the instances are the same as a serial pass's */
+    PROFILE_ZONE("BuildInstances");
+    for(p = 0; p<3; p++)
+      for(l = 0; l<MAX_LOD_LEVELS; l++)
+        instancebuffers[p][l].Reset();
+    ParallelFor(visiblenodes.size(), INSTANCE_GRAIN, [&VP](size_t begin, size_t end){
+      size_t chunk = begin / INSTANCE_GRAIN;
+      std::vector<glm::mat4> *lists[3][MAX_LOD_LEVELS];
+      for(int b = 0; b<3; b++)
+        for(int k = 0; k<MAX_LOD_LEVELS; k++)
+          lists[b][k] = &instancebuffers[b][k].Begin(chunk);
+      for(size_t n = begin; n<end; n++){
+        const SceneNode &node = GetSceneNode(visiblenodes[n]);
+        int part = RocketPart(node);
+        lists[part][NodeLOD(visiblenodes[n], node, part, VP)]->push_back(node.world);
+      }
+      for(int b = 0; b<3; b++)
+        for(int k = 0; k<MAX_LOD_LEVELS; k++)
+          instancebuffers[b][k].End();
+    });
+    std::vector<glm::mat4> *parts[3] = {sphereinstances, cylinderinstances, coneinstances};
+    for(p = 0; p<3; p++)
+      for(l = 0; l<MAX_LOD_LEVELS; l++){
+        parts[p][l].clear();
+        instancebuffers[p][l].Merge(parts[p][l]);
+      }
+  }
+}
+
+/* Draw the parts of the rocket field that survive frustum culling, each at its level of detail.
+   Only the draws themselves are issued from this thread. Impostor spheres are one instanced draw
+   whether instancing is on or not. */
+void DrawRockets(const glm::mat4 &Projection, const glm::mat4 &View) {
+  PROFILE_ZONE("DrawRockets");
+  bool impostorspheres = DrawingImpostors();
+  ChooseLODChains(Projection, impostorspheres);
+  BuildRocketDrawLists(Projection * View, programinstanced);
+  if(!programinstanced){
+    sphereinstances[0].clear();
+    for(size_t i = 0; i<visiblenodes.size(); i++){
+      const SceneNode &node = GetSceneNode(visiblenodes[i]);
+      int part = RocketPart(node);
+      if(impostorspheres && part == 0){
+        sphereinstances[0].push_back(node.world);
+        continue;
+      }
+      const Mesh *mesh = drawnlods[part].meshes[directlods[i]];
+      DrawDirect(mesh, directmatrices[i]);
+      if(!programtessellated) /* Patches are not the mesh's triangles */
+        framestats.lodtriangles[directlods[i]] += mesh->triangles;
+    }
+    if(impostorspheres)
+      DrawImpostors(Projection, View, sphereinstances[0].data(), sphereinstances[0].size());
+    return;
+  }
+  SetViewProjection(Projection * View);
+  std::vector<glm::mat4> *parts[3] = {sphereinstances, cylinderinstances, coneinstances};
+  MeshBatch batches[3 * MAX_LOD_LEVELS];
+  int count = 0;
+  for(int p = impostorspheres ? 1 : 0; p<3; p++)
+    for(int l = 0; l<drawnlods[p].count; l++){
+      MeshBatch batch = {drawnlods[p].meshes[l], (const GLfloat *)parts[p][l].data(), (GLsizei)parts[p][l].size()};
+      batches[count++] = batch;
+      if(!programtessellated)
+        framestats.lodtriangles[l] += (unsigned long long)batch.mesh->triangles * batch.count;
+    }
+  DrawBatches(batches, count);
+  if(impostorspheres)
+    DrawImpostors(Projection, View, sphereinstances[0].data(), sphereinstances[0].size());
+}
+
+/* The point lights of mode 1, each circling the sphere on its own tilted orbit */
+struct LightOrbit {
+  glm::vec3 axis, start;  /* start is at right angles to axis and as long as the orbit's radius */
+  float speed;            /* Radians per second */
+};
+std::vector<LightOrbit> lightorbits;
+std::vector<PointLight> lightlist;
+
+/* Uniform in [0, 1) from a linear congruential generator, so every run makes the same lights */
+static float NextRandom(unsigned *seed) {
+  *seed = *seed * 1664525u + 1013904223u;
+  return (*seed >> 8) / 16777216.f;
+}
+
+/* Make count lights in the shell between radii 1.05 and 2 about the unit sphere. The range
+   shrinks as the count grows so that about the same number of lights reach any point. */
+void SetupLights(int count) {
+  unsigned seed = 1;
+  float range = cbrtf(24.f / count);
+  lightorbits.resize(count);
+  lightlist.resize(count);
+  for(int i = 0; i<count; i++){
+    glm::vec3 axis = glm::normalize(glm::vec3(NextRandom(&seed) - 0.5f, NextRandom(&seed) - 0.5f, NextRandom(&seed) - 0.5f) + glm::vec3(0.f, 0.f, 1e-3f));
+    glm::vec3 across = glm::normalize(glm::cross(axis, fabsf(axis.y) < 0.99f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(1.f, 0.f, 0.f)));
+    float phase = NextRandom(&seed) * 2.f * (float)M_PI;
+    lightorbits[i].axis = axis;
+    lightorbits[i].start = (across * cosf(phase) + glm::cross(axis, across) * sinf(phase)) * (1.05f + 0.95f * NextRandom(&seed));
+    lightorbits[i].speed = 0.2f + 0.6f * NextRandom(&seed);
+    /* A saturated colour: one channel full, one empty, one anywhere between */
+    float c[3] = {1.f, NextRandom(&seed), 0.f};
+    int first = (int)(NextRandom(&seed) * 3) % 3;
+    lightlist[i].colour = glm::vec3(c[first], c[(first + 1) % 3], c[(first + 2) % 3]) * 0.6f;
+    lightlist[i].range = range;
+  }
+}
+
+/* Where the orbit has taken its light at time t */
+static glm::vec3 LightPosition(const LightOrbit &orbit, float t) {
+  float a = orbit.speed * t;
+  return orbit.start * cosf(a) + glm::cross(orbit.axis, orbit.start) * sinf(a);
+}
+
+/* Put the lights where they are at time t, or alpha of the way between the two states of
+   snapshot when both have them */
+void MoveLights(float t, const SceneSnapshot *snapshot, float alpha) {
+  if(snapshot && snapshot->from.lights.size() == lightlist.size() && snapshot->to.lights.size() == lightlist.size()){
+    for(size_t i = 0; i<lightlist.size(); i++)
+      lightlist[i].position = glm::mix(snapshot->from.lights[i], snapshot->to.lights[i], alpha);
+    return;
+  }
+  for(size_t i = 0; i<lightorbits.size(); i++)
+    lightlist[i].position = LightPosition(lightorbits[i], t);
+}
+
+/* The simulation thread's step: what moves in the current mode, at time. The mode is read once,
+   and deformbase only once SetupDeformedSphere has published it; lightorbits never change while
+   the thread runs. */
+void StepScene(double time, SceneState *state) {
+  float t = fmod(time, ANIMATION_PERIOD);
+  state->mode = simmode;
+  state->deformed.clear();
+  state->lights.clear();
+  if(state->mode == 3 && deformready){
+    state->deformed.resize(deformbase.size() * 3);
+    DeformSphere(state->deformed.data(), t);
+  }
+  if(state->mode == 1)
+    for(size_t i = 0; i<lightorbits.size(); i++)
+      state->lights.push_back(LightPosition(lightorbits[i], t));
 }
 
 void Render() {
-  glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+  PROFILE_ZONE("Render");
+  SetPolygonMode(GL_LINE);
   GLfloat angle;
   glm::mat4 Projection = glm::perspective(45.0f, 1.0f, 0.1f, 100.0f);
-  float t = glfwGetTime();
-  float p = 400.;
-  t = fmod(t, p);
-  angle = t * 360. / p;
+  /* The simulation thread's newest snapshot, interpolated to now; its parts for another mode
+     are empty, and the draws below then compute theirs here */
+  double now = Seconds();
+  double time = now - starttime;
+  const SceneSnapshot *snapshot = LatestSnapshot(now);
+  float alpha = 0;
+  if(snapshot){
+    alpha = SnapshotAlpha(*snapshot, time);
+    time = snapshot->from.time + (snapshot->to.time - snapshot->from.time) * alpha;
+    framestats.simms = snapshot->stepms;
+    framestats.snapshotms = (now - snapshot->published) * 1000;
+  }
+  float t = fmod(time, ANIMATION_PERIOD);
+  angle = t * 360. / ANIMATION_PERIOD;
   glm::mat4 View = glm::mat4(1.);
   glm::mat4 Model = glm::mat4(1.0);
   if((mode == 0)||(mode == 1)){
@@ -420,129 +1246,1017 @@ void Render() {
       View = glm::translate(View, glm::vec3(0.f, 0.f, -5.0f));
       Model = glm::rotate(Model, angle * -1.0f, glm::vec3(0.f, 0.f, 1.f));
     }
-    glm::mat4 MVP = Projection * View * Model;
-    glUniformMatrix4fv(glGetUniformLocation(shaderprogram, "mvpmatrix"), 1, GL_FALSE, glm::value_ptr(MVP));
-    /* Bind our modelmatrix variable to be a uniform called mvpmatrix in our shaderprogram */
-    glClearColor(0.0, 0.0, 0.0, 1.0);  /* Make our background black */
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glBindVertexArray(vao);
-    if(mode == 0){
-      glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-      glDrawArrays(GL_TRIANGLES, 0, v.size());
-    }
-    if(mode == 1){
-      glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-      glDrawArrays(GL_TRIANGLE_FAN, 0, v.size());
+    ClearFrame();  /* Make our background black */
+    if(mode == 0)
+      SetPolygonMode(GL_LINE);
+    if(mode == 1)
+      SetPolygonMode(GL_FILL);
+    if(mode == 1 && !softbackend && shaderprogram && shaderprogram->uniforms[UNIFORM_CLUSTERS] >= 0){
+      MoveLights(t, snapshot, alpha);
+      BuildLightClusters(lightlist, View, Projection);
+      BindLightClusters(shaderprogram, 0);
+      glUniformMatrix4fv(shaderprogram->uniforms[UNIFORM_VIEW], 1, GL_FALSE, glm::value_ptr(View));
+      glUniformMatrix4fv(shaderprogram->uniforms[UNIFORM_MODELVIEW], 1, GL_FALSE, glm::value_ptr(View * Model));
+      framestats.bytesuploaded += 2 * sizeof(glm::mat4);
     }
-    glBindVertexArray(0);
+    if(mode == 1 && DrawingImpostors())
+      DrawImpostors(Projection, View, &Model, 1);
+    else if(programinstanced){
+      SetViewProjection(Projection * View);
+      DrawInstances(sphere, &Model, 1);
+    } else
+      DrawDirect(sphere, Projection * View * Model);
   }
 
   if(mode == 2){ /* Draw a basic wireframe rocket */
-    // Draw the sphere
     glm::mat4 View = glm::mat4(1.);
     View = glm::translate(View, glm::vec3(0.f, 0.f, -5.0f));
     View = glm::scale(View, glm::vec3(0.5f, 0.5f, 0.5f));
     View = glm::rotate(View, angle * -1.0f, glm::vec3(1.f, 0.f, 0.f));
     View = glm::rotate(View, angle * 0.5f, glm::vec3(0.f, 1.f, 0.f));
     View = glm::rotate(View, angle * 0.5f, glm::vec3(0.f, 0.f, 1.f));
-    glm::mat4 Model = glm::mat4(1.0);
-    glm::mat4 MVP = Projection * View * Model;
-    glUniformMatrix4fv(glGetUniformLocation(shaderprogram, "mvpmatrix"), 1, GL_FALSE, glm::value_ptr(MVP));
-    glClearColor(0.0, 0.0, 0.0, 1.0);  /* Make our background black. Do NOT use when drawing several objects */
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLES, 0, v.size());
-    glBindVertexArray(0);
-
-    // Draw the cylinder
-    Model = glm::translate(Model, glm::vec3(0.f, 0.f, 0.f));
-    GLfloat cylinder_angle = 90.0;
-    Model = glm::translate(Model, glm::vec3(0.f, 2.f, 0.f));
-    MVP = Projection * View * Model;
-    glUniformMatrix4fv(glGetUniformLocation(shaderprogram, "mvpmatrix"), 1, GL_FALSE, glm::value_ptr(MVP));
-    glBindVertexArray(cylindervao);
-    glDrawArrays(GL_LINE_STRIP, 0, cylinderv.size());
-    glBindVertexArray(0);
-    // Draw cone
-    Model = glm::mat4(1.0);
-    GLfloat cone_angle = M_PI/2;
-    Model = glm::rotate(Model, cone_angle * 1.0f, glm::vec3(1.f, 0.f, 0.f));
-    Model = glm::translate(Model, glm::vec3(0.f, 0.f, -6.f));
-    MVP = Projection * View * Model;
-    glUniformMatrix4fv(glGetUniformLocation(shaderprogram, "mvpmatrix"), 1, GL_FALSE, glm::value_ptr(MVP));
-    glBindVertexArray(conevao);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, conev.size());
-    glBindVertexArray(0);
-
-    // second sphere
-    Model = glm::mat4(1.0);
-    Model = glm::translate(Model, glm::vec3(1.5f, 3.75f, 0.0f));
-    Model = glm::scale(Model, glm::vec3(0.5f, 0.5f, 0.5f));
-    MVP = Projection * View * Model;
-    glUniformMatrix4fv(glGetUniformLocation(shaderprogram, "mvpmatrix"), 1, GL_FALSE, glm::value_ptr(MVP));
-    glBindVertexArray(vao); // Use vao for spheres, conevao for cones
-    glDrawArrays(GL_TRIANGLES, 0, v.size());
-    glBindVertexArray(0);
-
-    // third sphere
-    Model = glm::mat4(1.0);
-    Model = glm::translate(Model, glm::vec3(-1.5f, 3.75f, 0.0f));
-    Model = glm::scale(Model, glm::vec3(0.5f, 0.5f, 0.5f));
-    MVP = Projection * View * Model;
-    glUniformMatrix4fv(glGetUniformLocation(shaderprogram, "mvpmatrix"), 1, GL_FALSE, glm::value_ptr(MVP));
-    glBindVertexArray(vao); // Use vao for spheres, conevao for cones
-    glDrawArrays(GL_TRIANGLES, 0, v.size());
-    glBindVertexArray(0);
-
-    // second cone
-    Model = glm::mat4(1.0);
-    Model = glm::rotate(Model, cone_angle * 1.0f, glm::vec3(1.f, 0.f, 0.f));
-    Model = glm::translate(Model, glm::vec3(1.5f, 0.f, -5.f));
-    Model = glm::scale(Model, glm::vec3(0.5f, 0.5f, 0.5f));
-    MVP = Projection * View * Model;
-    glUniformMatrix4fv(glGetUniformLocation(shaderprogram, "mvpmatrix"), 1, GL_FALSE, glm::value_ptr(MVP));
-    glBindVertexArray(conevao);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, conev.size());
-    glBindVertexArray(0);
-
-    // third cone
-    Model = glm::mat4(1.0);
-    Model = glm::rotate(Model, cone_angle * 1.0f, glm::vec3(1.f, 0.f, 0.f));
-    Model = glm::translate(Model, glm::vec3(-1.5f, 0.f, -5.f));
-    Model = glm::scale(Model, glm::vec3(0.5f, 0.5f, 0.5f));
-    MVP = Projection * View * Model;
-    glUniformMatrix4fv(glGetUniformLocation(shaderprogram, "mvpmatrix"), 1, GL_FALSE, glm::value_ptr(MVP));
-    glBindVertexArray(conevao);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, conev.size());
-    glBindVertexArray(0);
+    ClearFrame();  /* Make our background black. Do NOT use when drawing several objects */
+    if(spinrockets)
+      SpinRockets(angle * 8.0f);
+    DrawRockets(Projection, View);
+  }
+
+  if(mode == 3){ /* Draw a sphere deformed on the CPU every frame */
+    View = glm::translate(View, glm::vec3(0.f, 0.f, -5.0f));
+    View = glm::rotate(View, angle * -1.0f, glm::vec3(1.f, 0.f, 0.f));
+    View = glm::rotate(View, angle * 0.5f, glm::vec3(0.f, 1.f, 0.f));
+    ClearFrame();
+    SetPolygonMode(GL_FILL);
+    DrawDeformedSphere(Projection * View, t, snapshot, alpha);
+  }
+
+}
+
+/* Compare facets per second of CreateUnitSphere, CreateUnitSphereIndexed and SubdivideSphere at
+   levels 5 to 12, and check that SubdivideSphere gives the same bytes on one thread as on all of
+   them. The facet-soup version is skipped once it would need more than 1GB.
+ */
+void BenchmarkSubdivision() {
+  int threads = GetThreadCount();
+  printf("%5s %10s %14s %14s %14s %s\n", "level", "facets", "soup f/s", "indexed f/s", "engine f/s", "deterministic");
+  for(int level = 5; level<=12; level++){
+    size_t facets = UnitSphereFacets(level);
+    double soup = 0, indexed = 0, engine;
+    double start;
+    if(facets * sizeof(Facet) <= ((size_t)1 << 30)){
+      Facet *f = (Facet *)malloc(facets * sizeof(Facet));
+      if(f){
+        start = Seconds();
+        CreateUnitSphere(level, f);
+        soup = facets / (Seconds() - start);
+        free(f);
+      }
+      std::vector<Vertex> vertices;
+      std::vector<GLuint> indices;
+      start = Seconds();
+      CreateUnitSphereIndexed(level, vertices, indices);
+      indexed = facets / (Seconds() - start);
+    }
+
+    SubdividedSphere all, one;
+    start = Seconds();
+    SubdivideSphere(level, &all);
+    engine = facets / (Seconds() - start);
+    SetThreadCount(1);
+    SubdivideSphere(level, &one);
+    SetThreadCount(threads);
+    bool same = all.indices == one.indices && !memcmp(all.x.data(), one.x.data(), all.x.size() * sizeof(GLfloat)) &&
+                !memcmp(all.y.data(), one.y.data(), all.y.size() * sizeof(GLfloat)) &&
+                !memcmp(all.z.data(), one.z.data(), all.z.size() * sizeof(GLfloat));
+    printf("%5d %10zu ", level, facets);
+    if(soup > 0)
+      printf("%14.0f %14.0f ", soup, indexed);
+    else
+      printf("%14s %14s ", "-", "-");
+    printf("%14.0f %s\n", engine, same ? "yes" : "NO");
+  }
+  printf("(%d threads)\n", threads);
+}
+
+/* Nanoseconds and heap allocations per call of generate, over reps calls */
+struct GeneratorTiming {
+  double ns, allocations;
+};
+
+template<class Generate> GeneratorTiming TimeGenerator(int reps, const Generate &generate) {
+  unsigned long long before = AllocationCount();
+  double start = Seconds();
+  for(int r = 0; r<reps; r++)
+    generate();
+  GeneratorTiming timing = {(Seconds() - start) * 1e9 / reps, (double)(AllocationCount() - before) / reps};
+  return timing;
+}
+
+volatile float generatorsink; /* Read from every generated mesh so none of them is optimised away */
+
+/* Largest |a[i] - b[i]| over count floats */
+double MaxDifference(const GLfloat *a, const GLfloat *b, size_t count) {
+  double most = 0;
+  for(size_t i = 0; i<count; i++)
+    most = std::max(most, fabs((double)a[i] - b[i]));
+  return most;
+}
+
+void PrintGeneratorRow(const char *shape, int slices, size_t before, size_t after, const GeneratorTiming *timings, double difference) {
+  printf("%-8s %6d %4zu->%-4zu", shape, slices, before, after);
+  for(int i = 0; i<4; i++)
+    printf(" %8.0f %6.1f", timings[i].ns, timings[i].allocations);
+  printf("  %8.1e %s\n", difference, difference <= FLT_EPSILON ? "yes" : "NO");
+}
+
+/* One row each of BenchmarkGenerators: the original generator, the kernel with runtime trig into
+   a MeshData sized once, the one CreateCone and CreateCylinder use now, with the compiled table,
+   and Cone<Slices> and Cylinder<Slices> into their arrays. The row ends with the largest
+   difference between the mesh from the compiler's constexpr sines and cosines and the one from
+   libm's, and whether that is within 1 ulp of the unit radius. It is measured against the radius
+   rather than each value because the two disagree only where a sine or cosine is zero, and there
+   both are rounding noise around 1e-16. */
+template<int Slices> void BenchmarkConeLevel(int reps) {
+  GeneratorTiming timings[4];
+  MeshData original, current, runtime;
+  CreateConePushBack(Slices, &original);
+  CreateCone(Slices, &current);
+  runtime.vertices.resize(ConeVertexCount(Slices));
+  runtime.normals.resize(3 * ConeVertexCount(Slices));
+  ConeKernel(RuntimeSliceTable(Slices), Slices, runtime.vertices.data(), runtime.normals.data());
+  timings[0] = TimeGenerator(reps, [&]{
+    MeshData mesh;
+    CreateConePushBack(Slices, &mesh);
+    generatorsink = mesh.vertices[1].position[0];
+  });
+  timings[1] = TimeGenerator(reps, [&]{
+    MeshData mesh;
+    mesh.vertices.resize(ConeVertexCount(Slices));
+    mesh.normals.resize(3 * ConeVertexCount(Slices));
+    ConeKernel(RuntimeSliceTable(Slices), Slices, mesh.vertices.data(), mesh.normals.data());
+    generatorsink = mesh.vertices[1].position[0];
+  });
+  timings[2] = TimeGenerator(reps, [&]{
+    MeshData mesh;
+    CreateCone(Slices, &mesh);
+    generatorsink = mesh.vertices[1].position[0];
+  });
+  Cone<Slices> cone;
+  timings[3] = TimeGenerator(reps, [&]{
+    cone.Generate();
+    generatorsink = cone.vertices[1].position[0];
+  });
+  double difference = std::max(MaxDifference(cone.vertices[0].position, runtime.vertices[0].position, cone.vertices.size() * 6),
+                                MaxDifference(cone.normals.data(), runtime.normals.data(), cone.normals.size()));
+  PrintGeneratorRow("cone", Slices, original.vertices.size(), current.vertices.size(), timings, difference);
+}
+
+template<int Slices> void BenchmarkCylinderLevel(int reps) {
+  GeneratorTiming timings[4];
+  MeshData original, current, runtime;
+  CreateCylinderPushBack(Slices, &original);
+  CreateCylinder(Slices, &current);
+  runtime.vertices.resize(CylinderVertexCount(Slices));
+  runtime.indices.resize(CylinderIndexCount(Slices));
+  CylinderKernel(RuntimeSliceTable(Slices), Slices, runtime.vertices.data(), runtime.indices.data());
+  timings[0] = TimeGenerator(reps, [&]{
+    MeshData mesh;
+    CreateCylinderPushBack(Slices, &mesh);
+    generatorsink = mesh.vertices[2].position[0];
+  });
+  timings[1] = TimeGenerator(reps, [&]{
+    MeshData mesh;
+    mesh.vertices.resize(CylinderVertexCount(Slices));
+    mesh.indices.resize(CylinderIndexCount(Slices));
+    CylinderKernel(RuntimeSliceTable(Slices), Slices, mesh.vertices.data(), mesh.indices.data());
+    generatorsink = mesh.vertices[2].position[0];
+  });
+  timings[2] = TimeGenerator(reps, [&]{
+    MeshData mesh;
+    CreateCylinder(Slices, &mesh);
+    generatorsink = mesh.vertices[2].position[0];
+  });
+  Cylinder<Slices> cylinder;
+  timings[3] = TimeGenerator(reps, [&]{
+    cylinder.Generate();
+    generatorsink = cylinder.vertices[2].position[0];
+  });
+  double difference = MaxDifference(cylinder.vertices[0].position, runtime.vertices[0].position, cylinder.vertices.size() * 6);
+  if(memcmp(cylinder.indices.data(), runtime.indices.data(), sizeof(cylinder.indices)))
+    difference = INFINITY;
+  PrintGeneratorRow("cylinder", Slices, original.vertices.size(), current.vertices.size(), timings, difference);
+}
+
+/* Time every level of detail of the cone and cylinder generators, old and new, with the heap
+   allocations each call makes. Single-threaded; the meshes are small enough to stay in cache. */
+void BenchmarkGenerators() {
+  const int reps = 20000;
+  printf("%-8s %6s %10s %15s %15s %15s %15s  %s\n", "shape", "slices", "vertices", "original", "runtime trig",
+         "compiled table", "std::array", "vs libm");
+  printf("%-8s %6s %10s", "", "", "");
+  for(int i = 0; i<4; i++)
+    printf(" %8s %6s", "ns", "allocs");
+  printf("  %8s\n", "max diff");
+  BenchmarkConeLevel<32>(reps);
+  BenchmarkConeLevel<16>(reps);
+  BenchmarkConeLevel<8>(reps);
+  BenchmarkConeLevel<4>(reps);
+  BenchmarkCylinderLevel<50>(reps);
+  BenchmarkCylinderLevel<25>(reps);
+  BenchmarkCylinderLevel<12>(reps);
+  BenchmarkCylinderLevel<6>(reps);
+}
+
+/* Switch to mode 0 (wireframe sphere), 1 (lit sphere), 2 (rockets) or 3 (deformed sphere) */
+void SetMode(int newmode) {
+  mode = newmode;
+  simmode = newmode;
+  SetupGeometry();
+  if(mode == 1)
+    SetupShaders2();
+  else
+    SetupShaders();
+}
+
+/* What the keyboard asks for: the mode, sphere level, and whether spheres are impostors and
+   meshes tessellated */
+struct Settings {
+  int mode, level;
+  bool impostors, tessellation;
+};
+Settings queued;        /* The settings once every queued rebuild is applied */
+int queuedrebuilds = 0;
+
+/* The settings a new key press starts from: those of the last rebuild queued, if any is */
+Settings QueuedSettings() {
+  if(!queuedrebuilds)
+    queued = {mode, spherelevel, impostors, tessellation};
+  return queued;
+}
+
+/* Rebuilds asked for from the keyboard. The meshes that next needs are generated on the loader
+   thread, and apply runs at the first frame boundary after they are ready; the old settings keep
+   drawing until then, so no frame waits on a generator. The loader finishes its jobs in order,
+   so apply goes last, and rebuilds apply in the order they were asked for. Programs are built on
+   the loader thread already (asyncshaders). */
+void QueueRebuild(const Settings &next, std::function<void()> apply) {
+  static const int zero = 0, tessslices = TESS_SLICES;
+  queued = next;
+  queuedrebuilds++;
+  int levels[MAX_LOD_LEVELS], segments[MAX_LOD_LEVELS];
+  int count = SphereLevels(next.level, levels, segments);
+  PrepareMeshChain("sphere", CreateSphere, CreateSphereChain, levels, count, NULL);
+  if(next.mode == 2){
+    PrepareMeshChain("cone", CreateCone, NULL, conelevels, MAX_LOD_LEVELS, NULL);
+    PrepareMeshChain("cylinder", CreateCylinder, NULL, cylinderlevels, MAX_LOD_LEVELS, NULL);
+  }
+  if(next.impostors && !softbackend && (next.mode == 1 || next.mode == 2))
+    PrepareMeshChain("impostor", CreateImpostorQuad, NULL, &zero, 1, NULL);
+  if(next.tessellation && !softbackend && next.mode != 3 && TessellationSupported()){
+    PrepareMeshChain("sphere-patches", CreateSpherePatches, NULL, &zero, 1, NULL);
+    if(next.mode == 2){
+      PrepareMeshChain("cone-patches", CreateConePatches, NULL, &tessslices, 1, NULL);
+      PrepareMeshChain("cylinder-patches", CreateCylinderPatches, NULL, &tessslices, 1, NULL);
+    }
   }
+  if(next.mode == 3)
+    PrepareDeformedSphere(next.level);
+  RunAsync(NULL, [apply]{
+    queuedrebuilds--;
+    apply();
+  });
+}
 
+/* Switch the sphere to level, evicting the levels of detail the new chain does not share */
+void SetSphereLevel(int level) {
+  int levels[MAX_LOD_LEVELS], segments[MAX_LOD_LEVELS];
+  int count = SphereLevels(spherelevel, levels, segments);
+  for(int i = 0; i<count; i++)
+    if(levels[i] > level || levels[i] <= level - MAX_LOD_LEVELS)
+      EvictMesh(CreateSphere, levels[i]);
+  spherelevel = level;
+  printf("Sphere level %d\n", spherelevel);
+  scenerockets = -1; /* The rocket nodes point at the old sphere */
+  SetupGeometry();
+  PrintMeshRegistryStats();
 }
 
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
   if ((key == GLFW_KEY_ESCAPE || key == GLFW_KEY_Q) && action == GLFW_PRESS)
     glfwSetWindowShouldClose(window, GL_TRUE);
-  if ((key == GLFW_KEY_A) && action == GLFW_PRESS){
-    mode = 0;
-    SetupGeometry();
-    SetupShaders();
+  if (key >= GLFW_KEY_A && key <= GLFW_KEY_D && action == GLFW_PRESS){
+    Settings next = QueuedSettings();
+    int newmode = next.mode = key - GLFW_KEY_A;
+    QueueRebuild(next, [newmode]{ SetMode(newmode); });
+  }
+  if ((key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET) && action == GLFW_PRESS){
+    Settings next = QueuedSettings();
+    int level = next.level + (key == GLFW_KEY_RIGHT_BRACKET ? 1 : -1);
+    if(level >= 1 && level <= MAX_SUBDIVIDE_ITERATIONS){
+      next.level = level;
+      QueueRebuild(next, [level]{ SetSphereLevel(level); });
+    }
   }
 
-  if ((key == GLFW_KEY_B) && action == GLFW_PRESS){
-    mode = 1;
-    SetupGeometry();
-    SetupShaders2();
+  if ((key == GLFW_KEY_S) && action == GLFW_PRESS){
+    spinrockets = !spinrockets;
+    printf("Spinning rockets %s\n", spinrockets ? "on" : "off");
+    if(!spinrockets) /* Back to the grid the scene was built with */
+      for(size_t r = 0; r<rocketnodes.size(); r++)
+        SetSceneNodeTransform(rocketnodes[r], rocketplacements[r]);
   }
+  if ((key == GLFW_KEY_P) && action == GLFW_PRESS){
+    Settings next = QueuedSettings();
+    bool enable = next.impostors = !next.impostors;
+    QueueRebuild(next, [enable]{
+      impostors = enable;
+      printf("Sphere impostors %s\n", impostors ? "on" : "off");
+      SetupGeometry();
+    });
+  }
+  if ((key == GLFW_KEY_I) && action == GLFW_PRESS){
+    instancing = !instancing;
+    printf("Instancing %s\n", instancing ? "on" : "off");
+    if(mode == 1)
+      SetupShaders2();
+    else
+      SetupShaders();
+  }
+  if ((key == GLFW_KEY_L) && action == GLFW_PRESS){
+    lod = !lod;
+    printf("Levels of detail %s\n", lod ? "on" : "off");
+  }
+  if ((key == GLFW_KEY_T) && action == GLFW_PRESS){
+    Settings next = QueuedSettings();
+    bool enable = next.tessellation = !next.tessellation;
+    QueueRebuild(next, [enable]{
+      tessellation = enable;
+      SetupTessellation(); /* Turns tessellation back off where it is not supported */
+      printf("Tessellation %s\n", tessellation ? "on" : "off");
+      SetMode(mode);
+    });
+  }
+}
 
-  if ((key == GLFW_KEY_C) && action == GLFW_PRESS){
-    mode = 2;
-    SetupGeometry();
-    SetupShaders();
+/* Time Render in mode 2 for 1 to 100k rockets, with and without instancing. Vsync is off and every
+   frame is finished before the next one, so the time measured is the CPU cost of submitting it.
+ */
+void BenchmarkInstancing(GLFWwindow *window) {
+  static const int counts[] = {1, 10, 100, 1000, 10000, 100000};
+  mode = 2;
+  SetupGeometry();
+  glfwSwapInterval(0);
+  printf("%8s %20s %20s\n", "rockets", "direct ms/frame", "instanced ms/frame");
+  for(size_t c = 0; c<sizeof(counts)/sizeof(counts[0]); c++){
+    double ms[2];
+    rockets = counts[c];
+    BuildRocketScene();
+    for(int path = 0; path<2; path++){
+      instancing = path == 1;
+      SetupShaders();
+      Render(); /* Warm up buffers and driver state outside the measurement */
+      glFinish();
+      double cpu = 0, start = Seconds();
+      int frames = 0;
+      while(frames < 3 || (frames < 50 && Seconds() - start < 0.5)){
+        double t0 = Seconds();
+        Render();
+        cpu += Seconds() - t0;
+        glFinish();
+        glfwSwapBuffers(window);
+        frames++;
+      }
+      ms[path] = cpu * 1000 / frames;
+    }
+    printf("%8d %20.3f %20.3f\n", rockets, ms[0], ms[1]);
+  }
+}
+
+static bool TimerQueriesSupported() {
+#ifdef __APPLE__
+  return true; /* Core since GL 3.3 */
+#else
+  return GLEW_ARB_timer_query;
+#endif
+}
+
+/* Render frames of each of modes (or of all four when modes is empty) into the offscreen
+   framebuffer and write a summary of their times and counters to output, as CSV if its name ends
+   in .csv and JSON otherwise. cpu_ms covers Render alone; frame_ms also waits for FinishFrame,
+   which stands in for the swap since nothing is presented.
+ */
+void RunHeadless(std::vector<int> modes, int frames, int width, int height, const char *output) {
+  if(modes.empty())
+    for(int m = 0; m<4; m++)
+      modes.push_back(m);
+  for(size_t m = 0; m<modes.size(); m++){
+    SetMode(modes[m]);
+    Render(); /* Warm up buffers and driver state outside the measurement */
+    FinishFrame();
+    GLTraceFrame();
+    ReportFirstFrame();
+    for(int f = 0; f<frames; f++){
+      ProfilerBeginFrame();
+      ResetFrameStats();
+      double t0 = Seconds();
+      Render();
+      double t1 = Seconds();
+      {
+        PROFILE_ZONE("Finish");
+        FinishFrame();
+      }
+      double t2 = Seconds();
+      RecordFrame(mode, (t1 - t0) * 1000, (t2 - t0) * 1000, framestats);
+      GLTraceFrame();
+      ProfilerEndFrame();
+    }
+  }
+  size_t length = strlen(output);
+  bool csv = length >= 4 && !strcmp(output + length - 4, ".csv");
+  FILE *out = fopen(output, "w");
+  if(!out){
+    fprintf(stderr, "Cannot write %s\n", output);
+    exit( EXIT_FAILURE );
+  }
+  WriteFrameSummary(out, csv, width, height);
+  fclose(out);
+  printf("Wrote %d frames per mode to %s\n", frames, output);
+}
+
+/* Write the last frame drawn as a binary PPM */
+void DumpFrame(const char *path, int width, int height) {
+  std::vector<unsigned char> pixels;
+  const unsigned char *rgba;
+  if(softbackend)
+    rgba = SoftPixels();
+  else {
+    pixels.resize((size_t)width * height * 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    rgba = pixels.data();
+  }
+  if(WritePPM(path, width, height, rgba))
+    printf("Wrote %s\n", path);
+}
+
+/* Time the software rasterizer on nine lit level-7 spheres (295k triangles) at 1, 2, 4... threads
+   up to the --threads count (one per core by default), in millions of triangles per second.
+ */
+void BenchmarkSoftRaster(int width, int height) {
+  int maxthreads = GetThreadCount();
+  const Mesh *ball = GetMesh("sphere", CreateSphere, 7);
+  glm::mat4 Projection = glm::perspective(45.0f, (float)width / height, 0.1f, 100.0f);
+  SoftPolygonMode(GL_FILL);
+  SoftShade(SOFT_SHADE_LAMBERT);
+  printf("%8s %12s %12s %8s\n", "threads", "ms/frame", "Mtris/s", "speedup");
+  double single = 0;
+  for(int threads = 1; ; threads = threads * 2 < maxthreads ? threads * 2 : maxthreads){
+    SetThreadCount(threads);
+    double start = Seconds(), elapsed;
+    size_t triangles = 0;
+    int frames = 0;
+    do {
+      static const GLfloat black[3] = {0, 0, 0};
+      SoftClear(black);
+      for(int i = 0; i<9; i++){
+        glm::mat4 Model = glm::translate(glm::mat4(1.0), glm::vec3((i % 3 - 1) * 2.2f, (i / 3 - 1) * 2.2f, -8.f));
+        SoftDraw(ball->data, glm::value_ptr(Projection * Model));
+      }
+      triangles += SoftFinish();
+      frames++;
+      elapsed = Seconds() - start;
+    } while(frames < 3 || (frames < 50 && elapsed < 0.5));
+    double rate = triangles / elapsed / 1e6;
+    if(threads == 1)
+      single = rate;
+    printf("%8d %12.2f %12.2f %7.2fx\n", threads, elapsed * 1000 / frames, rate, rate / single);
+    if(threads == maxthreads)
+      break;
+  }
+  SetThreadCount(maxthreads);
+}
+
+/* Time lit spheres drawn as instanced meshes of --sphere-level against impostors, for 1 to 1M
+   spheres on a grid that covers the same part of the screen whatever their number: the pixels
+   shaded stay about the same while the meshes' vertex work grows with the count. Frame times
+   include glFinish. The meshes are not timed again once a frame of them takes over a second.
+ */
+void BenchmarkImpostors(int width, int height) {
+  static const int counts[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+  const Mesh *ball = GetMesh("sphere", CreateSphere, spherelevel);
+  const ShaderProgram *lit = GetShaderProgram("./mode2_instanced.vert", "./mode2.frag");
+  impostors = true;
+  SetupImpostors();
+  glm::mat4 Projection = glm::perspective(45.0f, (float)width / height, 0.1f, 100.0f);
+  glm::mat4 View = glm::translate(glm::mat4(1.), glm::vec3(0.f, 0.f, -5.f));
+  glm::mat4 VP = Projection * View;
+  std::vector<glm::mat4> models;
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  printf("Mesh spheres of level %d, %d indices each, against impostors at %dx%d\n", spherelevel, ball->count, width, height);
+  printf("%9s %16s %18s %8s\n", "spheres", "mesh ms/frame", "impostor ms/frame", "speedup");
+  int crossover = 0;
+  bool meshtoo = true;
+  for(size_t c = 0; c<sizeof(counts)/sizeof(counts[0]); c++){
+    int n = counts[c];
+    int side = (int)ceil(sqrt((double)n));
+    float cell = 4.f / side; /* The grid spans the 4x4 square the view holds at z = 0 */
+    models.resize(n);
+    for(int i = 0; i<n; i++){
+      glm::mat4 Model = glm::translate(glm::mat4(1.0), glm::vec3((i % side - (side - 1) / 2.f) * cell, (i / side - (side - 1) / 2.f) * cell, 0.f));
+      models[i] = glm::scale(Model, glm::vec3(cell * 0.4f));
+    }
+    double ms[2] = {0, 0};
+    for(int path = 0; path<2; path++){
+      if(path == 0 && !meshtoo)
+        continue;
+      if(path == 0){
+        glUseProgram(lit->program);
+        glUniformMatrix4fv(lit->uniforms[UNIFORM_VIEWPROJECTION], 1, GL_FALSE, glm::value_ptr(VP));
+      }
+      double start = 0, elapsed = 0;
+      int frames = -1; /* Frame -1 warms up buffers and driver state outside the measurement */
+      do {
+        if(!frames)
+          start = Seconds();
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if(path == 0)
+          DrawMeshInstanced(ball, glm::value_ptr(models[0]), n);
+        else
+          DrawImpostors(Projection, View, models.data(), n);
+        glFinish();
+        frames++;
+        elapsed = Seconds() - start;
+      } while(frames < 1 || (frames < 50 && elapsed < 0.5));
+      ms[path] = elapsed * 1000 / frames;
+    }
+    if(meshtoo){
+      printf("%9d %16.3f %18.3f %7.2fx\n", n, ms[0], ms[1], ms[0] / ms[1]);
+      if(ms[1] >= ms[0])
+        crossover = 0;
+      else if(!crossover)
+        crossover = n;
+      meshtoo = ms[0] < 1000;
+    } else
+      printf("%9d %16s %18.3f\n", n, "-", ms[1]);
+  }
+  if(crossover)
+    printf("Impostors are faster from %d sphere%s up\n", crossover, crossover > 1 ? "s" : "");
+  else
+    printf("Impostors were not faster at the largest count measured\n");
+}
+
+/* Count the triangles mode 2 submits at each level of detail for --rockets rockets (10000 if
+   fewer than 1000), with levels of detail off and on, from above the whole field and from a low
+   camera at its edge that sees the nearest rockets large and the farthest ones as specks. Frame
+   times include glFinish.
+ */
+void BenchmarkLOD(int width, int height) {
+  if(rockets < 1000)
+    rockets = 10000;
+  bool wanted = lod;
+  SetMode(2);
+  SetPolygonMode(GL_LINE);
+  float extent = ceil(sqrt((double)rockets)) * 10.f; /* Width of the field */
+  glm::mat4 Projection = glm::perspective(45.0f, (float)width / height, 1.f, extent * 3);
+  glm::mat4 views[2] = {
+    glm::lookAt(glm::vec3(0.f, 0.f, extent * 1.5f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f)),
+    glm::lookAt(glm::vec3(0.f, extent * -0.5f, 8.f), glm::vec3(0.f, extent * -0.5f + 60.f, 0.f), glm::vec3(0.f, 0.f, 1.f))
+  };
+  static const char *names[2] = {"above", "low"};
+  printf("%d rockets, %zu scene nodes, %dx%d\n", rockets, SceneNodeCount(), width, height);
+  printf("%6s %4s %12s %12s %12s %12s %12s %10s %9s\n", "view", "lod", "triangles", "level 0", "level 1", "level 2",
+         "level 3", "ms/frame", "reduction");
+  for(int v = 0; v<2; v++){
+    unsigned long long full = 0;
+    for(int on = 0; on<2; on++){
+      lod = on == 1;
+      nodelods.assign(nodelods.size(), 0);
+      double start = 0, elapsed = 0;
+      int frames = -1; /* Frame -1 warms up buffers and lets the levels settle outside the measurement */
+      do {
+        if(!frames)
+          start = Seconds();
+        ResetFrameStats();
+        ClearFrame();
+        DrawRockets(Projection, views[v]);
+        FinishFrame();
+        frames++;
+        elapsed = Seconds() - start;
+      } while(frames < 1 || (frames < 50 && elapsed < 0.5));
+      if(!on)
+        full = framestats.triangles;
+      printf("%6s %4s %12llu", names[v], on ? "on" : "off", framestats.triangles);
+      for(int l = 0; l<MAX_LOD_LEVELS; l++)
+        printf(" %12llu", framestats.lodtriangles[l]);
+      printf(" %10.3f", elapsed * 1000 / frames);
+      if(on)
+        printf(" %8.1fx", (double)full / std::max(framestats.triangles, 1ULL));
+      printf("\n");
+    }
+  }
+  lod = wanted;
+}
+
+/* Light a 16x16 grid of spheres filling the view with 1 to 4096 point lights scattered in a slab
+   just in front of them, through the clusters and by looping over every light, and compare frame
+   times (with glFinish) and the images. Each light's range shrinks as the count grows so that
+   about four reach any point, which is the case clustering is for. The loop over every light is
+   no longer timed once one of its frames takes over a second.
+ */
+void BenchmarkLights(int width, int height) {
+  static const int counts[] = {1, 4, 16, 64, 256, 1024, 4096};
+  const Mesh *ball = GetMesh("sphere", CreateSphere, spherelevel);
+  const ShaderProgram *program = GetShaderProgram("./clustered_instanced.vert", "./clustered.frag");
+  glm::mat4 Projection = glm::perspective(45.0f, (float)width / height, 0.1f, 100.0f);
+  glm::mat4 View = glm::translate(glm::mat4(1.), glm::vec3(0.f, 0.f, -5.f));
+  glm::mat4 VP = Projection * View;
+  const int side = 16;
+  const float cell = 4.f / side; /* The grid spans the 4x4 square the view holds at z = 0 */
+  std::vector<glm::mat4> models(side * side);
+  for(int i = 0; i<side * side; i++){
+    glm::mat4 Model = glm::translate(glm::mat4(1.0), glm::vec3((i % side - (side - 1) / 2.f) * cell, (i / side - (side - 1) / 2.f) * cell, 0.f));
+    models[i] = glm::scale(Model, glm::vec3(cell * 0.45f));
+  }
+  std::vector<unsigned char> pixels[2];
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glUseProgram(program->program);
+  glUniformMatrix4fv(program->uniforms[UNIFORM_VIEWPROJECTION], 1, GL_FALSE, glm::value_ptr(VP));
+  glUniformMatrix4fv(program->uniforms[UNIFORM_VIEW], 1, GL_FALSE, glm::value_ptr(View));
+  glUniform2f(program->uniforms[UNIFORM_VIEWPORT], width, height);
+  printf("%d spheres of level %d lit by point lights at %dx%d, %dx%dx%d clusters, %d threads\n", side * side, spherelevel,
+         width, height, CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES, GetThreadCount());
+  printf("%7s %10s %10s %8s %14s %16s %8s %9s\n", "lights", "assign ms", "avg/cluster", "max", "clustered ms", "all lights ms",
+         "speedup", "max diff");
+  bool alltoo = true;
+  for(size_t c = 0; c<sizeof(counts)/sizeof(counts[0]); c++){
+    int n = counts[c];
+    unsigned seed = 1;
+    float range = sqrtf(4.f * 16.f / ((float)M_PI * n));
+    std::vector<PointLight> lights(n);
+    for(int i = 0; i<n; i++){
+      lights[i].position = glm::vec3(NextRandom(&seed) * 4.f - 2.f, NextRandom(&seed) * 4.f - 2.f, NextRandom(&seed) * 0.3f);
+      lights[i].range = range;
+      lights[i].colour = glm::vec3(NextRandom(&seed), NextRandom(&seed), NextRandom(&seed)) * 0.5f;
+    }
+    /* The lights do not move, but the assignment is timed as if they did */
+    LightClusterStats stats;
+    double start = Seconds();
+    int builds = 0;
+    do {
+      stats = BuildLightClusters(lights, View, Projection);
+      builds++;
+    } while(builds < 10 || (builds < 1000 && Seconds() - start < 0.2));
+    double assign = (Seconds() - start) * 1000 / builds;
+    double ms[2] = {0, 0};
+    for(int path = 0; path<2; path++){
+      if(path == 1 && !alltoo)
+        continue;
+      BindLightClusters(program, path == 1 ? n : 0);
+      double elapsed = 0;
+      int frames = -1; /* Frame -1 warms up buffers and driver state outside the measurement */
+      do {
+        if(!frames)
+          start = Seconds();
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        DrawMeshInstanced(ball, glm::value_ptr(models[0]), side * side);
+        glFinish();
+        frames++;
+        elapsed = Seconds() - start;
+      } while(frames < 1 || (frames < 50 && elapsed < 0.5));
+      ms[path] = elapsed * 1000 / frames;
+      pixels[path].resize((size_t)width * height * 4);
+      glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels[path].data());
+    }
+    printf("%7d %10.3f %10.2f %8u %14.3f", n, assign, (double)stats.references / std::max(stats.occupied, 1u), stats.maxlights, ms[0]);
+    if(alltoo){
+      int diff = 0;
+      for(size_t i = 0; i<pixels[0].size(); i++)
+        diff = std::max(diff, abs(pixels[0][i] - pixels[1][i]));
+      printf(" %16.3f %7.2fx %9d\n", ms[1], ms[1] / ms[0], diff);
+      alltoo = ms[1] < 1000;
+    } else
+      printf(" %16s\n", "-");
+  }
+}
+
+/* Time mode 2's scene work per frame - spinning every rocket, updating the scene graph, culling
+   and building the instance lists - at 1, 2, 4... threads up to the --threads count, for the
+   --rockets count or 20000 rockets if that is fewer than 1000. The view takes in the whole
+   field, so every part ends up in an instance list. Nothing is drawn. Each thread count must
+   build the same instance lists, bit for bit, as one thread.
+ */
+void BenchmarkJobs() {
+  int maxthreads = GetThreadCount();
+  if(rockets < 1000)
+    rockets = 20000;
+  mode = 2;
+  SetupGeometry();
+  int side = (int)ceil(sqrt((double)rockets));
+  glm::mat4 Projection = glm::perspective(45.0f, 1.0f, 1.f, side * 40.f);
+  glm::mat4 View = glm::translate(glm::mat4(1.), glm::vec3(0.f, 0.f, side * -15.f));
+  glm::mat4 VP = Projection * View;
+  std::vector<glm::mat4> reference[3][MAX_LOD_LEVELS];
+  ChooseLODChains(Projection, false);
+  printf("%d rockets, %zu scene nodes\n", rockets, SceneNodeCount());
+  printf("%8s %12s %8s %14s %s\n", "threads", "ms/frame", "speedup", "steals/frame", "deterministic");
+  double single = 0;
+  for(int threads = 1; ; threads = threads * 2 < maxthreads ? threads * 2 : maxthreads){
+    SetThreadCount(threads);
+    unsigned long long steals = GetStealCount();
+    double start = Seconds(), elapsed;
+    int frames = 0;
+    do {
+      SpinRockets(frames * 2.0f);
+      BuildRocketDrawLists(VP, true);
+      frames++;
+      elapsed = Seconds() - start;
+    } while(frames < 3 || (frames < 200 && elapsed < 1.0));
+    double ms = elapsed * 1000 / frames;
+    steals = GetStealCount() - steals;
+    SpinRockets(1.0f);
+    nodelods.assign(nodelods.size(), 0); /* The levels must not depend on how many frames were timed */
+    BuildRocketDrawLists(VP, true);
+    std::vector<glm::mat4> *lists[3] = {sphereinstances, cylinderinstances, coneinstances};
+    bool same = true;
+    for(int b = 0; b<3; b++)
+      for(int l = 0; l<MAX_LOD_LEVELS; l++){
+        if(threads == 1)
+          reference[b][l] = lists[b][l];
+        same = same && reference[b][l].size() == lists[b][l].size() &&
+               !memcmp(reference[b][l].data(), lists[b][l].data(), reference[b][l].size() * sizeof(glm::mat4));
+      }
+    if(threads == 1)
+      single = ms;
+    printf("%8d %12.3f %7.2fx %14.1f %s\n", threads, ms, single / ms, (double)steals / frames, same ? "yes" : "NO");
+    if(threads == maxthreads)
+      break;
   }
+  size_t instances = 0;
+  for(int l = 0; l<MAX_LOD_LEVELS; l++)
+    instances += sphereinstances[l].size() + cylinderinstances[l].size() + coneinstances[l].size();
+  printf("(%zu instances per frame)\n", instances);
+  SetThreadCount(maxthreads);
 }
 
-int main( void ) {
+int main( int argc, char **argv ) {
   GLFWwindow* window;
+  bool benchinstancing = false, benchsubdivision = false, benchsoft = false, benchjobs = false, benchimpostors = false;
+  bool benchlod = false, benchlights = false, benchgenerators = false;
+  bool headless = false, bake = false;
+  bool hotreload = true, optimisemeshes = true, strips = false;
+  int frames = 300, width = 640, height = 480;
+  std::vector<int> headlessmodes;
+  const char *output = "framestats.json";
+  const char *profile = NULL, *dump = NULL, *gltrace = NULL;
+  for(int i = 1; i<argc; i++){
+    if(!strcmp(argv[i], "--rockets") && i + 1 < argc)
+      rockets = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--vertex-format") && i + 1 < argc){
+      i++;
+      if(!strcmp(argv[i], "float"))
+        SetVertexFormat(VERTEX_FORMAT_FLOAT);
+      else if(!strcmp(argv[i], "compact"))
+        SetVertexFormat(VERTEX_FORMAT_COMPACT);
+      else {
+        printf("Unknown vertex format %s, expected float or compact\n", argv[i]);
+        exit( EXIT_FAILURE );
+      }
+    } else if(!strcmp(argv[i], "--threads") && i + 1 < argc)
+      SetThreadCount(atoi(argv[++i]));
+    else if(!strcmp(argv[i], "--bench-instancing"))
+      benchinstancing = true;
+    else if(!strcmp(argv[i], "--bench-subdivision"))
+      benchsubdivision = true;
+    else if(!strcmp(argv[i], "--bench-generators")){
+      benchgenerators = true;
+#ifndef ALLOCCOUNT
+      printf("Built without ALLOCCOUNT, so --bench-generators counts no allocations; rebuild with premake4 --alloccount gmake\n");
+#endif
+    }
+    else if(!strcmp(argv[i], "--sphere-level") && i + 1 < argc)
+      spherelevel = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--bake"))
+      bake = true;
+    else if(!strcmp(argv[i], "--no-mesh-files"))
+      SetMeshFiles(false);
+    else if(!strcmp(argv[i], "--no-hot-reload"))
+      hotreload = false;
+    else if(!strcmp(argv[i], "--no-arena"))
+      SetMeshArenas(false);
+    else if(!strcmp(argv[i], "--no-mesh-optimise"))
+      optimisemeshes = false;
+    else if(!strcmp(argv[i], "--strips"))
+      strips = true;
+    else if(!strcmp(argv[i], "--bench-soft"))
+      benchsoft = true;
+    else if(!strcmp(argv[i], "--bench-jobs"))
+      benchjobs = true;
+    else if(!strcmp(argv[i], "--spin"))
+      spinrockets = true;
+    else if(!strcmp(argv[i], "--impostors"))
+      impostors = true;
+    else if(!strcmp(argv[i], "--tessellation"))
+      tessellation = true;
+    else if(!strcmp(argv[i], "--bench-impostors"))
+      benchimpostors = true;
+    else if(!strcmp(argv[i], "--no-lod"))
+      lod = false;
+    else if(!strcmp(argv[i], "--bench-lod"))
+      benchlod = true;
+    else if(!strcmp(argv[i], "--lights") && i + 1 < argc)
+      pointlights = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--bench-lights"))
+      benchlights = true;
+    else if(!strcmp(argv[i], "--no-sim-thread"))
+      simthread = false;
+    else if(!strcmp(argv[i], "--headless"))
+      headless = true;
+    else if(!strcmp(argv[i], "--backend") && i + 1 < argc){
+      i++;
+      if(!strcmp(argv[i], "soft"))
+        softbackend = true;
+      else if(strcmp(argv[i], "gl")){
+        printf("Unknown backend %s, expected gl or soft\n", argv[i]);
+        exit( EXIT_FAILURE );
+      }
+    } else if(!strcmp(argv[i], "--dump") && i + 1 < argc)
+      dump = argv[++i];
+    else if(!strcmp(argv[i], "--frames") && i + 1 < argc)
+      frames = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--mode") && i + 1 < argc)
+      headlessmodes.push_back(atoi(argv[++i]));
+    else if(!strcmp(argv[i], "--output") && i + 1 < argc)
+      output = argv[++i];
+    else if(!strcmp(argv[i], "--profile") && i + 1 < argc){
+      profile = argv[++i];
+#ifndef PROFILER
+      printf("Built without PROFILER, so --profile records nothing; rebuild with premake4 --profiler gmake\n");
+#endif
+    }
+    else if(!strcmp(argv[i], "--trace") && i + 1 < argc){
+      gltrace = argv[++i];
+#ifndef GLTRACE
+      printf("Built without GLTRACE, so --trace records nothing; rebuild with premake4 --gltrace gmake\n");
+#endif
+    }
+    else if(!strcmp(argv[i], "--size") && i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &width, &height) == 2)
+      i++;
+    else {
+      printf("Usage: %s [--rockets N] [--threads N] [--vertex-format float|compact] [--bench-instancing] [--bench-subdivision] [--profile trace.json]\n"
+             "          [--headless | --backend gl|soft] [--frames N] [--size WxH] [--mode 0|1|2|3]... [--output file.json|file.csv]\n"
+             "          [--dump frame.ppm] [--bench-soft] [--sphere-level N] [--bake] [--no-mesh-files] [--no-hot-reload] [--no-arena]\n"
+             "          [--spin] [--bench-jobs] [--no-mesh-optimise] [--strips] [--impostors] [--bench-impostors]\n"
+             "          [--tessellation] [--no-lod] [--bench-lod] [--lights N] [--bench-lights] [--trace file.gltrace]\n"
+             "          [--no-sim-thread] [--bench-generators]\n", argv[0]);
+      exit( EXIT_FAILURE );
+    }
+  }
+  SetMeshOptimisation(optimisemeshes, strips);
+  if(spherelevel < 1 || spherelevel > MAX_SUBDIVIDE_ITERATIONS){
+    printf("--sphere-level must be between 1 and %d\n", MAX_SUBDIVIDE_ITERATIONS);
+    exit( EXIT_FAILURE );
+  }
+  for(int m : headlessmodes)
+    if(m < 0 || m > 3){
+      printf("--mode must be between 0 and 3\n");
+      exit( EXIT_FAILURE );
+    }
+  if(frames < 1){
+    printf("--frames must be at least 1\n");
+    exit( EXIT_FAILURE );
+  }
+  if(width < 1 || height < 1){
+    printf("--size must be at least 1x1\n");
+    exit( EXIT_FAILURE );
+  }
+  if(pointlights < 0){
+    printf("--lights must not be negative\n");
+    exit( EXIT_FAILURE );
+  }
+  if(rockets < 0){
+    printf("--rockets must not be negative\n");
+    exit( EXIT_FAILURE );
+  }
+  SetupLights(pointlights);
+  if(bake){ /* Encoding needs no GL */
+    BakeMeshes();
+    exit( EXIT_SUCCESS );
+  }
+  if(benchsubdivision){ /* Needs no window */
+    BenchmarkSubdivision();
+    exit( EXIT_SUCCESS );
+  }
+  if(benchgenerators){ /* Nor does this */
+    BenchmarkGenerators();
+    exit( EXIT_SUCCESS );
+  }
+  if(benchjobs){ /* Neither does the scene work; the meshes are only needed for their bounds */
+    SetMeshUpload(false);
+    SetupRocket();
+    BenchmarkJobs();
+    ReleaseMeshes();
+    exit( EXIT_SUCCESS );
+  }
+  if(benchimpostors){ /* Offscreen, so the swap and vsync stay out of the times */
+    if(!CreateHeadlessContext(width, height))
+      exit( EXIT_FAILURE );
+    glEnable(GL_DEPTH_TEST);
+    BenchmarkImpostors(width, height);
+    ReleaseMeshes();
+    ReleaseShaderPrograms();
+    DestroyHeadlessContext();
+    exit( EXIT_SUCCESS );
+  }
+  if(benchlod){ /* Offscreen too, so the frame times are the draws' alone */
+    if(!CreateHeadlessContext(width, height))
+      exit( EXIT_FAILURE );
+    viewportwidth = width;
+    viewportheight = height;
+    glEnable(GL_DEPTH_TEST);
+    SetupRocket();
+    BenchmarkLOD(width, height);
+    StopAsyncLoader();
+    ReleaseMeshes();
+    ReleaseShaderPrograms();
+    DestroyHeadlessContext();
+    exit( EXIT_SUCCESS );
+  }
+  if(benchlights){ /* Offscreen as well */
+    if(!CreateHeadlessContext(width, height))
+      exit( EXIT_FAILURE );
+    glEnable(GL_DEPTH_TEST);
+    BenchmarkLights(width, height);
+    ReleaseLightClusters();
+    ReleaseMeshes();
+    ReleaseShaderPrograms();
+    DestroyHeadlessContext();
+    exit( EXIT_SUCCESS );
+  }
+  if(softbackend || benchsoft){ /* No GL at all; the software backend always renders headless */
+    if(impostors)
+      printf("Sphere impostors need the GL backend; drawing the spheres as meshes\n");
+    if(tessellation)
+      printf("Tessellation needs the GL backend; drawing meshes\n");
+    if(pointlights)
+      printf("Clustered lighting needs the GL backend; lighting mode 1 with its one light\n");
+    softbackend = true;
+    SetMeshUpload(false);
+    SoftResize(width, height);
+    viewportwidth = width;
+    viewportheight = height;
+    if(benchsoft)
+      BenchmarkSoftRaster(width, height);
+    else {
+      SetupRocket();
+      RunHeadless(headlessmodes, frames, width, height, output);
+      if(dump)
+        DumpFrame(dump, width, height);
+      if(profile){
+        WriteProfileTrace(profile);
+        PrintProfileSummary();
+      }
+    }
+    ReleaseProfiler();
+    PrintMeshRegistryStats();
+    ReleaseDeformedSphere();
+    ReleaseMeshes();
+    exit( EXIT_SUCCESS );
+  }
+  PrefetchMeshes();
+  if(headless){ /* No window either: an offscreen context, and no vsync to wait on */
+    if(!CreateHeadlessContext(width, height))
+      exit( EXIT_FAILURE );
+    viewportwidth = width;
+    viewportheight = height;
+    if(gltrace && !StartGLTrace(gltrace, width, height))
+      exit( EXIT_FAILURE );
+    glEnable(GL_DEPTH_TEST);
+    ProfilerEnableGPU(profile && TimerQueriesSupported());
+    SetupRocket();
+    if(simthread)
+      StartSimulation(StepScene, starttime);
+    RunHeadless(headlessmodes, frames, width, height, output);
+    StopSimulation();
+    if(dump)
+      DumpFrame(dump, width, height);
+    if(profile){
+      WriteProfileTrace(profile);
+      PrintProfileSummary();
+    }
+    ReleaseProfiler();
+    PrintSimulationStats();
+    PrintMeshRegistryStats();
+    ReleaseDeformedSphere();
+    StopAsyncLoader();
+    ReleaseLightClusters();
+    ReleaseMeshes();
+    ReleaseShaderPrograms();
+    StopGLTrace();
+    DestroyHeadlessContext();
+    exit( EXIT_SUCCESS );
+  }
+
   if( !glfwInit() ) {
     printf("Failed to start GLFW\n");
     exit( EXIT_FAILURE );
@@ -576,16 +2290,53 @@ int main( void ) {
 
   glfwSetKeyCallback(window, key_callback);
   fprintf(stderr, "GL INFO %s\n", glGetString(GL_VERSION));
+  if(gltrace && !StartGLTrace(gltrace, 640, 480))
+    exit( EXIT_FAILURE );
   glEnable(GL_DEPTH_TEST);
+  ProfilerEnableGPU(profile && TimerQueriesSupported());
+  SetupRocket();
+  if(benchinstancing){
+    BenchmarkInstancing(window);
+    glfwTerminate();
+    exit( EXIT_SUCCESS );
+  }
+  SetShaderHotReload(hotreload);
   SetupGeometry();
   SetupShaders();
+  asyncshaders = true; /* From here on a new program never stalls a frame */
+  if(simthread)
+    StartSimulation(StepScene, starttime);
   printf("Ready to render\n");
   while(!glfwWindowShouldClose(window)) {  // Main loop
+    ProfilerBeginFrame();
+    FrameBoundary();
     Render();        // OpenGL rendering goes here...
-    glfwSwapBuffers(window);        // Swap front and back rendering buffers
-    glfwPollEvents();         // Poll for events.
-
+    {
+      PROFILE_ZONE("SwapBuffers");
+      glfwSwapBuffers(window);        // Swap front and back rendering buffers
+    }
+    ReportFirstFrame();
+    GLTraceFrame();
+    {
+      PROFILE_ZONE("PollEvents");
+      glfwPollEvents();         // Poll for events.
+    }
+    ProfilerEndFrame();
+  }
+  StopSimulation();
+  if(profile){
+    WriteProfileTrace(profile);
+    PrintProfileSummary();
   }
+  ReleaseProfiler();
+  PrintSimulationStats();
+  PrintMeshRegistryStats();
+  ReleaseDeformedSphere();
+  StopAsyncLoader();
+  ReleaseLightClusters();
+  ReleaseMeshes();
+  ReleaseShaderPrograms();
+  StopGLTrace();
   glfwTerminate();  // Close window and terminate GLFW
   exit( EXIT_SUCCESS );  // Exit program
 }
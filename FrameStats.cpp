@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "FrameStats.h"
+
+FrameStats framestats;
+
+struct FrameSample {
+  double cpums, framems;
+  FrameStats stats;
+};
+
+static std::map<int, std::vector<FrameSample> > samples;
+
+void ResetFrameStats(){
+  framestats.drawcalls = 0;
+  framestats.vertices = 0;
+  framestats.triangles = 0;
+  for(int l = 0; l<MAX_LOD_LEVELS; l++)
+    framestats.lodtriangles[l] = 0;
+  framestats.bytesuploaded = 0;
+  framestats.nodestested = 0;
+  framestats.fencewaits = 0;
+  framestats.simms = 0;
+  framestats.snapshotms = 0;
+}
+
+void RecordFrame(int mode, double cpums, double framems, const FrameStats &stats){
+  FrameSample sample = {cpums, framems, stats};
+  samples[mode].push_back(sample);
+}
+
+struct Summary {
+  double mean, p50, p95, p99;
+};
+
+/* Nearest-rank percentiles */
+static Summary Summarise(std::vector<double> values){
+  Summary s = {0, 0, 0, 0};
+  if(values.empty())
+    return s;
+  std::sort(values.begin(), values.end());
+  for(size_t i = 0; i<values.size(); i++)
+    s.mean += values[i];
+  s.mean /= values.size();
+  size_t n = values.size();
+  s.p50 = values[(n * 50 + 99) / 100 - 1];
+  s.p95 = values[(n * 95 + 99) / 100 - 1];
+  s.p99 = values[(n * 99 + 99) / 100 - 1];
+  return s;
+}
+
+#define METRICS (10 + MAX_LOD_LEVELS)
+
+void WriteFrameSummary(FILE *out, bool csv, int width, int height){
+  /* In the order values is filled in below, with a lodN_triangles for each level */
+  std::vector<std::string> names = {"cpu_ms", "frame_ms", "draw_calls", "vertices", "bytes_uploaded", "nodes_tested",
+                                    "fence_waits", "triangles"};
+  for(int l = 0; l<MAX_LOD_LEVELS; l++)
+    names.push_back("lod" + std::to_string(l) + "_triangles");
+  names.push_back("sim_ms");
+  names.push_back("snapshot_latency_ms");
+  if(csv)
+    fprintf(out, "mode,metric,mean,p50,p95,p99\n");
+  else
+    fprintf(out, "{\n  \"width\": %d,\n  \"height\": %d,\n  \"modes\": [", width, height);
+  for(std::map<int, std::vector<FrameSample> >::iterator it = samples.begin(); it != samples.end(); ++it){
+    const std::vector<FrameSample> &frames = it->second;
+    std::vector<double> values[METRICS];
+    for(size_t i = 0; i<frames.size(); i++){
+      values[0].push_back(frames[i].cpums);
+      values[1].push_back(frames[i].framems);
+      values[2].push_back(frames[i].stats.drawcalls);
+      values[3].push_back(frames[i].stats.vertices);
+      values[4].push_back(frames[i].stats.bytesuploaded);
+      values[5].push_back(frames[i].stats.nodestested);
+      values[6].push_back(frames[i].stats.fencewaits);
+      values[7].push_back(frames[i].stats.triangles);
+      for(int l = 0; l<MAX_LOD_LEVELS; l++)
+        values[8 + l].push_back(frames[i].stats.lodtriangles[l]);
+      values[8 + MAX_LOD_LEVELS].push_back(frames[i].stats.simms);
+      values[9 + MAX_LOD_LEVELS].push_back(frames[i].stats.snapshotms);
+    }
+    if(!csv)
+      fprintf(out, "%s\n    {\"mode\": %d, \"frames\": %d", it == samples.begin() ? "" : ",", it->first, (int)frames.size());
+    for(int m = 0; m<METRICS; m++){
+      Summary s = Summarise(values[m]);
+      if(csv)
+        fprintf(out, "%d,%s,%.4f,%.4f,%.4f,%.4f\n", it->first, names[m].c_str(), s.mean, s.p50, s.p95, s.p99);
+      else
+        fprintf(out, ",\n     \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f}", names[m].c_str(), s.mean, s.p50, s.p95, s.p99);
+    }
+    if(!csv)
+      fprintf(out, "}");
+  }
+  if(!csv)
+    fprintf(out, "\n  ]\n}\n");
+}
@@ -0,0 +1,32 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+/*
+   Per-frame counters and a recorder that summarises them. The draw helpers in Mesh.cpp and
+   Coursework.cpp add to framestats as they submit work; whoever runs the frame loop resets it,
+   renders, and records the frame.
+ */
+#include <stdio.h>
+#include "LOD.h"
+
+struct FrameStats {
+  unsigned drawcalls;
+  unsigned long long vertices;        /* Vertices (or indices) submitted, times instances */
+  unsigned long long triangles;       /* Triangles (or patches) submitted, times instances */
+  unsigned long long lodtriangles[MAX_LOD_LEVELS]; /* Of those, the ones at each level of detail */
+  unsigned long long bytesuploaded;   /* Buffer and uniform data sent to the GL */
+  unsigned long long nodestested;     /* Scene graph nodes frustum culling looked at */
+  unsigned fencewaits;                /* Times a stream buffer had to wait for the GPU */
+  double simms;                       /* Time the simulation step drawn took, on its own thread */
+  double snapshotms;                  /* Age of the simulation snapshot drawn */
+};
+
+extern FrameStats framestats;
+
+void ResetFrameStats();
+/* Store one frame of mode: cpums is the time spent submitting it, framems the time until the GL
+   finished it */
+void RecordFrame(int mode, double cpums, double framems, const FrameStats &stats);
+/* Write p50/p95/p99 of every recorded mode as JSON, or as CSV when csv is set */
+void WriteFrameSummary(FILE *out, bool csv, int width, int height);
+
+#endif
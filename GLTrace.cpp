@@ -0,0 +1,419 @@
+#ifdef GLTRACE
+
+#define GLTRACE_IMPLEMENTATION
+#include <stdio.h>
+#include <string.h>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include "Platform.h"
+#include "GLTraceFormat.h"
+
+static FILE *trace;
+static unsigned long long calls, frames, payloadbytes;
+/* Sync objects by the number the trace knows them by */
+static std::unordered_map<GLsync, unsigned> syncs;
+static unsigned nextsync = 1;
+/* Buffer bound to each target, and the mappings of buffers mapped without GL_MAP_PERSISTENT_BIT,
+   whose contents are written to the trace when they are unmapped */
+struct Mapping {
+  unsigned char *pointer;
+  GLintptr offset;
+  GLsizeiptr length;
+};
+static std::unordered_map<GLenum, GLuint> boundbuffers;
+static std::unordered_map<GLuint, Mapping> mappings;
+
+static unsigned Bits(float f){
+  unsigned u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+static void Record(TraceOp op, std::initializer_list<unsigned> words, const void *payload = NULL, size_t bytes = 0){
+  if(!trace)
+    return;
+  unsigned char code = op;
+  fwrite(&code, 1, 1, trace);
+  for(unsigned w : words)
+    fwrite(&w, sizeof(w), 1, trace);
+  if(traceops[op].payload){
+    unsigned length = payload ? bytes : 0;
+    fwrite(&length, sizeof(length), 1, trace);
+    if(length)
+      fwrite(payload, 1, length, trace);
+    payloadbytes += length;
+  }
+  calls++;
+}
+
+bool StartGLTrace(const char *path, int width, int height){
+  trace = fopen(path, "wb");
+  if(!trace){
+    fprintf(stderr, "Cannot write %s\n", path);
+    return false;
+  }
+  TraceHeader header;
+  memset(&header, 0, sizeof(header));
+  strcpy(header.magic, GLTRACE_MAGIC);
+  header.version = GLTRACE_VERSION;
+  header.width = width;
+  header.height = height;
+  fwrite(&header, sizeof(header), 1, trace);
+  calls = frames = payloadbytes = 0;
+  return true;
+}
+
+void GLTraceFrame(){
+  if(!trace)
+    return;
+  Record(TRACE_FRAME, {});
+  calls--; /* A marker, not a call */
+  frames++;
+}
+
+void GLTraceMappedWrite(GLuint buffer, GLintptr offset, GLsizeiptr bytes, const void *data){
+  Record(TRACE_MAPPED_WRITE, {buffer, (unsigned)offset}, data, bytes);
+}
+
+void StopGLTrace(){
+  if(!trace)
+    return;
+  long size = ftell(trace);
+  fclose(trace);
+  trace = NULL;
+  printf("GL trace: %llu frames, %llu calls, %.1f MB of data, %.1f MB in all\n", frames, calls, payloadbytes / 1e6, size / 1e6);
+}
+
+/* Names made by glGen* and dropped by glDelete* */
+static void RecordNames(TraceOp op, GLsizei n, const GLuint *names){
+  Record(op, {}, names, n * sizeof(GLuint));
+}
+
+void TraceGenBuffers(GLsizei n, GLuint *buffers){
+  glGenBuffers(n, buffers);
+  RecordNames(TRACE_GEN_BUFFERS, n, buffers);
+}
+
+void TraceDeleteBuffers(GLsizei n, const GLuint *buffers){
+  glDeleteBuffers(n, buffers);
+  RecordNames(TRACE_DELETE_BUFFERS, n, buffers);
+}
+
+void TraceBindBuffer(GLenum target, GLuint buffer){
+  glBindBuffer(target, buffer);
+  boundbuffers[target] = buffer;
+  Record(TRACE_BIND_BUFFER, {target, buffer});
+}
+
+void TraceBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage){
+  glBufferData(target, size, data, usage);
+  Record(TRACE_BUFFER_DATA, {target, (unsigned)size, usage}, data, size);
+}
+
+void TraceBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data){
+  glBufferSubData(target, offset, size, data);
+  Record(TRACE_BUFFER_SUB_DATA, {target, (unsigned)offset}, data, size);
+}
+
+void TraceBufferStorage(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags){
+  glBufferStorage(target, size, data, flags);
+  Record(TRACE_BUFFER_STORAGE, {target, (unsigned)size, flags}, data, size);
+}
+
+void *TraceMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access){
+  void *pointer = glMapBufferRange(target, offset, length, access);
+  if(pointer && !(access & GL_MAP_PERSISTENT_BIT) && (access & GL_MAP_WRITE_BIT)){
+    Mapping mapping = {(unsigned char *)pointer, offset, length};
+    mappings[boundbuffers[target]] = mapping;
+  }
+  Record(TRACE_MAP_BUFFER_RANGE, {target, (unsigned)offset, (unsigned)length, access});
+  return pointer;
+}
+
+GLboolean TraceUnmapBuffer(GLenum target){
+  GLuint buffer = boundbuffers[target];
+  auto found = mappings.find(buffer);
+  if(found != mappings.end()){
+    GLTraceMappedWrite(buffer, found->second.offset, found->second.length, found->second.pointer);
+    mappings.erase(found);
+  }
+  Record(TRACE_UNMAP_BUFFER, {target});
+  return glUnmapBuffer(target);
+}
+
+void TraceCopyBufferSubData(GLenum readtarget, GLenum writetarget, GLintptr readoffset, GLintptr writeoffset, GLsizeiptr size){
+  glCopyBufferSubData(readtarget, writetarget, readoffset, writeoffset, size);
+  Record(TRACE_COPY_BUFFER_SUB_DATA, {readtarget, writetarget, (unsigned)readoffset, (unsigned)writeoffset, (unsigned)size});
+}
+
+void TraceGenVertexArrays(GLsizei n, GLuint *arrays){
+  glGenVertexArrays(n, arrays);
+  RecordNames(TRACE_GEN_VERTEX_ARRAYS, n, arrays);
+}
+
+void TraceDeleteVertexArrays(GLsizei n, const GLuint *arrays){
+  glDeleteVertexArrays(n, arrays);
+  RecordNames(TRACE_DELETE_VERTEX_ARRAYS, n, arrays);
+}
+
+void TraceBindVertexArray(GLuint array){
+  glBindVertexArray(array);
+  Record(TRACE_BIND_VERTEX_ARRAY, {array});
+}
+
+void TraceVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer){
+  glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+  Record(TRACE_VERTEX_ATTRIB_POINTER, {index, (unsigned)size, type, normalized, (unsigned)stride, (unsigned)(size_t)pointer});
+}
+
+void TraceEnableVertexAttribArray(GLuint index){
+  glEnableVertexAttribArray(index);
+  Record(TRACE_ENABLE_VERTEX_ATTRIB_ARRAY, {index});
+}
+
+void TraceVertexAttribDivisor(GLuint index, GLuint divisor){
+  glVertexAttribDivisor(index, divisor);
+  Record(TRACE_VERTEX_ATTRIB_DIVISOR, {index, divisor});
+}
+
+void TraceVertexAttrib3f(GLuint index, GLfloat x, GLfloat y, GLfloat z){
+  glVertexAttrib3f(index, x, y, z);
+  Record(TRACE_VERTEX_ATTRIB_3F, {index, Bits(x), Bits(y), Bits(z)});
+}
+
+void TraceVertexAttrib3fv(GLuint index, const GLfloat *v){
+  glVertexAttrib3fv(index, v);
+  Record(TRACE_VERTEX_ATTRIB_3F, {index, Bits(v[0]), Bits(v[1]), Bits(v[2])});
+}
+
+void TraceGenTextures(GLsizei n, GLuint *textures){
+  glGenTextures(n, textures);
+  RecordNames(TRACE_GEN_TEXTURES, n, textures);
+}
+
+void TraceDeleteTextures(GLsizei n, const GLuint *textures){
+  glDeleteTextures(n, textures);
+  RecordNames(TRACE_DELETE_TEXTURES, n, textures);
+}
+
+void TraceActiveTexture(GLenum texture){
+  glActiveTexture(texture);
+  Record(TRACE_ACTIVE_TEXTURE, {texture});
+}
+
+void TraceBindTexture(GLenum target, GLuint texture){
+  glBindTexture(target, texture);
+  Record(TRACE_BIND_TEXTURE, {target, texture});
+}
+
+void TraceTexBuffer(GLenum target, GLenum internalformat, GLuint buffer){
+  glTexBuffer(target, internalformat, buffer);
+  Record(TRACE_TEX_BUFFER, {target, internalformat, buffer});
+}
+
+GLuint TraceCreateShader(GLenum type){
+  GLuint shader = glCreateShader(type);
+  Record(TRACE_CREATE_SHADER, {type, shader});
+  return shader;
+}
+
+void TraceShaderSource(GLuint shader, GLsizei count, const GLchar *const *strings, const GLint *lengths){
+  glShaderSource(shader, count, strings, lengths);
+  std::string source;
+  for(GLsizei i = 0; i<count; i++)
+    source.append(strings[i], lengths && lengths[i] >= 0 ? (size_t)lengths[i] : strlen(strings[i]));
+  Record(TRACE_SHADER_SOURCE, {shader}, source.data(), source.size());
+}
+
+void TraceCompileShader(GLuint shader){
+  glCompileShader(shader);
+  Record(TRACE_COMPILE_SHADER, {shader});
+}
+
+void TraceDeleteShader(GLuint shader){
+  glDeleteShader(shader);
+  Record(TRACE_DELETE_SHADER, {shader});
+}
+
+GLuint TraceCreateProgram(){
+  GLuint program = glCreateProgram();
+  Record(TRACE_CREATE_PROGRAM, {program});
+  return program;
+}
+
+void TraceAttachShader(GLuint program, GLuint shader){
+  glAttachShader(program, shader);
+  Record(TRACE_ATTACH_SHADER, {program, shader});
+}
+
+void TraceDetachShader(GLuint program, GLuint shader){
+  glDetachShader(program, shader);
+  Record(TRACE_DETACH_SHADER, {program, shader});
+}
+
+void TraceBindAttribLocation(GLuint program, GLuint index, const GLchar *name){
+  glBindAttribLocation(program, index, name);
+  Record(TRACE_BIND_ATTRIB_LOCATION, {program, index}, name, strlen(name));
+}
+
+void TraceProgramParameteri(GLuint program, GLenum pname, GLint value){
+  glProgramParameteri(program, pname, value);
+  Record(TRACE_PROGRAM_PARAMETERI, {program, pname, (unsigned)value});
+}
+
+void TraceLinkProgram(GLuint program){
+  glLinkProgram(program);
+  Record(TRACE_LINK_PROGRAM, {program});
+}
+
+void TraceProgramBinary(GLuint program, GLenum format, const void *binary, GLsizei length){
+  glProgramBinary(program, format, binary, length);
+  Record(TRACE_PROGRAM_BINARY, {program, format}, binary, length);
+}
+
+void TraceDeleteProgram(GLuint program){
+  glDeleteProgram(program);
+  Record(TRACE_DELETE_PROGRAM, {program});
+}
+
+GLint TraceGetUniformLocation(GLuint program, const GLchar *name){
+  GLint location = glGetUniformLocation(program, name);
+  Record(TRACE_GET_UNIFORM_LOCATION, {program, (unsigned)location}, name, strlen(name));
+  return location;
+}
+
+void TraceUseProgram(GLuint program){
+  glUseProgram(program);
+  Record(TRACE_USE_PROGRAM, {program});
+}
+
+void TraceUniform1i(GLint location, GLint v0){
+  glUniform1i(location, v0);
+  Record(TRACE_UNIFORM_1I, {(unsigned)location, (unsigned)v0});
+}
+
+void TraceUniform1f(GLint location, GLfloat v0){
+  glUniform1f(location, v0);
+  Record(TRACE_UNIFORM_1F, {(unsigned)location, Bits(v0)});
+}
+
+void TraceUniform2f(GLint location, GLfloat v0, GLfloat v1){
+  glUniform2f(location, v0, v1);
+  Record(TRACE_UNIFORM_2F, {(unsigned)location, Bits(v0), Bits(v1)});
+}
+
+void TraceUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2){
+  glUniform3f(location, v0, v1, v2);
+  Record(TRACE_UNIFORM_3F, {(unsigned)location, Bits(v0), Bits(v1), Bits(v2)});
+}
+
+void TraceUniform3fv(GLint location, GLsizei count, const GLfloat *value){
+  glUniform3fv(location, count, value);
+  Record(TRACE_UNIFORM_3FV, {(unsigned)location, (unsigned)count}, value, count * 3 * sizeof(GLfloat));
+}
+
+void TraceUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value){
+  glUniformMatrix4fv(location, count, transpose, value);
+  Record(TRACE_UNIFORM_MATRIX_4FV, {(unsigned)location, (unsigned)count, transpose}, value, count * 16 * sizeof(GLfloat));
+}
+
+void TracePolygonMode(GLenum face, GLenum mode){
+  glPolygonMode(face, mode);
+  Record(TRACE_POLYGON_MODE, {face, mode});
+}
+
+void TraceEnable(GLenum cap){
+  glEnable(cap);
+  Record(TRACE_ENABLE, {cap});
+}
+
+void TraceDisable(GLenum cap){
+  glDisable(cap);
+  Record(TRACE_DISABLE, {cap});
+}
+
+void TracePrimitiveRestartIndex(GLuint index){
+  glPrimitiveRestartIndex(index);
+  Record(TRACE_PRIMITIVE_RESTART_INDEX, {index});
+}
+
+void TracePatchParameteri(GLenum pname, GLint value){
+  glPatchParameteri(pname, value);
+  Record(TRACE_PATCH_PARAMETERI, {pname, (unsigned)value});
+}
+
+void TraceViewport(GLint x, GLint y, GLsizei width, GLsizei height){
+  glViewport(x, y, width, height);
+  Record(TRACE_VIEWPORT, {(unsigned)x, (unsigned)y, (unsigned)width, (unsigned)height});
+}
+
+void TraceClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha){
+  glClearColor(red, green, blue, alpha);
+  Record(TRACE_CLEAR_COLOR, {Bits(red), Bits(green), Bits(blue), Bits(alpha)});
+}
+
+void TraceClear(GLbitfield mask){
+  glClear(mask);
+  Record(TRACE_CLEAR, {mask});
+}
+
+void TraceDrawArrays(GLenum mode, GLint first, GLsizei count){
+  glDrawArrays(mode, first, count);
+  Record(TRACE_DRAW_ARRAYS, {mode, (unsigned)first, (unsigned)count});
+}
+
+void TraceDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices){
+  glDrawElements(mode, count, type, indices);
+  Record(TRACE_DRAW_ELEMENTS, {mode, (unsigned)count, type, (unsigned)(size_t)indices});
+}
+
+void TraceDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLint basevertex){
+  glDrawElementsBaseVertex(mode, count, type, indices, basevertex);
+  Record(TRACE_DRAW_ELEMENTS_BASE_VERTEX, {mode, (unsigned)count, type, (unsigned)(size_t)indices, (unsigned)basevertex});
+}
+
+void TraceDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances){
+  glDrawArraysInstanced(mode, first, count, instances);
+  Record(TRACE_DRAW_ARRAYS_INSTANCED, {mode, (unsigned)first, (unsigned)count, (unsigned)instances});
+}
+
+void TraceDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances){
+  glDrawElementsInstanced(mode, count, type, indices, instances);
+  Record(TRACE_DRAW_ELEMENTS_INSTANCED, {mode, (unsigned)count, type, (unsigned)(size_t)indices, (unsigned)instances});
+}
+
+void TraceDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances, GLint basevertex){
+  glDrawElementsInstancedBaseVertex(mode, count, type, indices, instances, basevertex);
+  Record(TRACE_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX, {mode, (unsigned)count, type, (unsigned)(size_t)indices, (unsigned)instances, (unsigned)basevertex});
+}
+
+void TraceMultiDrawArraysIndirect(GLenum mode, const void *indirect, GLsizei drawcount, GLsizei stride){
+  glMultiDrawArraysIndirect(mode, indirect, drawcount, stride);
+  Record(TRACE_MULTI_DRAW_ARRAYS_INDIRECT, {mode, (unsigned)(size_t)indirect, (unsigned)drawcount, (unsigned)stride});
+}
+
+void TraceMultiDrawElementsIndirect(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride){
+  glMultiDrawElementsIndirect(mode, type, indirect, drawcount, stride);
+  Record(TRACE_MULTI_DRAW_ELEMENTS_INDIRECT, {mode, type, (unsigned)(size_t)indirect, (unsigned)drawcount, (unsigned)stride});
+}
+
+GLsync TraceFenceSync(GLenum condition, GLbitfield flags){
+  GLsync sync = glFenceSync(condition, flags);
+  syncs[sync] = nextsync;
+  Record(TRACE_FENCE_SYNC, {nextsync++});
+  return sync;
+}
+
+GLenum TraceClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout){
+  Record(TRACE_CLIENT_WAIT_SYNC, {syncs[sync], flags});
+  return glClientWaitSync(sync, flags, timeout);
+}
+
+void TraceDeleteSync(GLsync sync){
+  glDeleteSync(sync);
+  Record(TRACE_DELETE_SYNC, {syncs[sync]});
+  syncs.erase(sync);
+}
+
+#endif
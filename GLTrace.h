@@ -0,0 +1,227 @@
+#ifndef GLTRACE_H
+#define GLTRACE_H
+/*
+   GL call capture. Platform.h includes this after the GL headers, so in a GLTRACE build every
+   file's calls to the GL functions below go through a wrapper in GLTrace.cpp instead, which
+   makes the call and, between StartGLTrace and StopGLTrace, appends it to a binary trace with
+   the data of its buffer uploads (GLTraceFormat.h). GLTraceFrame marks the end of each frame.
+   replay/Replay.cpp plays a trace back against a headless context, timing every frame, or reads
+   it without any GL to count state changes and redundant calls.
+
+   Writes the program makes through a persistent mapping never pass through a GL call, so the
+   code that makes them reports them with GLTRACE_MAPPED_WRITE.
+
+   Everything here compiles to nothing unless GLTRACE is defined (premake4 --gltrace gmake).
+   Main thread only.
+ */
+
+#ifdef GLTRACE
+
+/* Start writing calls to path, for a framebuffer of width x height */
+bool StartGLTrace(const char *path, int width, int height);
+void GLTraceFrame();
+void GLTraceMappedWrite(GLuint buffer, GLintptr offset, GLsizeiptr bytes, const void *data);
+/* Close the trace and print how many frames, calls and bytes it holds */
+void StopGLTrace();
+
+#define GLTRACE_MAPPED_WRITE(buffer, offset, bytes, data) GLTraceMappedWrite(buffer, offset, bytes, data)
+
+void TraceGenBuffers(GLsizei n, GLuint *buffers);
+void TraceDeleteBuffers(GLsizei n, const GLuint *buffers);
+void TraceBindBuffer(GLenum target, GLuint buffer);
+void TraceBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+void TraceBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data);
+void TraceBufferStorage(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+void *TraceMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+GLboolean TraceUnmapBuffer(GLenum target);
+void TraceCopyBufferSubData(GLenum readtarget, GLenum writetarget, GLintptr readoffset, GLintptr writeoffset, GLsizeiptr size);
+void TraceGenVertexArrays(GLsizei n, GLuint *arrays);
+void TraceDeleteVertexArrays(GLsizei n, const GLuint *arrays);
+void TraceBindVertexArray(GLuint array);
+void TraceVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer);
+void TraceEnableVertexAttribArray(GLuint index);
+void TraceVertexAttribDivisor(GLuint index, GLuint divisor);
+void TraceVertexAttrib3f(GLuint index, GLfloat x, GLfloat y, GLfloat z);
+void TraceVertexAttrib3fv(GLuint index, const GLfloat *v);
+void TraceGenTextures(GLsizei n, GLuint *textures);
+void TraceDeleteTextures(GLsizei n, const GLuint *textures);
+void TraceActiveTexture(GLenum texture);
+void TraceBindTexture(GLenum target, GLuint texture);
+void TraceTexBuffer(GLenum target, GLenum internalformat, GLuint buffer);
+GLuint TraceCreateShader(GLenum type);
+void TraceShaderSource(GLuint shader, GLsizei count, const GLchar *const *strings, const GLint *lengths);
+void TraceCompileShader(GLuint shader);
+void TraceDeleteShader(GLuint shader);
+GLuint TraceCreateProgram();
+void TraceAttachShader(GLuint program, GLuint shader);
+void TraceDetachShader(GLuint program, GLuint shader);
+void TraceBindAttribLocation(GLuint program, GLuint index, const GLchar *name);
+void TraceProgramParameteri(GLuint program, GLenum pname, GLint value);
+void TraceLinkProgram(GLuint program);
+void TraceProgramBinary(GLuint program, GLenum format, const void *binary, GLsizei length);
+void TraceDeleteProgram(GLuint program);
+GLint TraceGetUniformLocation(GLuint program, const GLchar *name);
+void TraceUseProgram(GLuint program);
+void TraceUniform1i(GLint location, GLint v0);
+void TraceUniform1f(GLint location, GLfloat v0);
+void TraceUniform2f(GLint location, GLfloat v0, GLfloat v1);
+void TraceUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+void TraceUniform3fv(GLint location, GLsizei count, const GLfloat *value);
+void TraceUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+void TracePolygonMode(GLenum face, GLenum mode);
+void TraceEnable(GLenum cap);
+void TraceDisable(GLenum cap);
+void TracePrimitiveRestartIndex(GLuint index);
+void TracePatchParameteri(GLenum pname, GLint value);
+void TraceViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void TraceClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+void TraceClear(GLbitfield mask);
+void TraceDrawArrays(GLenum mode, GLint first, GLsizei count);
+void TraceDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices);
+void TraceDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLint basevertex);
+void TraceDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances);
+void TraceDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances);
+void TraceDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances, GLint basevertex);
+void TraceMultiDrawArraysIndirect(GLenum mode, const void *indirect, GLsizei drawcount, GLsizei stride);
+void TraceMultiDrawElementsIndirect(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+GLsync TraceFenceSync(GLenum condition, GLbitfield flags);
+GLenum TraceClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout);
+void TraceDeleteSync(GLsync sync);
+
+/* GLTrace.cpp itself calls the real functions */
+#ifndef GLTRACE_IMPLEMENTATION
+#undef glGenBuffers
+#define glGenBuffers TraceGenBuffers
+#undef glDeleteBuffers
+#define glDeleteBuffers TraceDeleteBuffers
+#undef glBindBuffer
+#define glBindBuffer TraceBindBuffer
+#undef glBufferData
+#define glBufferData TraceBufferData
+#undef glBufferSubData
+#define glBufferSubData TraceBufferSubData
+#undef glBufferStorage
+#define glBufferStorage TraceBufferStorage
+#undef glMapBufferRange
+#define glMapBufferRange TraceMapBufferRange
+#undef glUnmapBuffer
+#define glUnmapBuffer TraceUnmapBuffer
+#undef glCopyBufferSubData
+#define glCopyBufferSubData TraceCopyBufferSubData
+#undef glGenVertexArrays
+#define glGenVertexArrays TraceGenVertexArrays
+#undef glDeleteVertexArrays
+#define glDeleteVertexArrays TraceDeleteVertexArrays
+#undef glBindVertexArray
+#define glBindVertexArray TraceBindVertexArray
+#undef glVertexAttribPointer
+#define glVertexAttribPointer TraceVertexAttribPointer
+#undef glEnableVertexAttribArray
+#define glEnableVertexAttribArray TraceEnableVertexAttribArray
+#undef glVertexAttribDivisor
+#define glVertexAttribDivisor TraceVertexAttribDivisor
+#undef glVertexAttrib3f
+#define glVertexAttrib3f TraceVertexAttrib3f
+#undef glVertexAttrib3fv
+#define glVertexAttrib3fv TraceVertexAttrib3fv
+#undef glGenTextures
+#define glGenTextures TraceGenTextures
+#undef glDeleteTextures
+#define glDeleteTextures TraceDeleteTextures
+#undef glActiveTexture
+#define glActiveTexture TraceActiveTexture
+#undef glBindTexture
+#define glBindTexture TraceBindTexture
+#undef glTexBuffer
+#define glTexBuffer TraceTexBuffer
+#undef glCreateShader
+#define glCreateShader TraceCreateShader
+#undef glShaderSource
+#define glShaderSource TraceShaderSource
+#undef glCompileShader
+#define glCompileShader TraceCompileShader
+#undef glDeleteShader
+#define glDeleteShader TraceDeleteShader
+#undef glCreateProgram
+#define glCreateProgram TraceCreateProgram
+#undef glAttachShader
+#define glAttachShader TraceAttachShader
+#undef glDetachShader
+#define glDetachShader TraceDetachShader
+#undef glBindAttribLocation
+#define glBindAttribLocation TraceBindAttribLocation
+#undef glProgramParameteri
+#define glProgramParameteri TraceProgramParameteri
+#undef glLinkProgram
+#define glLinkProgram TraceLinkProgram
+#undef glProgramBinary
+#define glProgramBinary TraceProgramBinary
+#undef glDeleteProgram
+#define glDeleteProgram TraceDeleteProgram
+#undef glGetUniformLocation
+#define glGetUniformLocation TraceGetUniformLocation
+#undef glUseProgram
+#define glUseProgram TraceUseProgram
+#undef glUniform1i
+#define glUniform1i TraceUniform1i
+#undef glUniform1f
+#define glUniform1f TraceUniform1f
+#undef glUniform2f
+#define glUniform2f TraceUniform2f
+#undef glUniform3f
+#define glUniform3f TraceUniform3f
+#undef glUniform3fv
+#define glUniform3fv TraceUniform3fv
+#undef glUniformMatrix4fv
+#define glUniformMatrix4fv TraceUniformMatrix4fv
+#undef glPolygonMode
+#define glPolygonMode TracePolygonMode
+#undef glEnable
+#define glEnable TraceEnable
+#undef glDisable
+#define glDisable TraceDisable
+#undef glPrimitiveRestartIndex
+#define glPrimitiveRestartIndex TracePrimitiveRestartIndex
+#undef glPatchParameteri
+#define glPatchParameteri TracePatchParameteri
+#undef glViewport
+#define glViewport TraceViewport
+#undef glClearColor
+#define glClearColor TraceClearColor
+#undef glClear
+#define glClear TraceClear
+#undef glDrawArrays
+#define glDrawArrays TraceDrawArrays
+#undef glDrawElements
+#define glDrawElements TraceDrawElements
+#undef glDrawElementsBaseVertex
+#define glDrawElementsBaseVertex TraceDrawElementsBaseVertex
+#undef glDrawArraysInstanced
+#define glDrawArraysInstanced TraceDrawArraysInstanced
+#undef glDrawElementsInstanced
+#define glDrawElementsInstanced TraceDrawElementsInstanced
+#undef glDrawElementsInstancedBaseVertex
+#define glDrawElementsInstancedBaseVertex TraceDrawElementsInstancedBaseVertex
+#undef glMultiDrawArraysIndirect
+#define glMultiDrawArraysIndirect TraceMultiDrawArraysIndirect
+#undef glMultiDrawElementsIndirect
+#define glMultiDrawElementsIndirect TraceMultiDrawElementsIndirect
+#undef glFenceSync
+#define glFenceSync TraceFenceSync
+#undef glClientWaitSync
+#define glClientWaitSync TraceClientWaitSync
+#undef glDeleteSync
+#define glDeleteSync TraceDeleteSync
+#endif
+
+#else
+
+#define GLTRACE_MAPPED_WRITE(buffer, offset, bytes, data)
+
+inline bool StartGLTrace(const char *, int, int) { return false; }
+inline void GLTraceFrame() {}
+inline void StopGLTrace() {}
+
+#endif
+
+#endif
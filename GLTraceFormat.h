@@ -0,0 +1,171 @@
+#ifndef GLTRACEFORMAT_H
+#define GLTRACEFORMAT_H
+/*
+   The file format GLTrace.cpp writes and replay/Replay.cpp reads. A trace starts with a
+   TraceHeader, then holds one record per GL call: a byte of TraceOp, the call's fixed arguments
+   as traceops[op].words little-endian 32-bit words (floats by their bits), and for the calls with
+   a payload a word of its length in bytes followed by the bytes themselves. A TRACE_FRAME record
+   ends each frame; whatever comes before the first one is setup.
+
+   Object names, uniform locations and sync objects are the capturing run's; the replayer maps
+   them to its own as the records that create them go by. Buffer offsets and sizes take one word,
+   which this program's buffers never outgrow.
+ */
+
+#define GLTRACE_MAGIC "GLTRACE"
+#define GLTRACE_VERSION 1
+
+struct TraceHeader {
+  char magic[8];       /* GLTRACE_MAGIC, zero padded */
+  unsigned version;    /* GLTRACE_VERSION */
+  unsigned width, height; /* Of the framebuffer the capture drew into */
+};
+
+enum TraceOp {
+  TRACE_FRAME,
+  /* Buffers */
+  TRACE_GEN_BUFFERS,                  /* Payload: the names */
+  TRACE_DELETE_BUFFERS,               /* Payload: the names */
+  TRACE_BIND_BUFFER,                  /* target, buffer */
+  TRACE_BUFFER_DATA,                  /* target, size, usage; payload: the data, empty for NULL */
+  TRACE_BUFFER_SUB_DATA,              /* target, offset; payload: the data */
+  TRACE_BUFFER_STORAGE,               /* target, size, flags; payload: the data, empty for NULL */
+  TRACE_MAP_BUFFER_RANGE,             /* target, offset, length, access */
+  TRACE_UNMAP_BUFFER,                 /* target */
+  TRACE_MAPPED_WRITE,                 /* buffer, offset; payload: what was written through a mapping */
+  TRACE_COPY_BUFFER_SUB_DATA,         /* read target, write target, read offset, write offset, size */
+  /* Vertex arrays */
+  TRACE_GEN_VERTEX_ARRAYS,            /* Payload: the names */
+  TRACE_DELETE_VERTEX_ARRAYS,         /* Payload: the names */
+  TRACE_BIND_VERTEX_ARRAY,            /* array */
+  TRACE_VERTEX_ATTRIB_POINTER,        /* index, size, type, normalized, stride, offset */
+  TRACE_ENABLE_VERTEX_ATTRIB_ARRAY,   /* index */
+  TRACE_VERTEX_ATTRIB_DIVISOR,        /* index, divisor */
+  TRACE_VERTEX_ATTRIB_3F,             /* index, x, y, z */
+  /* Textures */
+  TRACE_GEN_TEXTURES,                 /* Payload: the names */
+  TRACE_DELETE_TEXTURES,              /* Payload: the names */
+  TRACE_ACTIVE_TEXTURE,               /* unit */
+  TRACE_BIND_TEXTURE,                 /* target, texture */
+  TRACE_TEX_BUFFER,                   /* target, internal format, buffer */
+  /* Shaders and programs */
+  TRACE_CREATE_SHADER,                /* type, the shader created */
+  TRACE_SHADER_SOURCE,                /* shader; payload: the strings joined */
+  TRACE_COMPILE_SHADER,               /* shader */
+  TRACE_DELETE_SHADER,                /* shader */
+  TRACE_CREATE_PROGRAM,               /* the program created */
+  TRACE_ATTACH_SHADER,                /* program, shader */
+  TRACE_DETACH_SHADER,                /* program, shader */
+  TRACE_BIND_ATTRIB_LOCATION,         /* program, index; payload: the name */
+  TRACE_PROGRAM_PARAMETERI,           /* program, parameter, value */
+  TRACE_LINK_PROGRAM,                 /* program */
+  TRACE_PROGRAM_BINARY,               /* program, format; payload: the binary */
+  TRACE_DELETE_PROGRAM,               /* program */
+  TRACE_GET_UNIFORM_LOCATION,         /* program, the location returned; payload: the name */
+  TRACE_USE_PROGRAM,                  /* program */
+  /* Uniforms of the program in use */
+  TRACE_UNIFORM_1I,                   /* location, v0 */
+  TRACE_UNIFORM_1F,                   /* location, v0 */
+  TRACE_UNIFORM_2F,                   /* location, v0, v1 */
+  TRACE_UNIFORM_3F,                   /* location, v0, v1, v2 */
+  TRACE_UNIFORM_3FV,                  /* location, count; payload: the values */
+  TRACE_UNIFORM_MATRIX_4FV,           /* location, count, transpose; payload: the values */
+  /* Fixed-function state */
+  TRACE_POLYGON_MODE,                 /* face, mode */
+  TRACE_ENABLE,                       /* capability */
+  TRACE_DISABLE,                      /* capability */
+  TRACE_PRIMITIVE_RESTART_INDEX,      /* index */
+  TRACE_PATCH_PARAMETERI,             /* parameter, value */
+  TRACE_VIEWPORT,                     /* x, y, width, height */
+  TRACE_CLEAR_COLOR,                  /* red, green, blue, alpha */
+  TRACE_CLEAR,                        /* mask */
+  /* Draws */
+  TRACE_DRAW_ARRAYS,                  /* mode, first, count */
+  TRACE_DRAW_ELEMENTS,                /* mode, count, type, offset */
+  TRACE_DRAW_ELEMENTS_BASE_VERTEX,    /* mode, count, type, offset, base vertex */
+  TRACE_DRAW_ARRAYS_INSTANCED,        /* mode, first, count, instances */
+  TRACE_DRAW_ELEMENTS_INSTANCED,      /* mode, count, type, offset, instances */
+  TRACE_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX, /* mode, count, type, offset, instances, base vertex */
+  TRACE_MULTI_DRAW_ARRAYS_INDIRECT,   /* mode, offset, draws, stride */
+  TRACE_MULTI_DRAW_ELEMENTS_INDIRECT, /* mode, type, offset, draws, stride */
+  /* Sync objects, numbered from 1 in the order they were made */
+  TRACE_FENCE_SYNC,                   /* the sync made */
+  TRACE_CLIENT_WAIT_SYNC,             /* sync, flags */
+  TRACE_DELETE_SYNC,                  /* sync */
+  TRACE_OPS
+};
+
+struct TraceOpInfo {
+  const char *name;
+  unsigned char words;
+  bool payload;
+};
+
+static const TraceOpInfo traceops[TRACE_OPS] = {
+  {"frame", 0, false},
+  {"glGenBuffers", 0, true},
+  {"glDeleteBuffers", 0, true},
+  {"glBindBuffer", 2, false},
+  {"glBufferData", 3, true},
+  {"glBufferSubData", 2, true},
+  {"glBufferStorage", 3, true},
+  {"glMapBufferRange", 4, false},
+  {"glUnmapBuffer", 1, false},
+  {"mapped write", 2, true},
+  {"glCopyBufferSubData", 5, false},
+  {"glGenVertexArrays", 0, true},
+  {"glDeleteVertexArrays", 0, true},
+  {"glBindVertexArray", 1, false},
+  {"glVertexAttribPointer", 6, false},
+  {"glEnableVertexAttribArray", 1, false},
+  {"glVertexAttribDivisor", 2, false},
+  {"glVertexAttrib3f", 4, false},
+  {"glGenTextures", 0, true},
+  {"glDeleteTextures", 0, true},
+  {"glActiveTexture", 1, false},
+  {"glBindTexture", 2, false},
+  {"glTexBuffer", 3, false},
+  {"glCreateShader", 2, false},
+  {"glShaderSource", 1, true},
+  {"glCompileShader", 1, false},
+  {"glDeleteShader", 1, false},
+  {"glCreateProgram", 1, false},
+  {"glAttachShader", 2, false},
+  {"glDetachShader", 2, false},
+  {"glBindAttribLocation", 2, true},
+  {"glProgramParameteri", 3, false},
+  {"glLinkProgram", 1, false},
+  {"glProgramBinary", 2, true},
+  {"glDeleteProgram", 1, false},
+  {"glGetUniformLocation", 2, true},
+  {"glUseProgram", 1, false},
+  {"glUniform1i", 2, false},
+  {"glUniform1f", 2, false},
+  {"glUniform2f", 3, false},
+  {"glUniform3f", 4, false},
+  {"glUniform3fv", 2, true},
+  {"glUniformMatrix4fv", 3, true},
+  {"glPolygonMode", 2, false},
+  {"glEnable", 1, false},
+  {"glDisable", 1, false},
+  {"glPrimitiveRestartIndex", 1, false},
+  {"glPatchParameteri", 2, false},
+  {"glViewport", 4, false},
+  {"glClearColor", 4, false},
+  {"glClear", 1, false},
+  {"glDrawArrays", 3, false},
+  {"glDrawElements", 4, false},
+  {"glDrawElementsBaseVertex", 5, false},
+  {"glDrawArraysInstanced", 4, false},
+  {"glDrawElementsInstanced", 5, false},
+  {"glDrawElementsInstancedBaseVertex", 6, false},
+  {"glMultiDrawArraysIndirect", 4, false},
+  {"glMultiDrawElementsIndirect", 5, false},
+  {"glFenceSync", 1, false},
+  {"glClientWaitSync", 2, false},
+  {"glDeleteSync", 1, false},
+};
+
+#define TRACE_MAX_WORDS 6
+
+#endif
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "GeometryArena.h"
+
+#define ARENA_MIN_VERTICES 4096  /* First allocation of a new arena's buffers */
+#define ARENA_MIN_INDICES 16384
+
+static std::vector<GeometryArena *> arenas;
+
+static bool SameLayout(const VertexLayout &a, const VertexLayout &b){
+  if(a.count != b.count || a.stride != b.stride || a.constantcolor != b.constantcolor || a.normals != b.normals)
+    return false;
+  if(a.constantcolor && memcmp(a.color, b.color, sizeof(a.color)))
+    return false;
+  for(int i = 0; i<a.count; i++){
+    const VertexAttribute &x = a.attributes[i], &y = b.attributes[i];
+    if(x.index != y.index || x.size != y.size || x.type != y.type || x.normalized != y.normalized || x.offset != y.offset)
+      return false;
+  }
+  return true;
+}
+
+static GLsizeiptr IndexSize(GLenum indextype){
+  return indextype == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+/* First fit */
+static bool Allocate(ArenaAllocator *a, GLuint count, GLuint *first){
+  for(size_t i = 0; i<a->freeblocks.size(); i++){
+    ArenaBlock &block = a->freeblocks[i];
+    if(block.count < count)
+      continue;
+    *first = block.first;
+    block.first += count;
+    block.count -= count;
+    if(!block.count)
+      a->freeblocks.erase(a->freeblocks.begin() + i);
+    return true;
+  }
+  return false;
+}
+
+/* Return a block to the list, merging it with the free blocks on either side */
+static void Release(ArenaAllocator *a, GLuint first, GLuint count){
+  if(!count)
+    return;
+  ArenaBlock block = {first, count};
+  std::vector<ArenaBlock>::iterator next = std::upper_bound(a->freeblocks.begin(), a->freeblocks.end(), block,
+    [](const ArenaBlock &x, const ArenaBlock &y){ return x.first < y.first; });
+  size_t i = next - a->freeblocks.begin();
+  a->freeblocks.insert(next, block);
+  if(i + 1 < a->freeblocks.size() && a->freeblocks[i].first + a->freeblocks[i].count == a->freeblocks[i + 1].first){
+    a->freeblocks[i].count += a->freeblocks[i + 1].count;
+    a->freeblocks.erase(a->freeblocks.begin() + i + 1);
+  }
+  if(i > 0 && a->freeblocks[i - 1].first + a->freeblocks[i - 1].count == a->freeblocks[i].first){
+    a->freeblocks[i - 1].count += a->freeblocks[i].count;
+    a->freeblocks.erase(a->freeblocks.begin() + i);
+  }
+}
+
+static GLuint FreeCount(const ArenaAllocator &a){
+  GLuint n = 0;
+  for(size_t i = 0; i<a.freeblocks.size(); i++)
+    n += a.freeblocks[i].count;
+  return n;
+}
+
+struct BufferCopy {
+  GLintptr from, to;
+  GLsizeiptr bytes;
+};
+
+/* A new buffer of bytes holding the listed pieces of old, which is deleted */
+static GLuint CopyBuffer(GLuint old, GLsizeiptr bytes, const std::vector<BufferCopy> &copies){
+  GLuint buffer;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+  if(old){
+    glBindBuffer(GL_COPY_READ_BUFFER, old);
+    for(size_t i = 0; i<copies.size(); i++)
+      if(copies[i].bytes)
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, copies[i].from, copies[i].to, copies[i].bytes);
+    glDeleteBuffers(1, &old);
+  }
+  return buffer;
+}
+
+/* Point the VAO at the arena's current buffers */
+static void BindBuffers(GeometryArena *arena){
+  glBindVertexArray(arena->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, arena->vertexbuffer);
+  ApplyVertexLayout(arena->layout);
+  if(arena->indextype)
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->indexbuffer);
+  glBindVertexArray(0);
+}
+
+/* Grow an allocator and its buffer to capacity elements of size bytes, keeping the contents */
+static void Grow(ArenaAllocator *a, GLuint *buffer, GLuint capacity, GLsizeiptr size){
+  std::vector<BufferCopy> copies(1);
+  copies[0].from = copies[0].to = 0;
+  copies[0].bytes = a->capacity * size;
+  *buffer = CopyBuffer(*buffer, capacity * size, copies);
+  Release(a, a->capacity, capacity - a->capacity);
+  a->capacity = capacity;
+}
+
+GeometryArena *GetGeometryArena(const VertexLayout &layout, GLenum indextype, GLuint instancebuffer){
+  for(size_t i = 0; i<arenas.size(); i++)
+    if(arenas[i]->indextype == indextype && SameLayout(arenas[i]->layout, layout))
+      return arenas[i];
+  GeometryArena *arena = new GeometryArena;
+  arena->layout = layout;
+  arena->indextype = indextype;
+  arena->vertexbuffer = arena->indexbuffer = 0;
+  arena->vertices.capacity = arena->indices.capacity = 0;
+  arena->defragmentations = 0;
+  glGenVertexArrays(1, &arena->vao);
+  glBindVertexArray(arena->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, instancebuffer);
+  for(int i = 0; i<4; i++){ /* One mat4 per instance, as in UploadBlocks */
+    glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat), (const GLvoid*)(i * 4 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(2 + i);
+    glVertexAttribDivisor(2 + i, 1);
+  }
+  glBindVertexArray(0);
+  arenas.push_back(arena);
+  return arena;
+}
+
+/* Take space for range from both free lists, or from neither */
+static bool Reserve(GeometryArena *arena, ArenaRange *range){
+  if(!Allocate(&arena->vertices, range->vertexcount, &range->firstvertex))
+    return false;
+  if(range->indexcount && !Allocate(&arena->indices, range->indexcount, &range->firstindex)){
+    Release(&arena->vertices, range->firstvertex, range->vertexcount);
+    return false;
+  }
+  return true;
+}
+
+int ArenaAdd(GeometryArena *arena, const void *vertices, GLuint vertexcount, const void *indices, GLuint indexcount){
+  GLsizeiptr stride = arena->layout.stride, indexsize = IndexSize(arena->indextype);
+  ArenaRange range = {0, vertexcount, 0, indexcount, true};
+  if(!Reserve(arena, &range)){
+    /* Growing adds at least the space needed to the free block at the end */
+    if(FreeCount(arena->vertices) < vertexcount)
+      Grow(&arena->vertices, &arena->vertexbuffer, std::max(std::max(arena->vertices.capacity * 2, (GLuint)ARENA_MIN_VERTICES),
+           arena->vertices.capacity + vertexcount), stride);
+    if(FreeCount(arena->indices) < indexcount)
+      Grow(&arena->indices, &arena->indexbuffer, std::max(std::max(arena->indices.capacity * 2, (GLuint)ARENA_MIN_INDICES),
+           arena->indices.capacity + indexcount), indexsize);
+    if(!Reserve(arena, &range)){ /* Enough space in total, but in pieces */
+      DefragmentArena(arena);
+      Reserve(arena, &range);
+    }
+    BindBuffers(arena);
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, arena->vertexbuffer);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstvertex * stride, vertexcount * stride, vertices);
+  if(indexcount){
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena->indexbuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstindex * indexsize, indexcount * indexsize, indices);
+  }
+
+  for(size_t i = 0; i<arena->ranges.size(); i++)
+    if(!arena->ranges[i].live){
+      arena->ranges[i] = range;
+      return i;
+    }
+  arena->ranges.push_back(range);
+  return arena->ranges.size() - 1;
+}
+
+void ArenaRemove(GeometryArena *arena, int handle){
+  ArenaRange &range = arena->ranges[handle];
+  Release(&arena->vertices, range.firstvertex, range.vertexcount);
+  Release(&arena->indices, range.firstindex, range.indexcount);
+  range.live = false;
+}
+
+void DefragmentArena(GeometryArena *arena){
+  GLsizeiptr stride = arena->layout.stride, indexsize = IndexSize(arena->indextype);
+  std::vector<BufferCopy> vertexcopies, indexcopies;
+  GLuint vertexend = 0, indexend = 0;
+  /* Handle order rather than buffer order; either packs the live meshes with no gaps */
+  for(size_t i = 0; i<arena->ranges.size(); i++){
+    ArenaRange &range = arena->ranges[i];
+    if(!range.live)
+      continue;
+    BufferCopy v = {(GLintptr)(range.firstvertex * stride), (GLintptr)(vertexend * stride), (GLsizeiptr)(range.vertexcount * stride)};
+    BufferCopy x = {(GLintptr)(range.firstindex * indexsize), (GLintptr)(indexend * indexsize), (GLsizeiptr)(range.indexcount * indexsize)};
+    vertexcopies.push_back(v);
+    indexcopies.push_back(x);
+    range.firstvertex = vertexend;
+    range.firstindex = indexend;
+    vertexend += range.vertexcount;
+    indexend += range.indexcount;
+  }
+  arena->vertexbuffer = CopyBuffer(arena->vertexbuffer, arena->vertices.capacity * stride, vertexcopies);
+  arena->vertices.freeblocks.clear();
+  Release(&arena->vertices, vertexend, arena->vertices.capacity - vertexend);
+  if(arena->indextype){
+    arena->indexbuffer = CopyBuffer(arena->indexbuffer, arena->indices.capacity * indexsize, indexcopies);
+    arena->indices.freeblocks.clear();
+    Release(&arena->indices, indexend, arena->indices.capacity - indexend);
+  }
+  BindBuffers(arena);
+  arena->defragmentations++;
+}
+
+void PrintGeometryArenaStats(){
+  for(size_t i = 0; i<arenas.size(); i++){
+    const GeometryArena *a = arenas[i];
+    GLsizeiptr indexsize = IndexSize(a->indextype);
+    printf("Geometry arena %d (%d bytes/vertex, %s): %d of %d vertices and %d of %d indices used, %d free blocks, %u defragmentations\n",
+           (int)i, (int)a->layout.stride, a->indextype ? (indexsize == 2 ? "16-bit indices" : "32-bit indices") : "not indexed",
+           (int)(a->vertices.capacity - FreeCount(a->vertices)), (int)a->vertices.capacity,
+           (int)(a->indices.capacity - FreeCount(a->indices)), (int)a->indices.capacity,
+           (int)(a->vertices.freeblocks.size() + a->indices.freeblocks.size()), a->defragmentations);
+  }
+}
+
+void ReleaseGeometryArenas(){
+  for(size_t i = 0; i<arenas.size(); i++){
+    glDeleteVertexArrays(1, &arenas[i]->vao);
+    glDeleteBuffers(1, &arenas[i]->vertexbuffer);
+    if(arenas[i]->indexbuffer)
+      glDeleteBuffers(1, &arenas[i]->indexbuffer);
+    delete arenas[i];
+  }
+  arenas.clear();
+}
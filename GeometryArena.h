@@ -0,0 +1,66 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+/*
+   Geometry arenas. Every mesh with the same vertex layout and index type lives in one shared
+   vertex buffer and one shared index buffer behind a single VAO, so a whole pipeline state can be
+   drawn with one glMultiDrawElementsIndirect (or Arrays) call whose commands pick each mesh out
+   by base vertex and first index.
+
+   Space is handed out by a first-fit free list counted in vertices and indices, so every mesh
+   starts on a whole vertex. A removed mesh returns its blocks to the list, where they merge with
+   free neighbours. When an allocation does not fit in any block but would fit in the total free
+   space the arena is compacted; otherwise its buffers grow, doubling, and the contents are copied
+   on the GPU.
+ */
+#include <vector>
+#include "Mesh.h"
+
+/* glMultiDraw*Indirect command records, laid out as the GL reads them */
+struct DrawArraysIndirectCommand {
+  GLuint count, instancecount, first, baseinstance;
+};
+
+struct DrawElementsIndirectCommand {
+  GLuint count, instancecount, firstindex;
+  GLint basevertex;
+  GLuint baseinstance;
+};
+
+struct ArenaBlock {
+  GLuint first, count;
+};
+
+/* Free list over [0, capacity) elements, sorted by first and with no two blocks touching */
+struct ArenaAllocator {
+  GLuint capacity;
+  std::vector<ArenaBlock> freeblocks;
+};
+
+/* Where one mesh lives in its arena */
+struct ArenaRange {
+  GLuint firstvertex, vertexcount;
+  GLuint firstindex, indexcount;
+  bool live;
+};
+
+struct GeometryArena {
+  VertexLayout layout;
+  GLenum indextype;          /* 0 when the arena holds non-indexed meshes */
+  GLuint vao, vertexbuffer, indexbuffer;
+  ArenaAllocator vertices, indices;
+  std::vector<ArenaRange> ranges; /* By handle; handles are reused once their mesh is removed */
+  unsigned defragmentations;
+};
+
+/* The arena for meshes with layout and indextype, created on first use. Its VAO takes the
+   per-instance model matrices (attributes 2 to 5) from instancebuffer. */
+GeometryArena *GetGeometryArena(const VertexLayout &layout, GLenum indextype, GLuint instancebuffer);
+/* Copy a mesh's blocks into the arena and return its handle */
+int ArenaAdd(GeometryArena *arena, const void *vertices, GLuint vertexcount, const void *indices, GLuint indexcount);
+void ArenaRemove(GeometryArena *arena, int handle);
+/* Move every live mesh to the front of the buffers, leaving one free block at the end */
+void DefragmentArena(GeometryArena *arena);
+void PrintGeometryArenaStats();
+void ReleaseGeometryArenas();
+
+#endif
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include "Platform.h"
+#include "Headless.h"
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static GLuint framebuffer, renderbuffers[2];
+
+bool CreateHeadlessContext(int width, int height){
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if(getPlatformDisplay)
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  if(display == EGL_NO_DISPLAY)
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  EGLint major, minor;
+  if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)){
+    fprintf(stderr, "Headless: no EGL display\n");
+    return false;
+  }
+  if(!eglBindAPI(EGL_OPENGL_API)){
+    fprintf(stderr, "Headless: EGL cannot create desktop GL contexts\n");
+    return false;
+  }
+  /* Surfaceless contexts need no config; everything is drawn into the FBO below */
+  const EGLint attributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 4,
+    EGL_CONTEXT_MINOR_VERSION, 1,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+  if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)){
+    fprintf(stderr, "Headless: cannot create a GL 4.1 core context (EGL error 0x%x)\n", eglGetError());
+    return false;
+  }
+
+#ifndef __APPLE__
+  glewExperimental = GL_TRUE;
+  int err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+  if(err == GLEW_ERROR_NO_GLX_DISPLAY) /* Expected without X; the GL entry points are loaded by then */
+    err = GLEW_OK;
+#endif
+  if (GLEW_OK != err) {
+    fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
+    return false;
+  }
+#endif
+
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glGenRenderbuffers(2, renderbuffers);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+    fprintf(stderr, "Headless: framebuffer incomplete\n");
+    return false;
+  }
+  glViewport(0, 0, width, height);
+  fprintf(stderr, "GL INFO %s (%s), headless %dx%d\n", glGetString(GL_VERSION), glGetString(GL_RENDERER), width, height);
+  return true;
+}
+
+void DestroyHeadlessContext(){
+  if(context == EGL_NO_CONTEXT)
+    return;
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteRenderbuffers(2, renderbuffers);
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(display, context);
+  eglTerminate(display);
+  context = EGL_NO_CONTEXT;
+}
+
+#else
+
+bool CreateHeadlessContext(int width, int height){
+  fprintf(stderr, "Headless rendering needs EGL, which this build only supports on Linux\n");
+  return false;
+}
+
+void DestroyHeadlessContext(){
+}
+
+#endif
+
+bool WritePPM(const char *path, int width, int height, const unsigned char *rgba){
+  FILE *out = fopen(path, "wb");
+  if(!out){
+    fprintf(stderr, "Cannot write %s\n", path);
+    return false;
+  }
+  fprintf(out, "P6\n%d %d\n255\n", width, height);
+  for(int y = height - 1; y>=0; y--)
+    for(int x = 0; x<width; x++)
+      fwrite(&rgba[((size_t)y * width + x) * 4], 1, 3, out);
+  fclose(out);
+  return true;
+}
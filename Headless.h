@@ -0,0 +1,15 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+/*
+   Offscreen GL context for machines with no display. On Linux this is an EGL context on Mesa's
+   surfaceless platform (which falls back to llvmpipe when there is no GPU), rendering into a
+   framebuffer object of the requested size. Other platforms report that it is unavailable.
+ */
+
+/* Create the context, make it current and bind a width x height colour + depth FBO */
+bool CreateHeadlessContext(int width, int height);
+void DestroyHeadlessContext();
+/* Write RGBA8 pixels, bottom row first as glReadPixels returns them, as a binary PPM */
+bool WritePPM(const char *path, int width, int height, const unsigned char *rgba);
+
+#endif
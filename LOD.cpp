@@ -0,0 +1,32 @@
+#include <float.h>
+#include <math.h>
+#include "LOD.h"
+
+void SetLODChain(LODChain *chain, const Mesh *const *meshes, const int *segments, int count){
+  if(count > MAX_LOD_LEVELS)
+    count = MAX_LOD_LEVELS;
+  chain->count = count;
+  for(int i = 0; i<count; i++){
+    chain->meshes[i] = meshes[i];
+    float error = 1 - cosf((float)M_PI / segments[i]);
+    chain->maxradius[i] = i == 0 || error <= 0 ? FLT_MAX : LOD_ERROR_PIXELS / error;
+  }
+}
+
+float ProjectedRadius(const glm::mat4 &viewprojection, float pixelscale, const glm::vec4 &sphere){
+  /* Clip w is the distance in front of the eye along the view direction */
+  const glm::mat4 &m = viewprojection;
+  float w = m[0][3] * sphere.x + m[1][3] * sphere.y + m[2][3] * sphere.z + m[3][3];
+  if(w <= sphere.w)
+    return FLT_MAX;
+  return sphere.w * pixelscale / w;
+}
+
+int SelectLOD(const LODChain &chain, float pixelradius, int current){
+  int level = current < chain.count ? current : chain.count - 1;
+  while(level > 0 && pixelradius > chain.maxradius[level])
+    level--;
+  while(level + 1 < chain.count && pixelradius * LOD_HYSTERESIS <= chain.maxradius[level + 1])
+    level++;
+  return level;
+}
@@ -0,0 +1,35 @@
+#ifndef LOD_H
+#define LOD_H
+/*
+   Discrete levels of detail. A LODChain holds one shape at up to MAX_LOD_LEVELS resolutions,
+   finest first. Each level approximates the shape's circles with some number of segments s, and
+   a circle r pixels across drawn that way strays from its true outline by r (1 - cos(pi / s))
+   pixels, so a level is good enough up to the projected radius where that error reaches
+   LOD_ERROR_PIXELS. An object moves to a finer level as soon as it grows past its level's radius,
+   but to a coarser one only once it is LOD_HYSTERESIS times inside that level's radius, so an
+   object sitting on a boundary does not pop back and forth between two levels.
+ */
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+#define MAX_LOD_LEVELS 4  /* Levels in a LODChain, 0 the finest */
+#define LOD_ERROR_PIXELS 0.5f
+#define LOD_HYSTERESIS 1.25f
+
+struct LODChain {
+  const Mesh *meshes[MAX_LOD_LEVELS];
+  float maxradius[MAX_LOD_LEVELS];  /* Largest projected radius in pixels each level is drawn at */
+  int count;
+};
+
+/* Fill chain with count meshes, finest first. segments[i] is the number of segments meshes[i]
+   has around its circles. */
+void SetLODChain(LODChain *chain, const Mesh *const *meshes, const int *segments, int count);
+/* Radius in pixels of a world-space sphere (centre xyz, radius w) under viewprojection, where
+   pixelscale is the projection's [1][1] times half the viewport height. A sphere that reaches
+   the eye plane gets FLT_MAX. */
+float ProjectedRadius(const glm::mat4 &viewprojection, float pixelscale, const glm::vec4 &sphere);
+/* The level of chain to draw an object of pixelradius at, given the level it had last frame */
+int SelectLOD(const LODChain &chain, float pixelradius, int current);
+
+#endif
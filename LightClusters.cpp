@@ -0,0 +1,187 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "LightClusters.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#define SLICE_CLUSTERS (CLUSTER_TILES_X * CLUSTER_TILES_Y)
+
+/* The cluster table (offset and count per cluster), the light index list and the lights (two
+   texels each: view-space position and range, then colour) */
+enum { CLUSTER_TABLE, CLUSTER_INDICES, CLUSTER_LIGHTS, CLUSTER_BUFFERS };
+static GLuint buffers[CLUSTER_BUFFERS], textures[CLUSTER_BUFFERS];
+static const GLenum formats[CLUSTER_BUFFERS] = {GL_RG32UI, GL_R32UI, GL_RGBA32F};
+
+/* Kept between frames so steady state allocates nothing */
+static std::vector<glm::vec4> viewlights;     /* Two per light, as uploaded */
+static std::vector<int> firstslice, lastslice; /* Slices each light touches; first > last if none */
+static std::vector<GLuint> slicetables[CLUSTER_SLICES], sliceindices[CLUSTER_SLICES];
+static std::vector<GLuint> table, indices;
+static std::vector<bool> reached;             /* Lights that some cluster lists, for the stats */
+static float clusternear, slicescale;         /* Slice of depth d is log(d / near) * slicescale */
+
+/* Range of tiles along one axis that the extent [lo, hi] at view depths [dmin, dmax] covers.
+   scale is the projection's diagonal entry for the axis. Empty (first > last) when off screen. */
+static void TileRange(float lo, float hi, float dmin, float dmax, float scale, int tiles, int *first, int *last){
+  float ndclo = scale * lo / (lo < 0 ? dmin : dmax);
+  float ndchi = scale * hi / (hi > 0 ? dmin : dmax);
+  *first = std::max(0, (int)floorf((ndclo + 1) / 2 * tiles));
+  *last = std::min(tiles - 1, (int)floorf((ndchi + 1) / 2 * tiles));
+}
+
+/* Sort the lights that reach slice s into its clusters: count per cluster, then fill, so the
+   slice's index list comes out in light order */
+static void BuildSlice(int s, float P00, float P11){
+  float d0 = clusternear * expf(s / slicescale), d1 = clusternear * expf((s + 1) / slicescale);
+  GLuint counts[SLICE_CLUSTERS], offsets[SLICE_CLUSTERS];
+  memset(counts, 0, sizeof(counts));
+  std::vector<GLuint> &out = sliceindices[s];
+  out.clear();
+  for(int pass = 0; pass<2; pass++){
+    for(size_t i = 0; i<firstslice.size(); i++){
+      if(s < firstslice[i] || s > lastslice[i])
+        continue;
+      const glm::vec4 &p = viewlights[i * 2];
+      float depth = -p.z, range = p.w;
+      float dmin = std::max(d0, depth - range), dmax = std::min(d1, depth + range);
+      /* Radius of the sphere's widest cross-section within the slice */
+      float nearest = depth < dmin ? dmin : (depth > dmax ? dmax : depth);
+      float r = sqrtf(std::max(0.f, range * range - (nearest - depth) * (nearest - depth)));
+      int x0, x1, y0, y1;
+      TileRange(p.x - r, p.x + r, dmin, dmax, P00, CLUSTER_TILES_X, &x0, &x1);
+      TileRange(p.y - r, p.y + r, dmin, dmax, P11, CLUSTER_TILES_Y, &y0, &y1);
+      for(int y = y0; y<=y1; y++)
+        for(int x = x0; x<=x1; x++){
+          int c = y * CLUSTER_TILES_X + x;
+          if(pass == 0)
+            counts[c]++;
+          else
+            out[offsets[c]++] = i;
+        }
+    }
+    if(pass == 0){
+      GLuint total = 0;
+      for(int c = 0; c<SLICE_CLUSTERS; c++){
+        offsets[c] = total;
+        total += counts[c];
+      }
+      out.resize(total);
+    }
+  }
+  std::vector<GLuint> &t = slicetables[s];
+  t.resize(SLICE_CLUSTERS * 2);
+  for(int c = 0; c<SLICE_CLUSTERS; c++){
+    t[c * 2] = offsets[c] - counts[c];
+    t[c * 2 + 1] = counts[c];
+  }
+}
+
+/* Respecify buffer b with bytes of data, creating it and its texture on first use. A texture
+   buffer may not be empty, so an empty list uploads one zero. */
+static void Upload(int b, const void *data, size_t bytes){
+  static const GLuint zero[4] = {0, 0, 0, 0};
+  if(!buffers[b]){
+    glGenBuffers(1, &buffers[b]);
+    glGenTextures(1, &textures[b]);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers[b]);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(zero), zero, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, textures[b]);
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[b], buffers[b]);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+  }
+  if(!bytes){
+    data = zero;
+    bytes = sizeof(zero);
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, buffers[b]);
+  glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STREAM_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  framestats.bytesuploaded += bytes;
+}
+
+LightClusterStats BuildLightClusters(const std::vector<PointLight> &lights, const glm::mat4 &view, const glm::mat4 &projection){
+  PROFILE_ZONE("BuildLightClusters");
+  LightClusterStats stats = {0, 0, 0, 0};
+  /* A perspective projection keeps near and far in its third and fourth columns */
+  float a = projection[2][2], b = projection[3][2];
+  float znear = b / (a - 1), zfar = b / (a + 1);
+  float P00 = projection[0][0], P11 = projection[1][1];
+  clusternear = znear;
+  slicescale = CLUSTER_SLICES / logf(zfar / znear);
+
+  size_t n = lights.size();
+  viewlights.resize(n * 2);
+  firstslice.resize(n);
+  lastslice.resize(n);
+  ParallelFor(n, 1024, [&](size_t begin, size_t end){
+    for(size_t i = begin; i<end; i++){
+      const PointLight &light = lights[i];
+      glm::vec4 p = view * glm::vec4(light.position, 1.0f);
+      viewlights[i * 2] = glm::vec4(p.x, p.y, p.z, light.range);
+      viewlights[i * 2 + 1] = glm::vec4(light.colour, 0.0f);
+      float dmin = -p.z - light.range, dmax = -p.z + light.range;
+      if(dmax < znear || dmin > zfar){
+        firstslice[i] = 1;
+        lastslice[i] = 0;
+        continue;
+      }
+      firstslice[i] = dmin <= znear ? 0 : std::min(CLUSTER_SLICES - 1, (int)(logf(dmin / znear) * slicescale));
+      lastslice[i] = dmax >= zfar ? CLUSTER_SLICES - 1 : std::min(CLUSTER_SLICES - 1, (int)(logf(dmax / znear) * slicescale));
+    }
+  });
+  ParallelFor(CLUSTER_SLICES, 1, [=](size_t begin, size_t end){
+    for(size_t s = begin; s<end; s++)
+      BuildSlice(s, P00, P11);
+  });
+
+  /* Join the slices in order, moving each slice's offsets past the ones before it */
+  table.resize(CLUSTER_COUNT * 2);
+  indices.clear();
+  reached.assign(n, false);
+  for(int s = 0; s<CLUSTER_SLICES; s++){
+    GLuint base = indices.size();
+    const std::vector<GLuint> &t = slicetables[s];
+    for(int c = 0; c<SLICE_CLUSTERS; c++){
+      table[(s * SLICE_CLUSTERS + c) * 2] = base + t[c * 2];
+      table[(s * SLICE_CLUSTERS + c) * 2 + 1] = t[c * 2 + 1];
+      stats.occupied += t[c * 2 + 1] > 0;
+      stats.maxlights = std::max(stats.maxlights, t[c * 2 + 1]);
+    }
+    indices.insert(indices.end(), sliceindices[s].begin(), sliceindices[s].end());
+  }
+  for(size_t i = 0; i<indices.size(); i++)
+    if(!reached[indices[i]]){
+      reached[indices[i]] = true;
+      stats.lights++;
+    }
+  stats.references = indices.size();
+
+  Upload(CLUSTER_TABLE, table.data(), table.size() * sizeof(GLuint));
+  Upload(CLUSTER_INDICES, indices.data(), indices.size() * sizeof(GLuint));
+  Upload(CLUSTER_LIGHTS, viewlights.data(), viewlights.size() * sizeof(glm::vec4));
+  return stats;
+}
+
+void BindLightClusters(const ShaderProgram *program, int alllights){
+  static const Uniform samplers[CLUSTER_BUFFERS] = {UNIFORM_CLUSTERS, UNIFORM_LIGHTINDICES, UNIFORM_LIGHTS};
+  for(int b = 0; b<CLUSTER_BUFFERS; b++){
+    glActiveTexture(GL_TEXTURE0 + b);
+    glBindTexture(GL_TEXTURE_BUFFER, textures[b]);
+    glUniform1i(program->uniforms[samplers[b]], b);
+  }
+  glActiveTexture(GL_TEXTURE0);
+  glUniform3f(program->uniforms[UNIFORM_CLUSTERGRID], CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES);
+  glUniform2f(program->uniforms[UNIFORM_CLUSTERDEPTH], clusternear, slicescale);
+  glUniform1i(program->uniforms[UNIFORM_ALLLIGHTS], alllights);
+}
+
+void ReleaseLightClusters(){
+  for(int b = 0; b<CLUSTER_BUFFERS; b++)
+    if(buffers[b]){
+      glDeleteTextures(1, &textures[b]);
+      glDeleteBuffers(1, &buffers[b]);
+      textures[b] = buffers[b] = 0;
+    }
+}
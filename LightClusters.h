@@ -0,0 +1,46 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+/*
+   Clustered forward lighting. The view frustum is cut into CLUSTER_TILES_X x CLUSTER_TILES_Y
+   screen tiles and CLUSTER_SLICES depth slices, spaced exponentially so that a cluster is about
+   as deep as it is wide from the near plane to the far one. Every frame the CPU finds the
+   clusters each point light's sphere of influence touches, one depth slice per job on the
+   thread pool, and uploads three texture buffers: each cluster's run in a light index list, the
+   list itself, and the lights in view space. clustered.frag finds its fragment's cluster and
+   loops over that cluster's lights only, so what a pixel costs depends on the lights near it
+   rather than on how many there are.
+
+   Texture buffers rather than shader storage buffers keep this within GL 4.1, and so OS X.
+ */
+#include <vector>
+#include <glm/glm.hpp>
+#include "ShaderCache.h"
+
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 12
+#define CLUSTER_SLICES 24
+#define CLUSTER_COUNT (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+
+struct PointLight {
+  glm::vec3 position;  /* World space */
+  float range;         /* Distance at which its light has fallen to nothing */
+  glm::vec3 colour;
+};
+
+struct LightClusterStats {
+  unsigned lights;      /* Lights that reached at least one cluster */
+  unsigned references;  /* Entries in the light index list */
+  unsigned occupied;    /* Clusters with at least one light */
+  unsigned maxlights;   /* Most lights in one cluster */
+};
+
+/* Assign lights to the clusters of the frustum of projection, which must be a symmetric
+   perspective projection, seen through view, and upload the result */
+LightClusterStats BuildLightClusters(const std::vector<PointLight> &lights, const glm::mat4 &view, const glm::mat4 &projection);
+/* Bind the texture buffers to units 0 to 2 and set the cluster uniforms of program. With
+   alllights above 0 the shader loops over that many lights instead of a cluster's, which is the
+   unclustered baseline. */
+void BindLightClusters(const ShaderProgram *program, int alllights);
+void ReleaseLightClusters();
+
+#endif
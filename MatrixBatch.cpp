@@ -0,0 +1,112 @@
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#include "MatrixBatch.h"
+
+/* Column j of a * b is the columns of a weighted by column j of b, summed left to right as glm
+   does. Either side's columns or weights can be loaded once for a whole run. */
+#if defined(__AVX__) || defined(__SSE2__)
+typedef __m128 Column;
+static inline Column Load(const float *p){ return _mm_loadu_ps(p); }
+static inline Column Splat(float x){ return _mm_set1_ps(x); }
+static inline Column Weigh(const Column a[4], const Column w[4]){
+  Column r = _mm_add_ps(_mm_mul_ps(a[0], w[0]), _mm_mul_ps(a[1], w[1]));
+  r = _mm_add_ps(r, _mm_mul_ps(a[2], w[2]));
+  return _mm_add_ps(r, _mm_mul_ps(a[3], w[3]));
+}
+static inline void Store(float *p, Column c){ _mm_storeu_ps(p, c); }
+static inline void Transpose(Column r[4]){ _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]); }
+#elif defined(__aarch64__)
+typedef float32x4_t Column;
+static inline Column Load(const float *p){ return vld1q_f32(p); }
+static inline Column Splat(float x){ return vdupq_n_f32(x); }
+static inline Column Weigh(const Column a[4], const Column w[4]){
+  /* Separate multiplies and adds rather than vfmaq, to round the way glm does */
+  Column r = vaddq_f32(vmulq_f32(a[0], w[0]), vmulq_f32(a[1], w[1]));
+  r = vaddq_f32(r, vmulq_f32(a[2], w[2]));
+  return vaddq_f32(r, vmulq_f32(a[3], w[3]));
+}
+static inline void Store(float *p, Column c){ vst1q_f32(p, c); }
+static inline void Transpose(Column r[4]){
+  float32x4x2_t t0 = vtrnq_f32(r[0], r[1]), t1 = vtrnq_f32(r[2], r[3]);
+  r[0] = vcombine_f32(vget_low_f32(t0.val[0]), vget_low_f32(t1.val[0]));
+  r[1] = vcombine_f32(vget_low_f32(t0.val[1]), vget_low_f32(t1.val[1]));
+  r[2] = vcombine_f32(vget_high_f32(t0.val[0]), vget_high_f32(t1.val[0]));
+  r[3] = vcombine_f32(vget_high_f32(t0.val[1]), vget_high_f32(t1.val[1]));
+}
+#endif
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(__aarch64__)
+/* Four matrices a stride of floats apart into lanes: lanes[4 * j + k] holds element k of column
+   j of each, one matrix per lane */
+static inline void LoadLanes(const float *p, size_t stride, Column lanes[16]){
+  for(int j = 0; j<4; j++){
+    Column *r = lanes + 4 * j;
+    for(int m = 0; m<4; m++)
+      r[m] = Load(p + m * stride + 4 * j);
+    Transpose(r);
+  }
+}
+
+/* And back out to four consecutive matrices */
+static inline void StoreLanes(float *p, const Column lanes[16]){
+  for(int j = 0; j<4; j++){
+    Column r[4] = {lanes[4 * j], lanes[4 * j + 1], lanes[4 * j + 2], lanes[4 * j + 3]};
+    Transpose(r);
+    for(int m = 0; m<4; m++)
+      Store(p + 16 * m + 4 * j, r[m]);
+  }
+}
+#endif
+
+void MultiplyMatrices(const glm::mat4 *a, size_t astep, const glm::mat4 *b, size_t bstep, glm::mat4 *out, size_t count){
+#if defined(__AVX__) || defined(__SSE2__) || defined(__aarch64__)
+  const float *pa = &a[0][0][0], *pb = &b[0][0][0];
+  float *po = &out[0][0][0];
+  Column columns[4], weights[4][4];
+  if(!bstep){ /* A run of matrices times one transform: its sixteen weights are splatted once */
+    for(int j = 0; j<4; j++)
+      for(int k = 0; k<4; k++)
+        weights[j][k] = Splat(pb[4 * j + k]);
+    for(size_t i = 0; i<count; i++, pa += 16 * astep, po += 16){
+      for(int k = 0; k<4; k++)
+        columns[k] = Load(pa + 4 * k);
+      for(int j = 0; j<4; j++)
+        Store(po + 4 * j, Weigh(columns, weights[j]));
+    }
+    return;
+  }
+  /* Otherwise four products at once, one per lane, so b's weights need no splatting. A shared a,
+     a parent or the view-projection, is splatted once for the whole run. */
+  Column as[16], bs[16], os[16];
+  if(!astep)
+    for(int e = 0; e<16; e++)
+      as[e] = Splat(pa[e]);
+  size_t i = 0;
+  for(; i + 4 <= count; i += 4, pa += 64 * astep, pb += 64 * bstep, po += 64){
+    if(astep)
+      LoadLanes(pa, 16 * astep, as);
+    LoadLanes(pb, 16 * bstep, bs);
+    for(int j = 0; j<4; j++)
+      for(int r = 0; r<4; r++){
+        Column terms[4] = {as[r], as[4 + r], as[8 + r], as[12 + r]};
+        os[4 * j + r] = Weigh(terms, bs + 4 * j);
+      }
+    StoreLanes(po, os);
+  }
+  for(; i<count; i++, pa += 16 * astep, pb += 16 * bstep, po += 16){ /* The last few a matrix at a time */
+    for(int k = 0; k<4; k++)
+      columns[k] = Load(pa + 4 * k);
+    for(int j = 0; j<4; j++){
+      for(int k = 0; k<4; k++)
+        weights[0][k] = Splat(pb[4 * j + k]);
+      Store(po + 4 * j, Weigh(columns, weights[0]));
+    }
+  }
+#else
+  for(size_t i = 0; i<count; i++)
+    out[i] = a[i * astep] * b[i * bstep];
+#endif
+}
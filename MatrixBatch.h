@@ -0,0 +1,23 @@
+#ifndef MATRIXBATCH_H
+#define MATRIXBATCH_H
+/*
+   Batched 4x4 matrix products for the scene's transform work. Almost every product there has
+   one side shared by a run of matrices (a parent's world matrix, the view-projection, a rocket's
+   spin), so rather than one glm product per object the run goes through a single call that
+   loads the shared side into SSE2 or NEON registers once. Runs with a shared right side compose
+   each matrix a column of four floats per instruction; the rest transpose four matrices into the
+   four lanes and compose all four together, an element per instruction. The sums run in the
+   same order as glm's operator*, so the results are the same bits as the scalar code.
+ */
+#include <stddef.h>
+#include <glm/glm.hpp>
+
+/* Matrices gathered into a local array per call by code whose matrices are not contiguous */
+#define MATRIX_BATCH 8
+
+/* out[i] = a[i * astep] * b[i * bstep] for i in [0, count). A step of 0 repeats the same matrix.
+   out must not overlap a or b.
+ */
+void MultiplyMatrices(const glm::mat4 *a, size_t astep, const glm::mat4 *b, size_t bstep, glm::mat4 *out, size_t count);
+
+#endif
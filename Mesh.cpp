@@ -0,0 +1,932 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include "Mesh.h"
+#include "AsyncLoader.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include "MeshFile.h"
+#include "GeometryArena.h"
+#include "MeshOptimise.h"
+
+struct MeshKey {
+  MeshGenerator generator;
+  int param;
+  bool operator<(const MeshKey &o) const {
+    if(generator != o.generator)
+      return generator < o.generator;
+    return param < o.param;
+  }
+};
+
+/* std::map never moves its elements, so the Mesh pointers handed out stay valid */
+static std::map<MeshKey, Mesh> meshes;
+static MeshRegistryStats stats;
+static VertexFormat vertexformat = VERTEX_FORMAT_COMPACT;
+static bool upload = true;
+static bool meshfiles = true;
+static bool arenas = true;
+static bool optimise = true, strips = false;
+/* Shared by every arena: the instance matrices and indirect commands of the current draw */
+static GLuint instancebuffer, indirectbuffer;
+
+/* Files mapped ahead of GetMesh by PrefetchMeshFile, by path */
+struct PrefetchedMesh {
+  MappedMeshFile file;
+  bool done, ok;  /* done is set on the render thread once the loader has finished */
+};
+static std::map<std::string, PrefetchedMesh *> prefetched;
+/* Meshes generated ahead of GetMesh by PrepareMeshChain, until it takes them */
+static std::map<MeshKey, MeshData *> prepared;
+
+void SetMeshUpload(bool enable){
+  upload = enable;
+}
+
+void SetMeshFiles(bool enable){
+  meshfiles = enable;
+}
+
+void SetMeshArenas(bool enable){
+  arenas = enable;
+}
+
+void SetMeshOptimisation(bool enable, bool asstrips){
+  optimise = enable;
+  strips = enable && asstrips;
+}
+
+/* MeshFileHeader::processing of the meshes GetMesh builds now */
+static uint32_t Processing(){
+  return (optimise ? MESH_PROCESSING_OPTIMISED : 0) | (strips ? MESH_PROCESSING_STRIPS : 0);
+}
+
+/* Run the generator and the optimisation pass over its output */
+static void GenerateMesh(const char *name, MeshGenerator generator, int param, MeshData *data){
+  generator(param, data);
+  if(optimise)
+    OptimiseMesh(name, param, data, strips);
+}
+
+static bool ArenasSupported(){
+#ifdef __APPLE__
+  return false;
+#else
+  return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+#endif
+}
+
+static GLuint InstanceBuffer(){
+  static const GLfloat identity[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
+  if(!instancebuffer){
+    glGenBuffers(1, &instancebuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instancebuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(identity), identity, GL_STREAM_DRAW);
+  }
+  return instancebuffer;
+}
+
+void SetVertexFormat(VertexFormat format){
+  vertexformat = format;
+}
+
+/* IEEE half float, rounded to nearest even. Values too large for a half become infinity. */
+static GLushort FloatToHalf(GLfloat value){
+  unsigned int f;
+  memcpy(&f, &value, sizeof(f));
+  unsigned int sign = (f >> 16) & 0x8000, exponent = (f >> 23) & 0xff, mantissa = f & 0x7fffff;
+  if(exponent == 0xff)    /* Infinity or NaN */
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  int e = (int)exponent - 127 + 15;
+  if(e >= 31)
+    return sign | 0x7c00;
+  if(e <= 0){             /* Subnormal half, or zero */
+    if(e < -10)
+      return sign;
+    mantissa |= 0x800000;
+    unsigned int shift = 14 - e;
+    unsigned int half = mantissa >> shift, rest = mantissa & ((1u << shift) - 1), midpoint = 1u << (shift - 1);
+    if(rest > midpoint || (rest == midpoint && (half & 1)))
+      half++;
+    return sign | half;
+  }
+  unsigned int half = (e << 10) | (mantissa >> 13), rest = mantissa & 0x1fff;
+  if(rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    half++;               /* A carry into the exponent still gives the right result */
+  return sign | half;
+}
+
+static GLshort FloatToSnorm16(GLfloat value){
+  if(value > 1) value = 1;
+  if(value < -1) value = -1;
+  return (GLshort)lrintf(value * 32767.0f);
+}
+
+/* Octahedral encoding: project the unit normal onto the octahedron |x|+|y|+|z| = 1 and fold the
+   lower half over the upper, giving two values in [-1, 1] */
+static void OctEncode(const GLfloat *n, GLshort out[2]){
+  GLfloat l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+  GLfloat x = l1 > 0 ? n[0] / l1 : 0, y = l1 > 0 ? n[1] / l1 : 0;
+  if(n[2] < 0){
+    GLfloat fx = (1 - fabsf(y)) * (x >= 0 ? 1 : -1);
+    GLfloat fy = (1 - fabsf(x)) * (y >= 0 ? 1 : -1);
+    x = fx;
+    y = fy;
+  }
+  out[0] = FloatToSnorm16(x);
+  out[1] = FloatToSnorm16(y);
+}
+
+VertexLayout ChooseVertexLayout(const MeshData &data){
+  VertexLayout layout;
+  VertexAttribute position = {0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position)};
+  VertexAttribute color = {1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, color)};
+  memset(&layout, 0, sizeof(layout));
+  if(vertexformat == VERTEX_FORMAT_FLOAT){
+    layout.attributes[0] = position;
+    layout.attributes[1] = color;
+    layout.count = 2;
+    layout.stride = sizeof(Vertex);
+    return layout;
+  }
+
+  bool unit = true, samecolor = true;
+  for(size_t i = 0; i<data.vertices.size(); i++){
+    const Vertex &v = data.vertices[i];
+    for(int k = 0; k<3; k++){
+      if(fabsf(v.position[k]) > 1)
+        unit = false;
+      if(v.color[k] != data.vertices[0].color[k])
+        samecolor = false;
+    }
+  }
+  /* Positions take 8 bytes either way: three 16-bit values padded to keep 4-byte alignment */
+  position.type = unit ? GL_SHORT : GL_HALF_FLOAT;
+  position.normalized = unit;
+  position.offset = 0;
+  layout.attributes[layout.count++] = position;
+  layout.stride = 8;
+  if(samecolor && !data.vertices.empty()){
+    layout.constantcolor = true;
+    memcpy(layout.color, data.vertices[0].color, sizeof(layout.color));
+  } else {
+    color.size = 4;
+    color.type = GL_UNSIGNED_BYTE;
+    color.normalized = GL_TRUE;
+    color.offset = layout.stride;
+    layout.attributes[layout.count++] = color;
+    layout.stride += 4;
+  }
+  if(!data.normals.empty()){
+    VertexAttribute normal = {NORMAL_ATTRIBUTE, 2, GL_SHORT, GL_TRUE, (GLuint)layout.stride};
+    layout.attributes[layout.count++] = normal;
+    layout.normals = true;
+    layout.stride += 4;
+  }
+  return layout;
+}
+
+void EncodeVertices(const MeshData &data, const VertexLayout &layout, std::vector<unsigned char> &out){
+  size_t n = data.vertices.size();
+  out.assign(n * layout.stride, 0);
+  if(vertexformat == VERTEX_FORMAT_FLOAT && layout.stride == sizeof(Vertex)){
+    memcpy(out.data(), data.vertices.data(), out.size());
+    return;
+  }
+  for(size_t i = 0; i<n; i++){
+    const Vertex &v = data.vertices[i];
+    unsigned char *dst = &out[i * layout.stride];
+    for(int a = 0; a<layout.count; a++){
+      const VertexAttribute &attribute = layout.attributes[a];
+      unsigned char *p = dst + attribute.offset;
+      if(attribute.index == 0){
+        GLushort q[3];
+        for(int k = 0; k<3; k++)
+          q[k] = attribute.type == GL_SHORT ? (GLushort)FloatToSnorm16(v.position[k]) : FloatToHalf(v.position[k]);
+        memcpy(p, q, sizeof(q));
+      } else if(attribute.index == 1){
+        for(int k = 0; k<3; k++){
+          GLfloat c = v.color[k] < 0 ? 0 : (v.color[k] > 1 ? 1 : v.color[k]);
+          p[k] = (unsigned char)lrintf(c * 255.0f);
+        }
+        p[3] = 255;
+      } else if(attribute.index == NORMAL_ATTRIBUTE){
+        GLshort q[2];
+        OctEncode(&data.normals[i * 3], q);
+        memcpy(p, q, sizeof(q));
+      }
+    }
+  }
+}
+
+void ApplyVertexLayout(const VertexLayout &layout){
+  for(int a = 0; a<layout.count; a++){
+    const VertexAttribute &attribute = layout.attributes[a];
+    glVertexAttribPointer(attribute.index, attribute.size, attribute.type, attribute.normalized, layout.stride,
+                          (const GLvoid*)(size_t)attribute.offset);
+    glEnableVertexAttribArray(attribute.index);
+  }
+}
+
+/* Generic attribute values are context state rather than VAO state, so a mesh without a colour
+   or normal array sets them again before every draw. A normal of (0, 0, 1) in the shaders means
+   "use the position", which is exact for the unit sphere. */
+static void SetConstantAttributes(const Mesh *mesh){
+  if(mesh->layout.constantcolor)
+    glVertexAttrib3fv(1, mesh->layout.color);
+  if(!mesh->layout.normals)
+    glVertexAttrib3f(NORMAL_ATTRIBUTE, 0, 0, 1);
+}
+
+/* Point *bytes at the index data to upload, narrowed to 16 bits in shortindices when every index
+   fits. Returns the index type to pass to glDrawElements, or 0 if the mesh is not indexed.
+ */
+static GLenum PackIndices(const MeshData &data, std::vector<GLushort> &shortindices, const void **indices, size_t *bytes){
+  if(data.indices.empty()){
+    *indices = NULL;
+    *bytes = 0;
+    return 0;
+  }
+  /* A strip's restart index is the largest the type holds, so no vertex may have it */
+  if(data.vertices.size() <= (data.primitive == GL_TRIANGLE_STRIP ? 65535u : 65536u)){
+    shortindices.assign(data.indices.begin(), data.indices.end());
+    *indices = shortindices.data();
+    *bytes = shortindices.size() * sizeof(GLushort);
+    return GL_UNSIGNED_SHORT;
+  }
+  *indices = data.indices.data();
+  *bytes = data.indices.size() * sizeof(GLuint);
+  return GL_UNSIGNED_INT;
+}
+
+/* Triangles one draw of count elements submits; patches count as triangles. A strip is counted
+   run by run when indices holds restart indices. */
+static GLsizei CountTriangles(GLenum primitive, GLenum indextype, const void *indices, GLsizei count){
+  if(primitive == GL_TRIANGLES || primitive == GL_PATCHES)
+    return count / 3;
+  if(primitive == GL_TRIANGLE_FAN || (primitive == GL_TRIANGLE_STRIP && !indextype))
+    return count > 2 ? count - 2 : 0;
+  if(primitive != GL_TRIANGLE_STRIP)
+    return 0;
+  GLsizei triangles = 0, run = 0;
+  for(GLsizei i = 0; i<=count; i++){
+    bool restart = i == count;
+    if(!restart)
+      restart = indextype == GL_UNSIGNED_SHORT ? ((const GLushort *)indices)[i] == 0xffff
+                                               : ((const GLuint *)indices)[i] == MESH_RESTART_INDEX;
+    if(!restart){
+      run++;
+      continue;
+    }
+    triangles += run > 2 ? run - 2 : 0;
+    run = 0;
+  }
+  return triangles;
+}
+
+/* Create the mesh's GL objects from encoded vertex and packed index blocks. Fills in everything
+   but the name and bounds. */
+static Mesh UploadBlocks(GLenum primitive, GLsizei vertexcount, GLsizei count, const VertexLayout &layout,
+                         const void *vertices, size_t vertexbytes, GLenum indextype, const void *indices, size_t indexbytes){
+  Mesh mesh;
+  mesh.primitive = primitive;
+  mesh.vertexcount = vertexcount;
+  mesh.count = count;
+  mesh.triangles = CountTriangles(primitive, indextype, indices, count);
+  mesh.layout = layout;
+  mesh.ibo = 0;
+  mesh.indextype = indextype;
+  mesh.data = NULL;
+  mesh.bytes = vertexbytes + indexbytes;
+
+  if(arenas && ArenasSupported()){
+    mesh.arena = GetGeometryArena(layout, indextype, InstanceBuffer());
+    mesh.allocation = ArenaAdd(mesh.arena, vertices, vertexcount, indices, indextype ? count : 0);
+    mesh.vao = mesh.arena->vao;
+    mesh.vbo = mesh.instancevbo = 0;
+    return mesh;
+  }
+  mesh.arena = NULL;
+  mesh.allocation = -1;
+  glGenVertexArrays(1, &mesh.vao);
+  glBindVertexArray(mesh.vao);
+  /* Allocate and assign One Vertex Buffer Object to our handle */
+  glGenBuffers(1, &mesh.vbo);
+  /* Bind our VBO as being the active buffer and storing vertex attributes (coordinates + colors) */
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+  glBufferData ( GL_ARRAY_BUFFER, vertexbytes, vertices, GL_STATIC_DRAW );
+  /* Position goes to attribute index 0, colour (unless constant) to 1 and normals to NORMAL_ATTRIBUTE */
+  ApplyVertexLayout(mesh.layout);
+  if(indextype){
+    /* The element array binding is part of the VAO state, so bind the index buffer while the VAO is bound */
+    glGenBuffers(1, &mesh.ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexbytes, indices, GL_STATIC_DRAW);
+  }
+
+  /* Per-instance model matrix for the instanced shaders. A mat4 attribute is four vec4 columns,
+     each advancing once per instance. It starts as one identity matrix so the VAO is always valid. */
+  static const GLfloat identity[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
+  glGenBuffers(1, &mesh.instancevbo);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.instancevbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(identity), identity, GL_STREAM_DRAW);
+  for(int i = 0; i<4; i++){
+    glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(identity), (const GLvoid*)(i * 4 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(2 + i);
+    glVertexAttribDivisor(2 + i, 1);
+  }
+  glBindVertexArray(0);
+  return mesh;
+}
+
+static Mesh UploadMesh(const MeshData &data){
+  std::vector<unsigned char> vertices;
+  std::vector<GLushort> shortindices;
+  const void *indices;
+  size_t indexbytes;
+  VertexLayout layout = ChooseVertexLayout(data);
+  EncodeVertices(data, layout, vertices);
+  GLenum indextype = PackIndices(data, shortindices, &indices, &indexbytes);
+  return UploadBlocks(data.primitive, data.vertices.size(), indextype ? data.indices.size() : data.vertices.size(), layout,
+                      vertices.data(), vertices.size(), indextype, indices, indexbytes);
+}
+
+/* Touch every page of the mapping now, so the upload does not wait on the disk */
+static void FaultIn(const MappedMeshFile &file){
+  volatile unsigned char sum = 0;
+  for(size_t i = 0; i<file.size; i += 4096)
+    sum += ((const unsigned char *)file.base)[i];
+}
+
+/* Whether a mapped file is the mesh name(param) as GetMesh would build it now: written for the
+   current vertex format and optimisation settings */
+static bool MeshFileMatches(const MappedMeshFile &file, const char *name, int param){
+  const MeshFileHeader &h = *file.header;
+  return !strncmp(h.name, name, sizeof(h.name)) && h.param == param && h.vertexformat == (uint32_t)vertexformat &&
+         h.processing == Processing();
+}
+
+void PrefetchMeshFile(const char *name, int param){
+  char path[256];
+  if(!upload || !meshfiles)
+    return;
+  MeshFilePath(name, param, path, sizeof(path));
+  if(prefetched.count(path))
+    return;
+  PrefetchedMesh *p = new PrefetchedMesh;
+  p->done = p->ok = false;
+  prefetched[path] = p;
+  std::string file = path;
+  RunAsync([p, file]{
+    p->ok = MapMeshFile(file.c_str(), &p->file);
+    if(p->ok)
+      FaultIn(p->file);
+  }, [p]{ p->done = true; });
+}
+
+/* Take the prefetched mapping of path, waiting for it if the loader is still reading it */
+static bool TakePrefetched(const char *path, MappedMeshFile *file, bool *ok){
+  std::map<std::string, PrefetchedMesh *>::iterator it = prefetched.find(path);
+  if(it == prefetched.end())
+    return false;
+  PrefetchedMesh *p = it->second;
+  while(!p->done){
+    PollAsyncLoads();
+    std::this_thread::yield();
+  }
+  *file = p->file;
+  *ok = p->ok;
+  prefetched.erase(it);
+  delete p;
+  return true;
+}
+
+/* Upload the baked file of name(param) if there is one that matches the current vertex format and
+   optimisation settings */
+static bool LoadMeshFile(const char *name, int param, Mesh *mesh){
+  char path[256];
+  MappedMeshFile file;
+  bool ok;
+  MeshFilePath(name, param, path, sizeof(path));
+  if(!TakePrefetched(path, &file, &ok))
+    ok = MapMeshFile(path, &file);
+  if(!ok)
+    return false;
+  if(!MeshFileMatches(file, name, param)){
+    printf("Ignoring stale %s\n", path);
+    UnmapMeshFile(&file);
+    return false;
+  }
+  const MeshFileHeader &h = *file.header;
+  VertexLayout layout;
+  memset(&layout, 0, sizeof(layout));
+  layout.count = h.attributecount;
+  layout.stride = h.stride;
+  layout.constantcolor = h.constantcolor != 0;
+  layout.normals = h.normals != 0;
+  memcpy(layout.color, h.color, sizeof(layout.color));
+  for(int i = 0; i<layout.count; i++){
+    VertexAttribute &a = layout.attributes[i];
+    a.index = h.attributes[i].index;
+    a.size = h.attributes[i].size;
+    a.type = h.attributes[i].type;
+    a.normalized = h.attributes[i].normalized;
+    a.offset = h.attributes[i].offset;
+  }
+  /* The mapped blocks go to the GL as they are; nothing is parsed or copied on the way */
+  *mesh = UploadBlocks(h.primitive, h.vertexcount, h.count, layout, file.vertices, h.vertexbytes,
+                       h.indextype, file.indices, h.indexbytes);
+  memcpy(mesh->bounds, h.bounds, sizeof(mesh->bounds));
+  UnmapMeshFile(&file);
+  return true;
+}
+
+static double Seconds(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Sphere centred on the bounding box, with the radius to the farthest vertex */
+static void MeshBounds(const MeshData &data, GLfloat bounds[4]){
+  GLfloat lo[3] = {0, 0, 0}, hi[3] = {0, 0, 0}, radius = 0;
+  for(size_t i = 0; i<data.vertices.size(); i++)
+    for(int k = 0; k<3; k++){
+      GLfloat v = data.vertices[i].position[k];
+      lo[k] = i == 0 || v < lo[k] ? v : lo[k];
+      hi[k] = i == 0 || v > hi[k] ? v : hi[k];
+    }
+  for(int k = 0; k<3; k++)
+    bounds[k] = (lo[k] + hi[k]) / 2;
+  for(size_t i = 0; i<data.vertices.size(); i++){
+    const GLfloat *p = data.vertices[i].position;
+    GLfloat dx = p[0] - bounds[0], dy = p[1] - bounds[1], dz = p[2] - bounds[2];
+    radius = std::max(radius, dx * dx + dy * dy + dz * dz);
+  }
+  bounds[3] = sqrtf(radius);
+}
+
+bool BakeMesh(const char *name, MeshGenerator generator, int param){
+  MeshData data;
+  GenerateMesh(name, generator, param, &data);
+  std::vector<unsigned char> vertices;
+  std::vector<GLushort> shortindices;
+  const void *indices;
+  size_t indexbytes;
+  VertexLayout layout = ChooseVertexLayout(data);
+  EncodeVertices(data, layout, vertices);
+  GLenum indextype = PackIndices(data, shortindices, &indices, &indexbytes);
+
+  MeshFileHeader h;
+  memset(&h, 0, sizeof(h));
+  strncpy(h.name, name, sizeof(h.name) - 1);
+  h.param = param;
+  h.vertexformat = vertexformat;
+  h.processing = Processing();
+  h.primitive = data.primitive;
+  h.vertexcount = data.vertices.size();
+  h.count = indextype ? data.indices.size() : data.vertices.size();
+  h.indextype = indextype;
+  h.attributecount = layout.count;
+  h.stride = layout.stride;
+  h.constantcolor = layout.constantcolor;
+  h.normals = layout.normals;
+  memcpy(h.color, layout.color, sizeof(h.color));
+  for(int i = 0; i<layout.count; i++){
+    const VertexAttribute &a = layout.attributes[i];
+    MeshFileAttribute attribute = {a.index, (uint32_t)a.size, a.type, a.normalized, a.offset};
+    h.attributes[i] = attribute;
+  }
+  MeshBounds(data, h.bounds);
+  h.vertexbytes = vertices.size();
+  h.indexbytes = indexbytes;
+
+  char path[256];
+  MeshFilePath(name, param, path, sizeof(path));
+  if(!WriteMeshFile(path, h, vertices.data(), indices))
+    return false;
+  printf("Baked %s: %d vertices, %d bytes\n", path, (int)h.vertexcount, (int)(vertices.size() + indexbytes));
+  return true;
+}
+
+/* The registered mesh of key, or its baked file uploaded now. NULL when it has to be generated. */
+static const Mesh *LookupMesh(const char *name, const MeshKey &key){
+  std::map<MeshKey, Mesh>::iterator it = meshes.find(key);
+  if(it != meshes.end()){
+    stats.hits++;
+    return &it->second;
+  }
+  stats.misses++;
+  Mesh loaded;
+  double start = Seconds();
+  if(!upload || !meshfiles || !LoadMeshFile(name, key.param, &loaded))
+    return NULL;
+  Mesh &mesh = meshes[key] = loaded;
+  mesh.name = name;
+  stats.bytesresident += mesh.bytes;
+  stats.meshes++;
+  printf("Loaded mesh %s(%d) from %s: %d vertices, %d bytes in %.2f ms\n", name, key.param, MESH_DIRECTORY,
+         mesh.vertexcount, (int)mesh.bytes, (Seconds() - start) * 1000);
+  return &mesh;
+}
+
+/* Register data, generated since start, as the mesh of key: uploaded, or kept on the CPU */
+static const Mesh *AddMesh(const char *name, const MeshKey &key, const MeshData &data, double start){
+  Mesh &mesh = meshes[key];
+  int param = key.param;
+  if(!upload){
+    memset(&mesh, 0, sizeof(mesh));
+    mesh.name = name;
+    mesh.primitive = data.primitive;
+    mesh.vertexcount = data.vertices.size();
+    mesh.count = data.indices.empty() ? data.vertices.size() : data.indices.size();
+    mesh.triangles = CountTriangles(data.primitive, data.indices.empty() ? 0 : GL_UNSIGNED_INT, data.indices.data(), mesh.count);
+    mesh.data = new MeshData(data);
+    MeshBounds(data, mesh.bounds);
+    stats.meshes++;
+    printf("Built mesh %s(%d) on the CPU: %d vertices, %d %s\n", name, param, mesh.vertexcount, mesh.count,
+           data.indices.empty() ? "array elements" : "indices");
+    return &mesh;
+  }
+  mesh = UploadMesh(data);
+  mesh.name = name;
+  MeshBounds(data, mesh.bounds);
+  stats.bytesresident += mesh.bytes;
+  stats.meshes++;
+  printf("Built mesh %s(%d): %d vertices, %d %s, %d bytes, %d bytes/vertex (%d as float) in %.2f ms\n", name, param,
+         mesh.vertexcount, mesh.count, mesh.indextype ? "indices" : "array elements", (int)mesh.bytes,
+         (int)mesh.layout.stride, (int)sizeof(Vertex), (Seconds() - start) * 1000);
+  return &mesh;
+}
+
+/* Take the mesh PrepareMeshChain generated for key, if there is one */
+static bool TakePrepared(const MeshKey &key, MeshData *data){
+  std::map<MeshKey, MeshData *>::iterator it = prepared.find(key);
+  if(it == prepared.end())
+    return false;
+  std::swap(*data, *it->second);
+  delete it->second;
+  prepared.erase(it);
+  return true;
+}
+
+const Mesh *GetMesh(const char *name, MeshGenerator generator, int param){
+  MeshKey key = {generator, param};
+  const Mesh *mesh = LookupMesh(name, key);
+  if(mesh)
+    return mesh;
+  double start = Seconds();
+  MeshData data;
+  if(!TakePrepared(key, &data))
+    GenerateMesh(name, generator, param, &data);
+  return AddMesh(name, key, data, start);
+}
+
+void GetMeshChain(const char *name, MeshGenerator generator, MeshChainGenerator chain, const int *params, int count,
+                  const Mesh **out){
+  std::vector<int> missing, wanted;
+  for(int i = 0; i<count; i++){
+    MeshKey key = {generator, params[i]};
+    out[i] = LookupMesh(name, key);
+    if(out[i])
+      continue;
+    MeshData data;
+    double start = Seconds();
+    if(TakePrepared(key, &data))
+      out[i] = AddMesh(name, key, data, start);
+    else {
+      missing.push_back(i);
+      wanted.push_back(params[i]);
+    }
+  }
+  if(missing.empty())
+    return;
+  double start = Seconds();
+  std::vector<MeshData> data(missing.size());
+  if(chain){
+    chain(wanted.data(), wanted.size(), data.data());
+    if(optimise)
+      for(size_t m = 0; m<missing.size(); m++)
+        OptimiseMesh(name, wanted[m], &data[m], strips);
+  }
+  for(size_t m = 0; m<missing.size(); m++){
+    MeshKey key = {generator, wanted[m]};
+    if(!chain){
+      start = Seconds();
+      GenerateMesh(name, generator, wanted[m], &data[m]);
+    }
+    out[missing[m]] = AddMesh(name, key, data[m], start);
+  }
+}
+
+/* The meshes of one PrepareMeshChain, shared by its two halves */
+struct PreparedChain {
+  const char *name;
+  MeshGenerator generator;
+  MeshChainGenerator chain;
+  std::vector<int> params;
+  std::vector<std::string> paths; /* Of their baked files, or empty when GetMesh would not use them */
+  std::vector<MeshData> data;
+  std::vector<bool> generated;
+  std::vector<MappedMeshFile> files;
+  std::vector<bool> mapped;       /* files[m] is a valid baked file, faulted in, for GetMesh to upload */
+};
+
+void PrepareMeshChain(const char *name, MeshGenerator generator, MeshChainGenerator chain, const int *params, int count,
+                      std::function<void()> done){
+  PreparedChain *p = new PreparedChain;
+  p->name = name;
+  p->generator = generator;
+  p->chain = chain;
+  for(int i = 0; i<count; i++){
+    MeshKey key = {generator, params[i]};
+    if(meshes.count(key) || prepared.count(key))
+      continue;
+    char path[256] = "";
+    if(upload && meshfiles)
+      MeshFilePath(name, params[i], path, sizeof(path));
+    p->params.push_back(params[i]);
+    p->paths.push_back(path);
+  }
+  RunAsync([p]{
+    /* A baked file is cheaper to upload than anything generated here, but only one LoadMeshFile
+       will accept; a missing, damaged or stale one is generated instead */
+    std::vector<int> wanted;
+    std::vector<size_t> slots;
+    p->files.resize(p->params.size());
+    p->mapped.assign(p->params.size(), false);
+    for(size_t m = 0; m<p->params.size(); m++){
+      MappedMeshFile &file = p->files[m];
+      if(!p->paths[m].empty() && MapMeshFile(p->paths[m].c_str(), &file)){
+        if(MeshFileMatches(file, p->name, p->params[m])){
+          FaultIn(file);
+          p->mapped[m] = true;
+          continue;
+        }
+        printf("Ignoring stale %s\n", p->paths[m].c_str());
+        UnmapMeshFile(&file);
+      }
+      wanted.push_back(p->params[m]);
+      slots.push_back(m);
+    }
+    p->data.resize(p->params.size());
+    p->generated.assign(p->params.size(), false);
+    std::vector<MeshData> data(wanted.size());
+    if(p->chain && !wanted.empty()){
+      p->chain(wanted.data(), wanted.size(), data.data());
+      if(optimise)
+        for(size_t m = 0; m<wanted.size(); m++)
+          OptimiseMesh(p->name, wanted[m], &data[m], strips);
+    } else
+      for(size_t m = 0; m<wanted.size(); m++)
+        GenerateMesh(p->name, p->generator, wanted[m], &data[m]);
+    for(size_t m = 0; m<wanted.size(); m++){
+      std::swap(p->data[slots[m]], data[m]);
+      p->generated[slots[m]] = true;
+    }
+  }, [p, done]{
+    for(size_t m = 0; m<p->params.size(); m++){
+      MeshKey key = {p->generator, p->params[m]};
+      if(p->generated[m] && !meshes.count(key) && !prepared.count(key)){
+        prepared[key] = new MeshData;
+        std::swap(*prepared[key], p->data[m]);
+      }
+      /* Hand the mapping on as a prefetch, which LoadMeshFile takes without touching the disk */
+      if(p->mapped[m]){
+        if(!meshes.count(key) && !prefetched.count(p->paths[m])){
+          PrefetchedMesh *f = new PrefetchedMesh;
+          f->file = p->files[m];
+          f->done = f->ok = true;
+          prefetched[p->paths[m]] = f;
+        } else
+          UnmapMeshFile(&p->files[m]);
+      }
+    }
+    delete p;
+    if(done)
+      done();
+  });
+}
+
+static GLsizeiptr IndexBytes(GLenum indextype){
+  return indextype == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+/* Strips separate their runs with the largest index of their index type. Restart stays off for
+   everything else, where that index can be a real vertex. */
+static void PrimitiveRestart(const Mesh *mesh, bool enable){
+  if(mesh->primitive != GL_TRIANGLE_STRIP || !mesh->indextype)
+    return;
+  if(!enable){
+    glDisable(GL_PRIMITIVE_RESTART);
+    return;
+  }
+  glEnable(GL_PRIMITIVE_RESTART);
+  glPrimitiveRestartIndex(mesh->indextype == GL_UNSIGNED_SHORT ? 0xffff : MESH_RESTART_INDEX);
+}
+
+void DrawMesh(const Mesh *mesh){
+  PROFILE_ZONE(mesh->name);
+  SetConstantAttributes(mesh);
+  PrimitiveRestart(mesh, true);
+  glBindVertexArray(mesh->vao);
+  if(mesh->arena){
+    const ArenaRange &r = mesh->arena->ranges[mesh->allocation];
+    if(mesh->indextype)
+      glDrawElementsBaseVertex(mesh->primitive, mesh->count, mesh->indextype,
+                               (const GLvoid*)(r.firstindex * IndexBytes(mesh->indextype)), r.firstvertex);
+    else
+      glDrawArrays(mesh->primitive, r.firstvertex, mesh->count);
+  } else if(mesh->indextype)
+    glDrawElements(mesh->primitive, mesh->count, mesh->indextype, 0);
+  else
+    glDrawArrays(mesh->primitive, 0, mesh->count);
+  glBindVertexArray(0);
+  PrimitiveRestart(mesh, false);
+  framestats.drawcalls++;
+  framestats.vertices += mesh->count;
+  framestats.triangles += mesh->triangles;
+}
+
+void DrawMeshInstanced(const Mesh *mesh, const GLfloat *models, GLsizei count){
+  PROFILE_ZONE(mesh->name);
+  SetConstantAttributes(mesh);
+  PrimitiveRestart(mesh, true);
+  glBindVertexArray(mesh->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh->arena ? instancebuffer : mesh->instancevbo);
+  /* Respecifying the whole store lets the driver orphan the old one instead of waiting on it */
+  glBufferData(GL_ARRAY_BUFFER, count * 16 * sizeof(GLfloat), models, GL_STREAM_DRAW);
+  if(mesh->arena){
+    const ArenaRange &r = mesh->arena->ranges[mesh->allocation];
+    if(mesh->indextype)
+      glDrawElementsInstancedBaseVertex(mesh->primitive, mesh->count, mesh->indextype,
+                                        (const GLvoid*)(r.firstindex * IndexBytes(mesh->indextype)), count, r.firstvertex);
+    else
+      glDrawArraysInstanced(mesh->primitive, r.firstvertex, mesh->count, count);
+  } else if(mesh->indextype)
+    glDrawElementsInstanced(mesh->primitive, mesh->count, mesh->indextype, 0, count);
+  else
+    glDrawArraysInstanced(mesh->primitive, 0, mesh->count, count);
+  glBindVertexArray(0);
+  PrimitiveRestart(mesh, false);
+  framestats.drawcalls++;
+  framestats.vertices += (unsigned long long)mesh->count * count;
+  framestats.triangles += (unsigned long long)mesh->triangles * count;
+  framestats.bytesuploaded += count * 16 * sizeof(GLfloat);
+}
+
+/* One glMultiDraw*Indirect call: batches that share an arena and a primitive */
+struct IndirectGroup {
+  const Mesh *mesh;       /* The first; the rest share its arena, layout and primitive */
+  size_t offset;          /* Into the indirect buffer */
+  GLsizei draws;
+};
+
+void DrawMeshBatches(const MeshBatch *batches, int count){
+  PROFILE_ZONE("DrawMeshBatches");
+  /* Kept between calls so steady state allocates nothing */
+  static std::vector<unsigned char> commands;
+  static std::vector<IndirectGroup> groups;
+  static std::vector<GLuint> baseinstances;
+  static std::vector<bool> grouped;
+  GLsizei instances = 0;
+  int i, j;
+  for(i = 0; i<count; i++)
+    if(!batches[i].mesh->arena){ /* Not every mesh is in an arena, so draw them one by one */
+      for(j = 0; j<count; j++)
+        if(batches[j].count)
+          DrawMeshInstanced(batches[j].mesh, batches[j].models, batches[j].count);
+      return;
+    }
+
+  /* Every batch's matrices go into the one instance buffer, each starting at its base instance */
+  baseinstances.resize(count);
+  for(i = 0; i<count; i++){
+    baseinstances[i] = instances;
+    instances += batches[i].count;
+  }
+  if(!instances)
+    return;
+  glBindBuffer(GL_ARRAY_BUFFER, InstanceBuffer());
+  glBufferData(GL_ARRAY_BUFFER, instances * 16 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+  for(i = 0; i<count; i++)
+    if(batches[i].count)
+      glBufferSubData(GL_ARRAY_BUFFER, baseinstances[i] * 16 * sizeof(GLfloat), batches[i].count * 16 * sizeof(GLfloat), batches[i].models);
+
+  commands.clear();
+  groups.clear();
+  grouped.assign(count, false);
+  for(i = 0; i<count; i++){
+    if(grouped[i] || !batches[i].count)
+      continue;
+    IndirectGroup group = {batches[i].mesh, commands.size(), 0};
+    for(j = i; j<count; j++){
+      const Mesh *mesh = batches[j].mesh;
+      if(grouped[j] || !batches[j].count || mesh->arena != group.mesh->arena || mesh->primitive != group.mesh->primitive)
+        continue;
+      const ArenaRange &r = mesh->arena->ranges[mesh->allocation];
+      size_t at = commands.size();
+      if(mesh->indextype){
+        DrawElementsIndirectCommand c = {(GLuint)mesh->count, (GLuint)batches[j].count, r.firstindex, (GLint)r.firstvertex, baseinstances[j]};
+        commands.resize(at + sizeof(c));
+        memcpy(&commands[at], &c, sizeof(c));
+      } else {
+        DrawArraysIndirectCommand c = {(GLuint)mesh->count, (GLuint)batches[j].count, r.firstvertex, baseinstances[j]};
+        commands.resize(at + sizeof(c));
+        memcpy(&commands[at], &c, sizeof(c));
+      }
+      grouped[j] = true;
+      group.draws++;
+      framestats.vertices += (unsigned long long)mesh->count * batches[j].count;
+      framestats.triangles += (unsigned long long)mesh->triangles * batches[j].count;
+    }
+    groups.push_back(group);
+  }
+
+#ifndef __APPLE__
+  if(!indirectbuffer)
+    glGenBuffers(1, &indirectbuffer);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectbuffer);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size(), commands.data(), GL_STREAM_DRAW);
+  for(size_t g = 0; g<groups.size(); g++){
+    const Mesh *mesh = groups[g].mesh;
+    SetConstantAttributes(mesh);
+    PrimitiveRestart(mesh, true);
+    glBindVertexArray(mesh->vao);
+    if(mesh->indextype)
+      glMultiDrawElementsIndirect(mesh->primitive, mesh->indextype, (const GLvoid*)groups[g].offset, groups[g].draws, 0);
+    else
+      glMultiDrawArraysIndirect(mesh->primitive, (const GLvoid*)groups[g].offset, groups[g].draws, 0);
+    PrimitiveRestart(mesh, false);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+#endif
+  framestats.drawcalls += groups.size();
+  framestats.bytesuploaded += instances * 16 * sizeof(GLfloat) + commands.size();
+}
+
+MeshRegistryStats GetMeshRegistryStats(){
+  return stats;
+}
+
+void PrintMeshRegistryStats(){
+  printf("Mesh registry: %d meshes, %d bytes resident, %u hits, %u misses\n",
+         stats.meshes, (int)stats.bytesresident, stats.hits, stats.misses);
+  PrintGeometryArenaStats();
+}
+
+/* Give back everything a mesh holds; the registry entry itself is left to the caller */
+static void FreeMesh(Mesh &mesh){
+  delete mesh.data;
+  if(mesh.arena)
+    ArenaRemove(mesh.arena, mesh.allocation);
+  else if(mesh.vao){
+    glDeleteVertexArrays(1, &mesh.vao);
+    glDeleteBuffers(1, &mesh.vbo);
+    glDeleteBuffers(1, &mesh.instancevbo);
+    if(mesh.ibo)
+      glDeleteBuffers(1, &mesh.ibo);
+  }
+}
+
+void EvictMesh(MeshGenerator generator, int param){
+  MeshKey key = {generator, param};
+  std::map<MeshKey, Mesh>::iterator it = meshes.find(key);
+  if(it == meshes.end())
+    return;
+  FreeMesh(it->second);
+  stats.bytesresident -= it->second.bytes;
+  stats.meshes--;
+  meshes.erase(it);
+}
+
+void ReleaseMeshes(){
+  for(std::map<MeshKey, Mesh>::iterator it = meshes.begin(); it != meshes.end(); ++it)
+    FreeMesh(it->second);
+  meshes.clear();
+  ReleaseGeometryArenas();
+  if(instancebuffer)
+    glDeleteBuffers(1, &instancebuffer);
+  if(indirectbuffer)
+    glDeleteBuffers(1, &indirectbuffer);
+  instancebuffer = indirectbuffer = 0;
+  for(std::map<std::string, PrefetchedMesh *>::iterator it = prefetched.begin(); it != prefetched.end(); ++it){
+    while(!it->second->done){
+      PollAsyncLoads();
+      std::this_thread::yield();
+    }
+    if(it->second->ok)
+      UnmapMeshFile(&it->second->file);
+    delete it->second;
+  }
+  prefetched.clear();
+  for(std::map<MeshKey, MeshData *>::iterator it = prepared.begin(); it != prepared.end(); ++it)
+    delete it->second;
+  prepared.clear();
+  stats.bytesresident = 0;
+  stats.meshes = 0;
+}
@@ -0,0 +1,144 @@
+#ifndef MESH_H
+#define MESH_H
+/*
+   Mesh registry. Generators fill a MeshData on the CPU; the registry builds each
+   (generator, parameter) pair once, uploads it, and hands out the same GPU handles to
+   every caller after that, so switching modes never regenerates or re-uploads geometry.
+ */
+#include <stddef.h>
+#include <functional>
+#include <vector>
+#include "Platform.h"
+
+struct Vertex {
+  Vertex(): color{0,1,0} {};
+  GLfloat position[3];
+  GLfloat color[3];
+};
+
+/* CPU-side output of a generator. indices may be left empty for glDrawArrays meshes, and normals
+   (three floats per vertex) may be left empty when the shaders can use the position instead. */
+struct MeshData {
+  MeshData(): primitive(GL_TRIANGLES) {};
+  std::vector<Vertex> vertices;
+  std::vector<GLuint> indices;
+  std::vector<GLfloat> normals;
+  GLenum primitive;
+};
+
+/* How vertices are stored on the GPU. FLOAT uploads struct Vertex as it is (24 bytes). COMPACT
+   quantises positions to 16-bit snorm (or half floats when the mesh leaves the unit cube), packs
+   colours as RGBA8 or drops them for a per-mesh constant, and stores normals octahedral-encoded.
+ */
+enum VertexFormat { VERTEX_FORMAT_FLOAT, VERTEX_FORMAT_COMPACT };
+
+#define NORMAL_ATTRIBUTE 6  /* Attributes 2 to 5 hold the instance matrix */
+#define MAX_VERTEX_ATTRIBUTES 3
+
+struct VertexAttribute {
+  GLuint index;
+  GLint size;
+  GLenum type;
+  GLboolean normalized;
+  GLuint offset;
+};
+
+struct VertexLayout {
+  VertexAttribute attributes[MAX_VERTEX_ATTRIBUTES];
+  int count;
+  GLsizei stride;
+  bool constantcolor;   /* No colour array; attribute 1 is set to color before each draw */
+  GLfloat color[3];
+  bool normals;         /* NORMAL_ATTRIBUTE holds an array of encoded normals */
+};
+
+struct GeometryArena;
+
+/* GPU handles shared by everyone drawing the mesh. indextype is 0 for non-indexed meshes. */
+struct Mesh {
+  const char *name;     /* As passed to GetMesh */
+  GLuint vao, vbo, ibo;
+  GLuint instancevbo;   /* Per-instance model matrices, attributes 2 to 5 */
+  GeometryArena *arena; /* When set, vao is the arena's and the mesh has no buffers of its own */
+  int allocation;       /* The mesh's handle in arena */
+  GLenum primitive;
+  GLsizei count;        /* Number of indices, or vertices if the mesh is not indexed */
+  GLsizei vertexcount;
+  GLsizei triangles;    /* Triangles (or patches) one draw of the mesh submits; 0 for lines */
+  GLenum indextype;
+  size_t bytes;         /* Vertex plus index bytes resident on the GPU */
+  VertexLayout layout;
+  GLfloat bounds[4];    /* Sphere around the vertices: centre xyz and radius */
+  const MeshData *data; /* The generator's output, kept only when meshes are not uploaded */
+};
+
+typedef void (*MeshGenerator)(int param, MeshData *mesh);
+/* Builds the meshes of several params of one generator at once, meshes[i] for params[i], so
+   work shared between them (coarser subdivision levels, say) is done once */
+typedef void (*MeshChainGenerator)(const int *params, int count, MeshData *meshes);
+
+struct MeshRegistryStats {
+  size_t bytesresident;
+  unsigned hits, misses;
+  int meshes;
+};
+
+void SetVertexFormat(VertexFormat format);
+/* Let GetMesh upload baked files from MESH_DIRECTORY instead of running the generator (on by default) */
+void SetMeshFiles(bool enable);
+/* Map the baked file of name and param and read it into memory on the AsyncLoader thread, so a
+   later GetMesh of the same mesh only uploads it. Does nothing when GetMesh would not use the file. */
+void PrefetchMeshFile(const char *name, int param);
+/* Run generator and write its mesh, encoded in the current vertex format, to MESH_DIRECTORY */
+bool BakeMesh(const char *name, MeshGenerator generator, int param);
+/* Off for the software backend: GetMesh then keeps each mesh's MeshData and makes no GL calls */
+void SetMeshUpload(bool upload);
+/* Put meshes in shared GeometryArenas and draw batches with multi-draw indirect, when the GL has
+   it (4.3 or ARB_multi_draw_indirect with ARB_base_instance). On by default. */
+void SetMeshArenas(bool enable);
+/* Run OptimiseMesh (MeshOptimise.h) over every mesh GetMesh or BakeMesh generates, and with strips
+   also turn triangle lists into strips with primitive restart. Optimisation is on by default. */
+void SetMeshOptimisation(bool enable, bool strips);
+/* Pick the layout the current vertex format uses for this mesh */
+VertexLayout ChooseVertexLayout(const MeshData &data);
+/* Pack the vertices of data into layout.stride bytes each */
+void EncodeVertices(const MeshData &data, const VertexLayout &layout, std::vector<unsigned char> &out);
+/* Point the attributes of the bound VAO at the bound GL_ARRAY_BUFFER as layout describes */
+void ApplyVertexLayout(const VertexLayout &layout);
+
+/* Return the mesh built by generator with param, building and uploading it on the first request */
+const Mesh *GetMesh(const char *name, MeshGenerator generator, int param);
+/* GetMesh for each of params, into out. The ones not yet registered or baked are built by a
+   single call of chain, or by generator one at a time when chain is NULL. Each is registered as
+   GetMesh(name, generator, param) would, so the two share their meshes. */
+void GetMeshChain(const char *name, MeshGenerator generator, MeshChainGenerator chain, const int *params, int count,
+                  const Mesh **out);
+/* Run on the AsyncLoader thread the generators GetMeshChain would run for params, and keep their
+   output for it, so the GetMeshChain or GetMesh calls that follow only upload. Meshes that are
+   registered already are left alone; baked files GetMesh would accept are mapped and faulted in
+   there instead, and missing or stale ones generated. done runs on the render thread once the
+   meshes are ready; until then nothing of the registry changes, so the render thread can keep
+   drawing. */
+void PrepareMeshChain(const char *name, MeshGenerator generator, MeshChainGenerator chain, const int *params, int count,
+                      std::function<void()> done);
+/* Bind the mesh's VAO and issue its draw call */
+void DrawMesh(const Mesh *mesh);
+/* Draw count instances of the mesh in one call. models holds count column-major 4x4 matrices. */
+void DrawMeshInstanced(const Mesh *mesh, const GLfloat *models, GLsizei count);
+
+struct MeshBatch {
+  const Mesh *mesh;
+  const GLfloat *models;  /* count column-major 4x4 matrices */
+  GLsizei count;
+};
+/* Draw every batch. Meshes in arenas are drawn with one multi-draw indirect call per arena and
+   primitive, whatever the number of batches; others get one instanced draw each. */
+void DrawMeshBatches(const MeshBatch *batches, int count);
+/* Drop the mesh generator built with param, freeing its space for later meshes */
+void EvictMesh(MeshGenerator generator, int param);
+MeshRegistryStats GetMeshRegistryStats();
+void PrintMeshRegistryStats();
+/* Delete every GL object the registry owns. Pointers from GetMesh are invalid afterwards. */
+void ReleaseMeshes();
+
+#endif
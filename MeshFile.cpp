@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "MeshFile.h"
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static uint64_t Align(uint64_t offset){
+  return (offset + MESH_FILE_ALIGN - 1) & ~(uint64_t)(MESH_FILE_ALIGN - 1);
+}
+
+static bool WriteBlock(FILE *out, const void *data, uint64_t bytes){
+  return !bytes || fwrite(data, bytes, 1, out) == 1;
+}
+
+void MeshFilePath(const char *name, int param, char *path, size_t size){
+  snprintf(path, size, "%s/%s-%d.mesh", MESH_DIRECTORY, name, param);
+}
+
+bool WriteMeshFile(const char *path, MeshFileHeader header, const void *vertices, const void *indices){
+#ifdef _WIN32
+  _mkdir(MESH_DIRECTORY);
+#else
+  mkdir(MESH_DIRECTORY, 0755);
+#endif
+  header.magic = MESH_FILE_MAGIC;
+  header.version = MESH_FILE_VERSION;
+  header.vertexoffset = Align(sizeof(MeshFileHeader));
+  header.indexoffset = Align(header.vertexoffset + header.vertexbytes);
+  FILE *out = fopen(path, "wb");
+  if(!out){
+    fprintf(stderr, "Cannot write %s\n", path);
+    return false;
+  }
+  static const char zeros[MESH_FILE_ALIGN] = {0};
+  bool ok = WriteBlock(out, &header, sizeof(header)) &&
+            WriteBlock(out, zeros, header.vertexoffset - sizeof(header)) &&
+            WriteBlock(out, vertices, header.vertexbytes) &&
+            WriteBlock(out, zeros, header.indexoffset - header.vertexoffset - header.vertexbytes) &&
+            WriteBlock(out, indices, header.indexbytes);
+  ok = fclose(out) == 0 && ok;
+  if(!ok)
+    fprintf(stderr, "Error writing %s\n", path);
+  return ok;
+}
+
+/* Whether bytes from offset lie between the header and the end of a file of size bytes. Each
+   field is compared on its own, so a damaged header cannot wrap the sum around. */
+static bool BlockInside(uint64_t offset, uint64_t bytes, uint64_t size){
+  return offset >= sizeof(MeshFileHeader) && offset <= size && bytes <= size - offset;
+}
+
+bool MapMeshFile(const char *path, MappedMeshFile *file){
+  memset(file, 0, sizeof(*file));
+#ifdef _WIN32
+  /* No mmap here; read the file into one allocation instead */
+  FILE *in = fopen(path, "rb");
+  if(!in)
+    return false;
+  fseek(in, 0, SEEK_END);
+  long length = ftell(in);
+  fseek(in, 0, SEEK_SET);
+  file->base = length > 0 ? malloc(length) : NULL;
+  bool read = file->base && fread(file->base, length, 1, in) == 1;
+  fclose(in);
+  if(!read){
+    free(file->base);
+    file->base = NULL;
+    return false;
+  }
+  file->size = length;
+#else
+  int fd = open(path, O_RDONLY);
+  if(fd < 0)
+    return false;
+  struct stat st;
+  if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(MeshFileHeader)){
+    close(fd);
+    return false;
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); /* The mapping keeps the file open */
+  if(base == MAP_FAILED)
+    return false;
+  file->base = base;
+  file->size = st.st_size;
+#endif
+  const MeshFileHeader *header = (const MeshFileHeader *)file->base;
+  if(file->size < sizeof(MeshFileHeader) || header->magic != MESH_FILE_MAGIC || header->version != MESH_FILE_VERSION ||
+     header->attributecount > 3 || !BlockInside(header->vertexoffset, header->vertexbytes, file->size) ||
+     !BlockInside(header->indexoffset, header->indexbytes, file->size)){
+    UnmapMeshFile(file);
+    return false;
+  }
+  file->header = header;
+  file->vertices = (const char *)file->base + header->vertexoffset;
+  file->indices = (const char *)file->base + header->indexoffset;
+  return true;
+}
+
+void UnmapMeshFile(MappedMeshFile *file){
+  if(!file->base)
+    return;
+#ifdef _WIN32
+  free(file->base);
+#else
+  munmap(file->base, file->size);
+#endif
+  memset(file, 0, sizeof(*file));
+}
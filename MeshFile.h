@@ -0,0 +1,57 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+/*
+   Baked mesh files. A file holds one mesh exactly as the registry uploads it: a fixed header
+   with the vertex layout, draw parameters and bounding sphere, then the encoded vertex block and
+   the (possibly 16-bit) index block, each starting on a MESH_FILE_ALIGN boundary. Mapping the
+   file gives pointers that go straight to glBufferData.
+
+   All fields are little-endian and fixed size. Bump MESH_FILE_VERSION whenever the layout or a
+   generator's output changes, so older files are treated as stale and regenerated.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#define MESH_FILE_MAGIC 0x4853454d  /* "MESH" */
+#define MESH_FILE_VERSION 3
+#define MESH_FILE_ALIGN 16
+#define MESH_DIRECTORY "meshes"
+
+/* MeshFileHeader::processing: what ran between the generator and the encoder */
+#define MESH_PROCESSING_OPTIMISED 1
+#define MESH_PROCESSING_STRIPS 2
+
+struct MeshFileAttribute {
+  uint32_t index, size, type, normalized, offset;
+};
+
+struct MeshFileHeader {
+  uint32_t magic, version;
+  char name[32];
+  int32_t param;
+  uint32_t vertexformat;          /* The VertexFormat the vertices were encoded with */
+  uint32_t processing;            /* MESH_PROCESSING_* flags */
+  uint32_t primitive, vertexcount, count, indextype;
+  uint32_t attributecount, stride, constantcolor, normals;
+  float color[3];
+  MeshFileAttribute attributes[3];
+  float bounds[4];
+  uint64_t vertexoffset, vertexbytes, indexoffset, indexbytes;
+};
+
+struct MappedMeshFile {
+  const MeshFileHeader *header;
+  const void *vertices, *indices;
+  void *base;
+  size_t size;
+};
+
+/* MESH_DIRECTORY/name-param.mesh */
+void MeshFilePath(const char *name, int param, char *path, size_t size);
+/* Write header (its offsets are filled in here) followed by the two blocks */
+bool WriteMeshFile(const char *path, MeshFileHeader header, const void *vertices, const void *indices);
+/* Map path read-only and check its magic, version and block bounds. False if missing or invalid. */
+bool MapMeshFile(const char *path, MappedMeshFile *file);
+void UnmapMeshFile(MappedMeshFile *file);
+
+#endif
@@ -0,0 +1,407 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <glm/glm.hpp>
+#include "MeshOptimise.h"
+
+#define OVERDRAW_THRESHOLD 1.05f
+/* How far ahead of the first unused triangle a strip may reach for its next one, so the strips
+   keep to the cache-friendly order instead of wandering across the mesh */
+#define STRIP_WINDOW 32
+
+/* FIFO cache by timestamps: a vertex is cached if fewer than VERTEX_CACHE_SIZE misses have
+   happened since it was loaded */
+struct VertexCache {
+  std::vector<size_t> stamp;
+  size_t time;
+
+  VertexCache(size_t vertexcount): stamp(vertexcount, 0), time(VERTEX_CACHE_SIZE + 1) {}
+  void Reset(){
+    time += VERTEX_CACHE_SIZE + 1;
+  }
+  /* Returns 1 on a miss */
+  int Fetch(GLuint v){
+    if(time - stamp[v] <= VERTEX_CACHE_SIZE)
+      return 0;
+    stamp[v] = time++;
+    return 1;
+  }
+};
+
+VertexCacheStats AnalyseVertexCache(const std::vector<GLuint> &indices, GLenum primitive, size_t vertexcount){
+  VertexCache cache(vertexcount);
+  VertexCacheStats stats = {0, 0, 0};
+  size_t misses = 0, run = 0;
+  for(size_t i = 0; i<indices.size(); i++){
+    if(indices[i] == MESH_RESTART_INDEX){
+      run = 0;
+      continue;
+    }
+    misses += cache.Fetch(indices[i]);
+    if(primitive == GL_TRIANGLE_STRIP ? ++run >= 3 : i % 3 == 2)
+      stats.triangles++;
+  }
+  if(stats.triangles)
+    stats.acmr = (float)misses / stats.triangles;
+  if(vertexcount)
+    stats.atvr = (float)misses / vertexcount;
+  return stats;
+}
+
+/* Everything that makes two vertices the same vertex */
+struct WeldKey {
+  GLfloat v[9];
+  bool operator<(const WeldKey &o) const { return memcmp(v, o.v, sizeof(v)) < 0; }
+};
+
+bool IndexTriangles(MeshData *mesh){
+  GLenum primitive = mesh->primitive;
+  if(primitive != GL_TRIANGLES && primitive != GL_TRIANGLE_FAN && primitive != GL_TRIANGLE_STRIP)
+    return false;
+  if(primitive == GL_TRIANGLES && !mesh->indices.empty())
+    return true;
+  bool normals = mesh->normals.size() == mesh->vertices.size() * 3;
+  std::vector<GLuint> elements = mesh->indices;
+  if(elements.empty()){
+    /* Soup: one vertex per element, so identical ones are merged as they are indexed */
+    std::vector<Vertex> vertices;
+    std::vector<GLfloat> welded;
+    std::map<WeldKey, GLuint> seen;
+    for(size_t i = 0; i<mesh->vertices.size(); i++){
+      WeldKey key;
+      memset(&key, 0, sizeof(key));
+      memcpy(key.v, mesh->vertices[i].position, 3 * sizeof(GLfloat));
+      memcpy(key.v + 3, mesh->vertices[i].color, 3 * sizeof(GLfloat));
+      if(normals)
+        memcpy(key.v + 6, &mesh->normals[3 * i], 3 * sizeof(GLfloat));
+      std::map<WeldKey, GLuint>::iterator it = seen.find(key);
+      if(it == seen.end()){
+        it = seen.insert(std::make_pair(key, (GLuint)vertices.size())).first;
+        vertices.push_back(mesh->vertices[i]);
+        if(normals)
+          welded.insert(welded.end(), key.v + 6, key.v + 9);
+      }
+      elements.push_back(it->second);
+    }
+    mesh->vertices.swap(vertices);
+    if(normals)
+      mesh->normals.swap(welded);
+  }
+
+  std::vector<GLuint> triangles;
+  size_t start = 0;
+  for(size_t i = 0; i<=elements.size(); i++){
+    if(i < elements.size() && elements[i] != MESH_RESTART_INDEX)
+      continue;
+    /* Elements [start, i) are one fan, strip or list */
+    for(size_t k = 0; start + k + 2 < i; k += primitive == GL_TRIANGLES ? 3 : 1){
+      const GLuint *e = &elements[start];
+      GLuint t[3];
+      if(primitive == GL_TRIANGLE_FAN){
+        t[0] = e[0]; t[1] = e[k + 1]; t[2] = e[k + 2];
+      } else if(primitive == GL_TRIANGLE_STRIP){
+        t[0] = e[k + (k & 1)]; t[1] = e[k + 1 - (k & 1)]; t[2] = e[k + 2];
+      } else {
+        t[0] = e[k]; t[1] = e[k + 1]; t[2] = e[k + 2];
+      }
+      if(t[0] != t[1] && t[1] != t[2] && t[0] != t[2])
+        triangles.insert(triangles.end(), t, t + 3);
+    }
+    start = i + 1;
+  }
+  mesh->indices.swap(triangles);
+  mesh->primitive = GL_TRIANGLES;
+  return true;
+}
+
+/* Triangles using each vertex, as offsets into one array */
+struct Adjacency {
+  std::vector<GLuint> offsets, triangles;
+
+  Adjacency(const std::vector<GLuint> &indices, size_t vertexcount): offsets(vertexcount + 1, 0), triangles(indices.size()){
+    for(size_t i = 0; i<indices.size(); i++)
+      offsets[indices[i] + 1]++;
+    for(size_t v = 0; v<vertexcount; v++)
+      offsets[v + 1] += offsets[v];
+    std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t i = 0; i<indices.size(); i++)
+      triangles[fill[indices[i]]++] = i / 3;
+  }
+};
+
+void OptimiseVertexCache(std::vector<GLuint> &indices, size_t vertexcount){
+  const int k = VERTEX_CACHE_SIZE;
+  if(indices.empty())
+    return;
+  size_t ntriangles = indices.size() / 3;
+  Adjacency adjacency(indices, vertexcount);
+  std::vector<int> live(vertexcount);
+  for(size_t v = 0; v<vertexcount; v++)
+    live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+  std::vector<size_t> stamp(vertexcount, 0);
+  std::vector<bool> emitted(ntriangles, false);
+  std::vector<GLuint> deadend, candidates, output;
+  output.reserve(indices.size());
+  size_t time = k + 1, cursor = 0;
+  long fan = 0;
+
+  while(fan >= 0){
+    /* Emit every unused triangle around the fanning vertex */
+    candidates.clear();
+    for(GLuint a = adjacency.offsets[fan]; a<adjacency.offsets[fan + 1]; a++){
+      GLuint t = adjacency.triangles[a];
+      if(emitted[t])
+        continue;
+      for(int c = 0; c<3; c++){
+        GLuint v = indices[3 * t + c];
+        output.push_back(v);
+        deadend.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if(time - stamp[v] > (size_t)k)
+          stamp[v] = time++;
+      }
+      emitted[t] = true;
+    }
+
+    /* Next fan: the candidate that will still be in the cache after its own triangles are
+       emitted, and of those the one that has been there longest */
+    fan = -1;
+    long best = -1;
+    for(size_t i = 0; i<candidates.size(); i++){
+      GLuint v = candidates[i];
+      if(live[v] <= 0)
+        continue;
+      long priority = 0;
+      if((long)(time - stamp[v]) + 2 * live[v] <= k)
+        priority = time - stamp[v];
+      if(priority > best){
+        best = priority;
+        fan = v;
+      }
+    }
+    if(fan >= 0)
+      continue;
+    /* Dead end: go back to a recently used vertex with triangles left, else scan on */
+    while(!deadend.empty() && fan < 0){
+      GLuint v = deadend.back();
+      deadend.pop_back();
+      if(live[v] > 0)
+        fan = v;
+    }
+    for(; fan < 0 && cursor < vertexcount; cursor++)
+      if(live[cursor] > 0)
+        fan = cursor;
+  }
+  indices.swap(output);
+}
+
+/* Start triangles of clusters of a cache-optimised list: a hard boundary wherever a triangle
+   misses on all three vertices (the cache has started over), and soft ones inside a hard cluster
+   wherever the ACMR so far has come down to threshold times the whole cluster's */
+static void FindClusters(const std::vector<GLuint> &indices, size_t vertexcount, float threshold, std::vector<size_t> &clusters){
+  size_t ntriangles = indices.size() / 3;
+  std::vector<size_t> hard;
+  VertexCache cache(vertexcount);
+  for(size_t t = 0; t<ntriangles; t++){
+    int misses = cache.Fetch(indices[3 * t]) + cache.Fetch(indices[3 * t + 1]) + cache.Fetch(indices[3 * t + 2]);
+    if(t == 0 || misses == 3)
+      hard.push_back(t);
+  }
+  hard.push_back(ntriangles);
+  for(size_t h = 0; h + 1<hard.size(); h++){
+    size_t begin = hard[h], end = hard[h + 1], misses = 0;
+    cache.Reset();
+    for(size_t t = begin; t<end; t++)
+      for(int c = 0; c<3; c++)
+        misses += cache.Fetch(indices[3 * t + c]);
+    float target = threshold * misses / (end - begin);
+    size_t first = clusters.size(), running = 0;
+    clusters.push_back(begin);
+    cache.Reset();
+    for(size_t t = begin; t<end; t++){
+      for(int c = 0; c<3; c++)
+        running += cache.Fetch(indices[3 * t + c]);
+      if(t + 1 < end && (float)running / (t + 1 - clusters.back()) <= target){
+        clusters.push_back(t + 1);
+        cache.Reset();
+        running = 0;
+      }
+    }
+    /* The last piece rarely reaches the target on its own, so it joins the one before */
+    if(running && clusters.size() - first > 1)
+      clusters.pop_back();
+  }
+}
+
+struct Cluster {
+  size_t begin, end;
+  float key;
+};
+
+void OptimiseOverdraw(std::vector<GLuint> &indices, const std::vector<Vertex> &vertices, float threshold){
+  std::vector<size_t> starts;
+  FindClusters(indices, vertices.size(), threshold, starts);
+  size_t ntriangles = indices.size() / 3;
+  if(starts.size() < 2)
+    return;
+
+  /* Area-weighted centroid and normal of each cluster and of the whole mesh */
+  std::vector<Cluster> clusters(starts.size());
+  std::vector<glm::vec3> centroids(starts.size()), normals(starts.size());
+  glm::vec3 centre(0.f);
+  float total = 0;
+  for(size_t c = 0; c<starts.size(); c++){
+    clusters[c].begin = starts[c];
+    clusters[c].end = c + 1 < starts.size() ? starts[c + 1] : ntriangles;
+    glm::vec3 sum(0.f), normal(0.f);
+    float area = 0;
+    for(size_t t = clusters[c].begin; t<clusters[c].end; t++){
+      const GLfloat *p0 = vertices[indices[3 * t]].position, *p1 = vertices[indices[3 * t + 1]].position,
+                    *p2 = vertices[indices[3 * t + 2]].position;
+      glm::vec3 a(p0[0], p0[1], p0[2]), b(p1[0], p1[1], p1[2]), d(p2[0], p2[1], p2[2]);
+      glm::vec3 n = glm::cross(b - a, d - a);
+      float w = glm::length(n);
+      sum += (a + b + d) * (w / 3);
+      normal += n;
+      area += w;
+    }
+    centroids[c] = area > 0 ? sum * (1.f / area) : sum;
+    normals[c] = normal;
+    centre += sum;
+    total += area;
+  }
+  if(total > 0)
+    centre = centre * (1.f / total);
+  for(size_t c = 0; c<clusters.size(); c++){
+    float length = glm::length(normals[c]);
+    clusters[c].key = length > 0 ? glm::dot(centroids[c] - centre, normals[c] * (1.f / length)) : 0;
+  }
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b){ return a.key > b.key; });
+
+  std::vector<GLuint> output;
+  output.reserve(indices.size());
+  for(size_t c = 0; c<clusters.size(); c++)
+    output.insert(output.end(), indices.begin() + 3 * clusters[c].begin, indices.begin() + 3 * clusters[c].end);
+  indices.swap(output);
+}
+
+void OptimiseVertexFetch(MeshData *mesh){
+  const GLuint unused = MESH_RESTART_INDEX;
+  bool normals = mesh->normals.size() == mesh->vertices.size() * 3;
+  std::vector<GLuint> remap(mesh->vertices.size(), unused);
+  std::vector<Vertex> vertices;
+  std::vector<GLfloat> reordered;
+  vertices.reserve(mesh->vertices.size());
+  for(size_t i = 0; i<mesh->indices.size(); i++){
+    GLuint v = mesh->indices[i];
+    if(v == MESH_RESTART_INDEX)
+      continue;
+    if(remap[v] == unused){
+      remap[v] = vertices.size();
+      vertices.push_back(mesh->vertices[v]);
+      if(normals)
+        reordered.insert(reordered.end(), mesh->normals.begin() + 3 * v, mesh->normals.begin() + 3 * v + 3);
+    }
+    mesh->indices[i] = remap[v];
+  }
+  /* Vertices no triangle uses are dropped */
+  mesh->vertices.swap(vertices);
+  if(normals)
+    mesh->normals.swap(reordered);
+}
+
+void StripifyMesh(MeshData *mesh){
+  const std::vector<GLuint> &indices = mesh->indices;
+  size_t ntriangles = indices.size() / 3;
+  Adjacency adjacency(indices, mesh->vertices.size());
+  std::vector<bool> emitted(ntriangles, false);
+  std::vector<GLuint> strip;
+  size_t next = 0;
+
+  /* An unused triangle near next with corners (p, q, r) in that rotation; returns r */
+  auto Find = [&](GLuint p, GLuint q, size_t *triangle) -> long {
+    for(GLuint a = adjacency.offsets[p]; a<adjacency.offsets[p + 1]; a++){
+      GLuint t = adjacency.triangles[a];
+      if(emitted[t] || t >= next + STRIP_WINDOW)
+        continue;
+      for(int c = 0; c<3; c++)
+        if(indices[3 * t + c] == p && indices[3 * t + (c + 1) % 3] == q){
+          *triangle = t;
+          return indices[3 * t + (c + 2) % 3];
+        }
+    }
+    return -1;
+  };
+
+  for(;;){
+    while(next < ntriangles && emitted[next])
+      next++;
+    if(next == ntriangles)
+      break;
+    if(!strip.empty()){
+      strip.push_back(MESH_RESTART_INDEX);
+      if(strip.size() % 2) /* Keep every run on an even element; an empty run costs one index */
+        strip.push_back(MESH_RESTART_INDEX);
+    }
+    /* Start with the rotation whose last edge leads on to another triangle. The second triangle
+       of a run is odd, so it must have that edge reversed. */
+    const GLuint *t = &indices[3 * next];
+    int rotation = 0;
+    size_t unused;
+    for(int c = 0; c<3; c++)
+      if(Find(t[(c + 2) % 3], t[(c + 1) % 3], &unused) >= 0){
+        rotation = c;
+        break;
+      }
+    size_t run = strip.size();
+    for(int c = 0; c<3; c++)
+      strip.push_back(t[(rotation + c) % 3]);
+    emitted[next] = true;
+    for(;;){
+      size_t n = strip.size(), triangle;
+      GLuint x = strip[n - 2], y = strip[n - 1];
+      /* Triangle k of a run is (x, y, z) for even k and (y, x, z) for odd k */
+      long z = (n - run - 2) % 2 ? Find(y, x, &triangle) : Find(x, y, &triangle);
+      if(z < 0)
+        break;
+      strip.push_back(z);
+      emitted[triangle] = true;
+    }
+  }
+  mesh->indices.swap(strip);
+  mesh->primitive = GL_TRIANGLE_STRIP;
+}
+
+void OptimiseMesh(const char *name, int param, MeshData *mesh, bool strips){
+  if(!IndexTriangles(mesh))
+    return;
+  size_t vertexcount = mesh->vertices.size();
+  VertexCacheStats before = AnalyseVertexCache(mesh->indices, GL_TRIANGLES, vertexcount);
+  /* Tipsify does badly around vertices with more triangles than the cache holds, such as the
+     centre of a cylinder's end, so a generator's order that is already better is kept. Likewise
+     the overdraw order is only taken if it costs little in the cache. */
+  std::vector<GLuint> order = mesh->indices;
+  OptimiseVertexCache(order, vertexcount);
+  float acmr = AnalyseVertexCache(order, GL_TRIANGLES, vertexcount).acmr;
+  if(acmr < before.acmr)
+    mesh->indices.swap(order);
+  else
+    acmr = before.acmr;
+  order = mesh->indices;
+  OptimiseOverdraw(order, mesh->vertices, OVERDRAW_THRESHOLD);
+  if(AnalyseVertexCache(order, GL_TRIANGLES, vertexcount).acmr <= acmr * OVERDRAW_THRESHOLD)
+    mesh->indices.swap(order);
+  OptimiseVertexFetch(mesh);
+  VertexCacheStats after = AnalyseVertexCache(mesh->indices, GL_TRIANGLES, mesh->vertices.size());
+  printf("Optimised mesh %s(%d): %d triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%d-entry FIFO)\n", name, param,
+         (int)after.triangles, before.acmr, after.acmr, before.atvr, after.atvr, VERTEX_CACHE_SIZE);
+  if(!strips)
+    return;
+  size_t listed = mesh->indices.size();
+  StripifyMesh(mesh);
+  VertexCacheStats strip = AnalyseVertexCache(mesh->indices, GL_TRIANGLE_STRIP, mesh->vertices.size());
+  printf("  as strips: %d indices instead of %d, ACMR %.3f\n", (int)mesh->indices.size(), (int)listed, strip.acmr);
+}
@@ -0,0 +1,52 @@
+#ifndef MESHOPTIMISE_H
+#define MESHOPTIMISE_H
+/*
+   Post-processing for generated meshes, run on whatever a generator returns before it is
+   encoded. Fans, strips and unindexed triangles are first turned into an indexed triangle list
+   with identical vertices welded. Then:
+     - Tipsify (Sander, Nehab and Barczak 2007) reorders the triangles so each vertex is reused
+       while it is still in the post-transform cache;
+     - the order is cut into clusters wherever the cache starts over or has already done well,
+       and the clusters are sorted so those facing out from the mesh centre come first, which
+       lets early depth testing reject more of what is drawn behind them;
+     - the vertices are renumbered in the order the triangles first use them, so fetching them
+       walks the vertex buffer forwards;
+     - optionally the list becomes one triangle strip, runs joined by MESH_RESTART_INDEX.
+   Line primitives are left alone.
+
+   Cache efficiency is measured by simulating a FIFO of VERTEX_CACHE_SIZE vertices: ACMR is the
+   vertices transformed per triangle (0.5 is the limit for a large regular mesh, 3 means no reuse)
+   and ATVR the vertices transformed per vertex (1 is perfect).
+ */
+#include <stddef.h>
+#include <vector>
+#include "Mesh.h"
+
+#define VERTEX_CACHE_SIZE 16
+/* Separates the runs of a strip. It becomes 0xffff when the indices are narrowed to 16 bits. */
+#define MESH_RESTART_INDEX 0xffffffffu
+
+struct VertexCacheStats {
+  size_t triangles;
+  float acmr, atvr;
+};
+
+/* Simulate the cache over an indexed GL_TRIANGLES or GL_TRIANGLE_STRIP index list */
+VertexCacheStats AnalyseVertexCache(const std::vector<GLuint> &indices, GLenum primitive, size_t vertexcount);
+/* Turn a fan, strip or unindexed triangle mesh into an indexed triangle list, dropping degenerate
+   triangles. False, and the mesh unchanged, for lines. */
+bool IndexTriangles(MeshData *mesh);
+/* Tipsify: reorder the triangles of an indexed triangle list for the vertex cache */
+void OptimiseVertexCache(std::vector<GLuint> &indices, size_t vertexcount);
+/* Reorder cache-friendly clusters of an optimised triangle list, outward-facing first. threshold
+   is how far above its cluster's ACMR a soft cluster may end (1.05 keeps almost all the reuse). */
+void OptimiseOverdraw(std::vector<GLuint> &indices, const std::vector<Vertex> &vertices, float threshold);
+/* Renumber the vertices (and normals) in order of first use */
+void OptimiseVertexFetch(MeshData *mesh);
+/* Rewrite an indexed triangle list as a GL_TRIANGLE_STRIP with MESH_RESTART_INDEX between runs.
+   Every run starts on an even element, so its winding is the same with or without restart. */
+void StripifyMesh(MeshData *mesh);
+/* All of the above, printing the ACMR and ATVR before and after under name(param) */
+void OptimiseMesh(const char *name, int param, MeshData *mesh, bool strips);
+
+#endif
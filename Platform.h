@@ -0,0 +1,20 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+/*
+ *
+ * Include files for Windows, Linux and OSX
+ * __APPLE is defined if OSX, otherwise Windows and Linux.
+ *
+ */
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB 1
+#include <GLFW/glfw3.h>
+#else
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#endif
+
+#include "GLTrace.h"
+
+#endif
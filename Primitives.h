@@ -0,0 +1,158 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+/*
+   Cone and cylinder generators specialised at compile time. SliceTable<Slices> holds the cosine
+   and sine of every slice angle, evaluated by the compiler, and Cone<Slices> and
+   Cylinder<Slices> know their vertex and index counts as constants, so they fill std::arrays
+   with no trig and no heap allocation at all. The kernels are templates over the table: for a
+   slice count only known at run time they take a RuntimeSliceTable instead, which evaluates
+   each angle from its integer slice number, and write into storage the caller sized once from
+   ConeVertexCount and friends. SliceTables<...> picks the compiled table for a runtime count
+   when there is one.
+
+   Angles come from the slice number rather than a running sum, so the last rim vertex lands
+   exactly on the first.
+ */
+#include <math.h>
+#include <stddef.h>
+#include <array>
+#include "Mesh.h"
+
+#define PRIMITIVE_PI 3.14159265358979323846
+#define CONE_HEIGHT 2.0f          /* The rim's z; the apex is at the origin */
+#define CONE_NORMAL_SCALE 0.44721359549995794f /* The side is x^2 + y^2 = (z/2)^2, whose outward normal (2c, 2s, -1) is sqrt(5) long */
+#define CYLINDER_HALF_LENGTH 2.0f
+
+/* sin x from its Taylor series after reducing x to [-pi, pi], where 20 terms are exact in double */
+constexpr double ConstexprSin(double x){
+  while(x > PRIMITIVE_PI)
+    x -= 2 * PRIMITIVE_PI;
+  while(x < -PRIMITIVE_PI)
+    x += 2 * PRIMITIVE_PI;
+  double term = x, sum = x;
+  for(int n = 1; n<20; n++){
+    term *= -x * x / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double ConstexprCos(double x){
+  return ConstexprSin(x + PRIMITIVE_PI / 2);
+}
+
+/* Cosine and sine of slice i of Slices around the circle, for any i >= 0 */
+template<int Slices> struct SliceTable {
+  static_assert(Slices >= 3, "A circle needs at least three slices");
+  float cosines[Slices], sines[Slices];
+  constexpr SliceTable(): cosines(), sines() {
+    for(int i = 0; i<Slices; i++){
+      cosines[i] = (float)ConstexprCos(2 * PRIMITIVE_PI * i / Slices);
+      sines[i] = (float)ConstexprSin(2 * PRIMITIVE_PI * i / Slices);
+    }
+  }
+  float Cos(int i) const { return cosines[i % Slices]; }
+  float Sin(int i) const { return sines[i % Slices]; }
+};
+
+/* The same for a slice count chosen at run time; one cos and sin per call */
+struct RuntimeSliceTable {
+  int slices;
+  explicit RuntimeSliceTable(int n): slices(n) {}
+  float Cos(int i) const { return (float)cos(2 * PRIMITIVE_PI * (i % slices) / slices); }
+  float Sin(int i) const { return (float)sin(2 * PRIMITIVE_PI * (i % slices) / slices); }
+};
+
+/* Run kernel(table) with the compiled table of whichever of the counts equals slices. Returns
+   false, having run nothing, when none does. */
+template<int First, int... Rest> struct SliceTables {
+  template<class Kernel> static bool Run(int slices, const Kernel &kernel){
+    if(slices == First){
+      static constexpr SliceTable<First> table;
+      kernel(table);
+      return true;
+    }
+    return SliceTables<Rest...>::Run(slices, kernel);
+  }
+};
+
+template<int Last> struct SliceTables<Last> {
+  template<class Kernel> static bool Run(int slices, const Kernel &kernel){
+    if(slices != Last)
+      return false;
+    static constexpr SliceTable<Last> table;
+    kernel(table);
+    return true;
+  }
+};
+
+constexpr size_t ConeVertexCount(int slices) { return slices + 2; }
+constexpr size_t CylinderVertexCount(int slices) { return 2 + 2 * slices; }
+constexpr size_t CylinderIndexCount(int slices) { return 12 * slices; }
+
+/* A cone as a triangle fan: the apex at the origin, then slices + 1 rim vertices at z =
+   CONE_HEIGHT, the last closing the fan on the first. Rim colours alternate magenta and green.
+   normals gets three floats per vertex. */
+template<class Table> void ConeKernel(const Table &table, int slices, Vertex *vertices, GLfloat *normals){
+  Vertex &apex = vertices[0];
+  apex.position[0] = 0; apex.position[1] = 0; apex.position[2] = 0;
+  apex.color[0] = 0; apex.color[1] = 1; apex.color[2] = 0;
+  normals[0] = 0; normals[1] = 0; normals[2] = -1;
+  for(int i = 0; i<=slices; i++){
+    float c = table.Cos(i), s = table.Sin(i), odd = (float)(i & 1);
+    Vertex &v = vertices[1 + i];
+    v.position[0] = c; v.position[1] = s; v.position[2] = CONE_HEIGHT;
+    v.color[0] = 1 - odd; v.color[1] = odd; v.color[2] = 1 - odd;
+    GLfloat *n = normals + 3 * (1 + i);
+    n[0] = 2 * c * CONE_NORMAL_SCALE; n[1] = 2 * s * CONE_NORMAL_SCALE; n[2] = -CONE_NORMAL_SCALE;
+  }
+}
+
+/* A closed cylinder along y as an indexed triangle list: the two end centres, then a top and a
+   bottom vertex per slice */
+template<class Table> void CylinderKernel(const Table &table, int slices, Vertex *vertices, GLuint *indices){
+  for(int end = 0; end<2; end++){
+    Vertex &v = vertices[end];
+    v.position[0] = 0; v.position[1] = end ? -CYLINDER_HALF_LENGTH : CYLINDER_HALF_LENGTH; v.position[2] = 0;
+    v.color[0] = 0; v.color[1] = 1; v.color[2] = 0;
+  }
+  for(int i = 0; i<slices; i++)
+    for(int end = 0; end<2; end++){
+      Vertex &v = vertices[2 + 2 * i + end];
+      v.position[0] = table.Cos(i); v.position[1] = end ? -CYLINDER_HALF_LENGTH : CYLINDER_HALF_LENGTH; v.position[2] = table.Sin(i);
+      v.color[0] = 0; v.color[1] = 1; v.color[2] = 0;
+    }
+  for(int i = 0; i<slices; i++){
+    GLuint top = 2 + 2 * i, bottom = top + 1;
+    GLuint nexttop = 2 + 2 * ((i + 1) % slices), nextbottom = nexttop + 1;
+    GLuint *t = indices + 12 * i;
+    t[0] = 0;      t[1] = nexttop;  t[2] = top;         /* Top end */
+    t[3] = top;    t[4] = nexttop;  t[5] = bottom;      /* Side */
+    t[6] = bottom; t[7] = nexttop;  t[8] = nextbottom;
+    t[9] = 1;      t[10] = bottom;  t[11] = nextbottom; /* Bottom end */
+  }
+}
+
+template<int Slices> struct Cone {
+  static constexpr size_t vertexcount = ConeVertexCount(Slices);
+  std::array<Vertex, vertexcount> vertices;
+  std::array<GLfloat, 3 * vertexcount> normals;
+
+  void Generate(){
+    static constexpr SliceTable<Slices> table;
+    ConeKernel(table, Slices, vertices.data(), normals.data());
+  }
+};
+
+template<int Slices> struct Cylinder {
+  static constexpr size_t vertexcount = CylinderVertexCount(Slices), indexcount = CylinderIndexCount(Slices);
+  std::array<Vertex, vertexcount> vertices;
+  std::array<GLuint, indexcount> indices;
+
+  void Generate(){
+    static constexpr SliceTable<Slices> table;
+    CylinderKernel(table, Slices, vertices.data(), indices.data());
+  }
+};
+
+#endif
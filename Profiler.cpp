@@ -0,0 +1,242 @@
+#ifdef PROFILER
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include "Platform.h"
+#include "Profiler.h"
+
+#define GPU_LATENCY 4  /* Frames of timestamp queries in flight before they are read back */
+
+struct ZoneSample {
+  const char *name;
+  int depth;
+  double cpubegin, cpuend;   /* Milliseconds since the profiler started */
+  double gpubegin, gpuend;   /* Same clock; negative while unknown */
+  bool queried;
+};
+
+struct FrameSample {
+  double cpubegin, cpuend;
+  GLint64 gpuclock;          /* GL_TIMESTAMP when the frame started, to line GPU time up with cpubegin */
+  int count;
+  unsigned dropped;
+  bool resolved;
+  ZoneSample zones[PROFILE_ZONES];
+};
+
+static FrameSample *frames;
+static unsigned long long framenumber;
+static int depth;
+static bool gpuenabled;
+static GLuint queries[GPU_LATENCY][2 * PROFILE_ZONES];
+static bool queriesmade;
+static const std::chrono::steady_clock::time_point profilerstart = std::chrono::steady_clock::now();
+
+static double Milliseconds(){
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - profilerstart).count();
+}
+
+static FrameSample *CurrentFrame(){
+  if(!frames){
+    frames = new FrameSample[PROFILE_FRAMES];
+    frames[0].cpubegin = Milliseconds();
+    frames[0].gpuclock = 0;
+    frames[0].count = 0;
+    frames[0].dropped = 0;
+    frames[0].resolved = false;
+  }
+  return &frames[framenumber % PROFILE_FRAMES];
+}
+
+void ProfilerEnableGPU(bool enable){
+  if(enable && !queriesmade){
+    for(int i = 0; i<GPU_LATENCY; i++)
+      glGenQueries(2 * PROFILE_ZONES, queries[i]);
+    queriesmade = true;
+  }
+  if(enable && !gpuenabled){ /* Line the current frame up with the GPU clock from here on */
+    FrameSample *frame = CurrentFrame();
+    frame->cpubegin = Milliseconds();
+    glGetInteger64v(GL_TIMESTAMP, &frame->gpuclock);
+  }
+  gpuenabled = enable;
+}
+
+ProfileScope::ProfileScope(const char *name){
+  FrameSample *frame = CurrentFrame();
+  depth++;
+  if(frame->count == PROFILE_ZONES){
+    frame->dropped++;
+    zone = -1;
+    return;
+  }
+  zone = frame->count++;
+  ZoneSample &z = frame->zones[zone];
+  z.name = name;
+  z.depth = depth - 1;
+  z.gpubegin = z.gpuend = -1;
+  z.queried = gpuenabled;
+  if(z.queried)
+    glQueryCounter(queries[framenumber % GPU_LATENCY][2 * zone], GL_TIMESTAMP);
+  z.cpubegin = Milliseconds();
+}
+
+ProfileScope::~ProfileScope(){
+  depth--;
+  if(zone < 0)
+    return;
+  FrameSample *frame = CurrentFrame();
+  ZoneSample &z = frame->zones[zone];
+  z.cpuend = Milliseconds();
+  if(z.queried)
+    glQueryCounter(queries[framenumber % GPU_LATENCY][2 * zone + 1], GL_TIMESTAMP);
+}
+
+/* Read back the timestamps of frame number f, unless they are not ready and wait is false */
+static void ResolveFrame(unsigned long long f, bool wait){
+  FrameSample &frame = frames[f % PROFILE_FRAMES];
+  if(frame.resolved)
+    return;
+  GLuint *q = queries[f % GPU_LATENCY];
+  int last = -1;
+  for(int i = 0; i<frame.count; i++)
+    if(frame.zones[i].queried)
+      last = i;
+  if(!frame.gpuclock)
+    last = -1;
+  if(last >= 0 && !wait){
+    GLint available = 0;
+    glGetQueryObjectiv(q[2 * last + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available)
+      return; /* Leave the GPU times unknown rather than stall */
+  }
+  for(int i = 0; i<=last; i++){
+    ZoneSample &z = frame.zones[i];
+    if(!z.queried)
+      continue;
+    GLuint64 begin, end;
+    glGetQueryObjectui64v(q[2 * i], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(q[2 * i + 1], GL_QUERY_RESULT, &end);
+    z.gpubegin = frame.cpubegin + (GLint64)(begin - frame.gpuclock) / 1e6;
+    z.gpuend = frame.cpubegin + (GLint64)(end - frame.gpuclock) / 1e6;
+  }
+  frame.resolved = true;
+}
+
+void ProfilerBeginFrame(){
+  FrameSample *frame = CurrentFrame();
+  if(frame->count)  /* Zones since the last frame (start-up, mode switches) keep a frame of their own */
+    ProfilerEndFrame();
+  frame = CurrentFrame();
+  frame->cpubegin = Milliseconds();
+  frame->gpuclock = 0;
+  if(gpuenabled)
+    glGetInteger64v(GL_TIMESTAMP, &frame->gpuclock);
+}
+
+void ProfilerEndFrame(){
+  FrameSample *frame = CurrentFrame();
+  frame->cpuend = Milliseconds();
+  frame->resolved = false;
+  /* The query set the next frame reuses belongs to the frame GPU_LATENCY - 1 before this one */
+  if(framenumber + 1 >= GPU_LATENCY)
+    ResolveFrame(framenumber + 1 - GPU_LATENCY, false);
+  framenumber++;
+  frame = CurrentFrame();
+  frame->cpubegin = Milliseconds();
+  frame->gpuclock = 0;
+  if(gpuenabled)
+    glGetInteger64v(GL_TIMESTAMP, &frame->gpuclock);
+  frame->count = 0;
+  frame->dropped = 0;
+  frame->resolved = false;
+}
+
+/* Frame numbers still in the ring, oldest first */
+static unsigned long long FirstFrame(){
+  return framenumber >= PROFILE_FRAMES ? framenumber - PROFILE_FRAMES + 1 : 0;
+}
+
+static void ResolvePending(){
+  for(unsigned long long f = framenumber >= GPU_LATENCY ? framenumber - GPU_LATENCY + 1 : 0; f<framenumber; f++)
+    ResolveFrame(f, gpuenabled);
+}
+
+bool WriteProfileTrace(const char *path){
+  if(!frames)
+    return false;
+  FILE *out = fopen(path, "w");
+  if(!out){
+    fprintf(stderr, "Cannot write %s\n", path);
+    return false;
+  }
+  ResolvePending();
+  fprintf(out, "{\"traceEvents\": [\n");
+  fprintf(out, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n");
+  fprintf(out, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}");
+  for(unsigned long long f = FirstFrame(); f<framenumber; f++){
+    const FrameSample &frame = frames[f % PROFILE_FRAMES];
+    fprintf(out, ",\n  {\"name\": \"Frame %llu\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"dropped\": %u}}",
+            f, frame.cpubegin * 1000, (frame.cpuend - frame.cpubegin) * 1000, frame.dropped);
+    for(int i = 0; i<frame.count; i++){
+      const ZoneSample &z = frame.zones[i];
+      fprintf(out, ",\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f}",
+              z.name, z.cpubegin * 1000, (z.cpuend - z.cpubegin) * 1000);
+      if(z.gpubegin >= 0)
+        fprintf(out, ",\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": 2, \"ts\": %.3f, \"dur\": %.3f}",
+                z.name, z.gpubegin * 1000, (z.gpuend - z.gpubegin) * 1000);
+    }
+  }
+  fprintf(out, "\n]}\n");
+  fclose(out);
+  printf("Wrote profile of %llu frames to %s\n", framenumber - FirstFrame(), path);
+  return true;
+}
+
+void PrintProfileSummary(){
+  struct Totals {
+    double cpu, gpu;
+    unsigned calls, gpucalls;
+  };
+  if(!frames || !framenumber)
+    return;
+  ResolvePending();
+  std::map<std::string, Totals> totals;
+  unsigned long long first = FirstFrame();
+  for(unsigned long long f = first; f<framenumber; f++){
+    const FrameSample &frame = frames[f % PROFILE_FRAMES];
+    for(int i = 0; i<frame.count; i++){
+      const ZoneSample &z = frame.zones[i];
+      Totals &t = totals[z.name];
+      t.cpu += z.cpuend - z.cpubegin;
+      t.calls++;
+      if(z.gpubegin >= 0){
+        t.gpu += z.gpuend - z.gpubegin;
+        t.gpucalls++;
+      }
+    }
+  }
+  double n = framenumber - first;
+  printf("%-24s %10s %12s %12s\n", "zone", "calls/frame", "cpu ms/frame", "gpu ms/frame");
+  for(std::map<std::string, Totals>::iterator it = totals.begin(); it != totals.end(); ++it){
+    printf("%-24s %10.1f %12.3f ", it->first.c_str(), it->second.calls / n, it->second.cpu / n);
+    if(it->second.gpucalls)
+      printf("%12.3f\n", it->second.gpu / n);
+    else
+      printf("%12s\n", "-");
+  }
+}
+
+void ReleaseProfiler(){
+  if(queriesmade)
+    for(int i = 0; i<GPU_LATENCY; i++)
+      glDeleteQueries(2 * PROFILE_ZONES, queries[i]);
+  queriesmade = false;
+  gpuenabled = false;
+  delete[] frames;
+  frames = NULL;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+/*
+   Scoped frame profiler. PROFILE_ZONE("name") times the rest of the enclosing block on the CPU and,
+   once ProfilerEnableGPU has been called with a current context, on the GPU through timestamp
+   queries. Zones nest. Each frame between ProfilerBeginFrame and ProfilerEndFrame goes into a ring
+   of the last PROFILE_FRAMES frames; GPU times are read a few frames late so nothing waits on the
+   GPU. Zone names must outlive the profiler (string literals or mesh names). Main thread only.
+
+   Everything here compiles to nothing unless PROFILER is defined (premake4 --profiler gmake).
+ */
+
+#define PROFILE_FRAMES 256
+#define PROFILE_ZONES 512    /* Per frame; zones past this are counted but not kept */
+
+#ifdef PROFILER
+
+struct ProfileScope {
+  ProfileScope(const char *name);
+  ~ProfileScope();
+  int zone;
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) ProfileScope PROFILE_CONCAT(profilescope, __LINE__)(name)
+
+void ProfilerEnableGPU(bool enable);
+void ProfilerBeginFrame();
+void ProfilerEndFrame();
+/* Write the frames in the ring as Chrome trace events (chrome://tracing, ui.perfetto.dev) */
+bool WriteProfileTrace(const char *path);
+/* Print the mean CPU and GPU milliseconds per frame of every zone name */
+void PrintProfileSummary();
+/* Delete the query objects */
+void ReleaseProfiler();
+
+#else
+
+#define PROFILE_ZONE(name)
+
+inline void ProfilerEnableGPU(bool) {}
+inline void ProfilerBeginFrame() {}
+inline void ProfilerEndFrame() {}
+inline bool WriteProfileTrace(const char *) { return false; }
+inline void PrintProfileSummary() {}
+inline void ReleaseProfiler() {}
+
+#endif
+
+#endif
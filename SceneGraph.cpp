@@ -0,0 +1,217 @@
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include "SceneGraph.h"
+#include "MatrixBatch.h"
+#include "ThreadPool.h"
+
+static std::vector<SceneNode> nodes;
+static std::vector<int> roots, dirtynodes;
+
+int AddSceneNode(int parent, const glm::mat4 &local, const Mesh *mesh){
+  SceneNode node;
+  node.local = local;
+  node.world = local;
+  node.bounds = glm::vec4(0.f, 0.f, 0.f, -1.f);
+  node.mesh = mesh;
+  node.parent = parent;
+  node.dirty = false;
+  int index = nodes.size();
+  nodes.push_back(node);
+  if(parent >= 0)
+    nodes[parent].children.push_back(index);
+  else
+    roots.push_back(index);
+  SetSceneNodeTransform(index, local);
+  return index;
+}
+
+void SetSceneNodeTransform(int node, const glm::mat4 &local){
+  nodes[node].local = local;
+  if(!nodes[node].dirty){
+    nodes[node].dirty = true;
+    dirtynodes.push_back(node);
+  }
+}
+
+const SceneNode &GetSceneNode(int node){
+  return nodes[node];
+}
+
+size_t SceneNodeCount(){
+  return nodes.size();
+}
+
+/* Smallest sphere around spheres a and b */
+static glm::vec4 MergeSpheres(const glm::vec4 &a, const glm::vec4 &b){
+  if(a.w < 0)
+    return b;
+  if(b.w < 0)
+    return a;
+  float dx = b.x - a.x, dy = b.y - a.y, dz = b.z - a.z;
+  float d = sqrtf(dx * dx + dy * dy + dz * dz);
+  if(d + b.w <= a.w)
+    return a;
+  if(d + a.w <= b.w)
+    return b;
+  float r = (d + a.w + b.w) / 2;
+  float t = (r - a.w) / d;
+  return glm::vec4(a.x + dx * t, a.y + dy * t, a.z + dz * t, r);
+}
+
+/* The mesh's sphere moved into world space. Non-uniform scale is covered by the largest axis. */
+static glm::vec4 MeshBounds(const SceneNode &node){
+  if(!node.mesh)
+    return glm::vec4(0.f, 0.f, 0.f, -1.f);
+  const GLfloat *b = node.mesh->bounds;
+  glm::vec4 c = node.world * glm::vec4(b[0], b[1], b[2], 1.f);
+  float scale = 0;
+  for(int i = 0; i<3; i++){
+    const glm::vec4 &axis = node.world[i];
+    scale = std::max(scale, axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+  }
+  return glm::vec4(c.x, c.y, c.z, b[3] * sqrtf(scale));
+}
+
+static void ComputeBounds(SceneNode &node){
+  node.bounds = MeshBounds(node);
+  for(size_t i = 0; i<node.children.size(); i++)
+    node.bounds = MergeSpheres(node.bounds, nodes[node.children[i]].bounds);
+}
+
+/* Compose the children's world matrices in batches, then recurse; node's own world is current */
+static void UpdateChildren(int index){
+  SceneNode &node = nodes[index];
+  node.dirty = false;
+  size_t count = node.children.size();
+  for(size_t i = 0; i<count; i += MATRIX_BATCH){
+    glm::mat4 locals[MATRIX_BATCH], worlds[MATRIX_BATCH];
+    size_t n = std::min(count - i, (size_t)MATRIX_BATCH);
+    for(size_t k = 0; k<n; k++)
+      locals[k] = nodes[node.children[i + k]].local;
+    MultiplyMatrices(&node.world, 0, locals, 1, worlds, n);
+    for(size_t k = 0; k<n; k++)
+      nodes[node.children[i + k]].world = worlds[k];
+  }
+  for(size_t i = 0; i<count; i++)
+    UpdateChildren(node.children[i]);
+  ComputeBounds(node);
+}
+
+static void UpdateSubtree(int index){
+  SceneNode &node = nodes[index];
+  node.world = node.parent >= 0 ? nodes[node.parent].world * node.local : node.local;
+  UpdateChildren(index);
+}
+
+/* Dirty subtrees redone per parallel chunk; a rocket is small, so this many go together */
+#define UPDATE_GRAIN 16
+/* Root clusters culled per parallel chunk */
+#define CULL_GRAIN 4
+
+static std::vector<int> updateroots, ancestors;
+
+void UpdateScene(){
+  if(dirtynodes.empty())
+    return;
+  /* Only dirty nodes with no dirty ancestor start a subtree. Those subtrees are disjoint and
+     read nothing outside themselves but their clean parents, so they are redone in parallel. */
+  updateroots.clear();
+  for(size_t i = 0; i<dirtynodes.size(); i++){
+    int p = nodes[dirtynodes[i]].parent;
+    while(p >= 0 && !nodes[p].dirty)
+      p = nodes[p].parent;
+    if(p < 0)
+      updateroots.push_back(dirtynodes[i]);
+  }
+  ParallelFor(updateroots.size(), UPDATE_GRAIN, [](size_t begin, size_t end){
+    for(size_t i = begin; i<end; i++)
+      UpdateSubtree(updateroots[i]);
+  });
+  /* The ancestors' bounds are shared between subtrees, so they are merged afterwards, each once.
+     dirty marks the ones already listed, and a parent always has a lower index than its
+     children, so going down the indices finishes every child before its parent. */
+  ancestors.clear();
+  for(size_t i = 0; i<updateroots.size(); i++)
+    for(int p = nodes[updateroots[i]].parent; p >= 0 && !nodes[p].dirty; p = nodes[p].parent){
+      nodes[p].dirty = true;
+      ancestors.push_back(p);
+    }
+  std::sort(ancestors.begin(), ancestors.end());
+  for(size_t i = ancestors.size(); i-- > 0; ){
+    ComputeBounds(nodes[ancestors[i]]);
+    nodes[ancestors[i]].dirty = false;
+  }
+  dirtynodes.clear();
+}
+
+/* Frustum planes of a column-major matrix, normalised, pointing inwards (Gribb and Hartmann) */
+static void FrustumPlanes(const glm::mat4 &m, glm::vec4 planes[6]){
+  for(int i = 0; i<3; i++){
+    glm::vec4 row(m[0][i], m[1][i], m[2][i], m[3][i]), w(m[0][3], m[1][3], m[2][3], m[3][3]);
+    planes[2 * i] = w + row;
+    planes[2 * i + 1] = w - row;
+  }
+  for(int i = 0; i<6; i++){
+    glm::vec4 &p = planes[i];
+    p = p * (1.f / sqrtf(p.x * p.x + p.y * p.y + p.z * p.z));
+  }
+}
+
+static void AcceptSubtree(int index, std::vector<int> &visible){
+  const SceneNode &node = nodes[index];
+  if(node.mesh)
+    visible.push_back(index);
+  for(size_t i = 0; i<node.children.size(); i++)
+    AcceptSubtree(node.children[i], visible);
+}
+
+static size_t CullSubtree(int index, const glm::vec4 planes[6], std::vector<int> &visible){
+  const SceneNode &node = nodes[index];
+  const glm::vec4 &s = node.bounds;
+  if(s.w < 0)
+    return 1;
+  bool inside = true;
+  for(int i = 0; i<6; i++){
+    float d = planes[i].x * s.x + planes[i].y * s.y + planes[i].z * s.z + planes[i].w;
+    if(d < -s.w)
+      return 1;
+    if(d < s.w)
+      inside = false;
+  }
+  if(inside){
+    AcceptSubtree(index, visible);
+    return 1;
+  }
+  size_t tested = 1;
+  if(node.mesh)
+    visible.push_back(index);
+  for(size_t i = 0; i<node.children.size(); i++)
+    tested += CullSubtree(node.children[i], planes, visible);
+  return tested;
+}
+
+static ThreadBuffers<int> visiblebuffers;
+
+size_t CullScene(const glm::mat4 &viewprojection, std::vector<int> &visible){
+  glm::vec4 planes[6];
+  FrustumPlanes(viewprojection, planes);
+  std::atomic<size_t> tested(0);
+  visiblebuffers.Reset();
+  ParallelFor(roots.size(), CULL_GRAIN, [&](size_t begin, size_t end){
+    std::vector<int> &out = visiblebuffers.Begin(begin / CULL_GRAIN);
+    size_t n = 0;
+    for(size_t i = begin; i<end; i++)
+      n += CullSubtree(roots[i], planes, out);
+    visiblebuffers.End();
+    tested += n;
+  });
+  visiblebuffers.Merge(visible);
+  return tested;
+}
+
+void ClearScene(){
+  nodes.clear();
+  roots.clear();
+  dirtynodes.clear();
+}
@@ -0,0 +1,41 @@
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+/*
+   Scene graph of transform nodes. Each node caches its world matrix and a world-space bounding
+   sphere that encloses its mesh and all of its descendants. Changing a node's local transform
+   marks it dirty; UpdateScene then recomputes that subtree and the bounds of its ancestors and
+   nothing else, so a static scene costs nothing per frame. CullScene walks down from the roots,
+   dropping a whole subtree as soon as its sphere is outside the frustum and accepting a whole
+   subtree without further tests once its sphere is inside, so the work per frame follows the
+   number of visible nodes rather than the size of the scene.
+
+   Both passes run on the thread pool: UpdateScene redoes independent dirty subtrees in parallel,
+   composing each node's children in SIMD batches, and CullScene culls the roots in parallel into
+   per-thread lists that are merged in root order, so the result never depends on the threads.
+ */
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+struct SceneNode {
+  glm::mat4 local, world;
+  glm::vec4 bounds;        /* World-space sphere around the subtree: centre xyz, radius w. Radius < 0 if empty. */
+  const Mesh *mesh;        /* NULL for group nodes */
+  int parent;              /* -1 for roots */
+  std::vector<int> children;
+  bool dirty;
+};
+
+/* Add a node under parent (-1 for a root) and return its index */
+int AddSceneNode(int parent, const glm::mat4 &local, const Mesh *mesh);
+void SetSceneNodeTransform(int node, const glm::mat4 &local);
+const SceneNode &GetSceneNode(int node);
+/* Bring world matrices and bounds of dirty nodes up to date */
+void UpdateScene();
+/* Append the nodes with meshes whose bounds touch the frustum of viewprojection to visible, in
+   the order they were added. Returns the number of nodes tested. */
+size_t CullScene(const glm::mat4 &viewprojection, std::vector<int> &visible);
+size_t SceneNodeCount();
+void ClearScene();
+
+#endif
@@ -0,0 +1,649 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include "ShaderCache.h"
+#include "AsyncLoader.h"
+#include "Mesh.h"
+
+static const char *uniformnames[UNIFORM_COUNT] = {
+  "mvpmatrix",
+  "viewprojection",
+  "view",
+  "projection",
+  "axis",
+  "viewport",
+  "edgepixels",
+  "modelview",
+  "clusters",
+  "lightindices",
+  "lights",
+  "clustergrid",
+  "clusterdepth",
+  "alllights"
+};
+
+static const unsigned int binarymagic = 0x42504c47; /* "GLPB" */
+
+/* The stages a program may have, in pipeline order. Programs without tessellation leave the
+   middle two out. */
+#define SHADER_STAGES 4
+static const GLenum stagetypes[SHADER_STAGES] = {
+  GL_VERTEX_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER, GL_FRAGMENT_SHADER
+};
+
+/* The program each set of stage files (a "pair", as most have just a vertex and a fragment
+   shader) currently builds */
+struct ProgramFiles {
+  std::string files[SHADER_STAGES]; /* Empty for a stage the program does not have */
+  unsigned long long hash;  /* Program in use, 0 until the first build is done */
+  unsigned generation;      /* Counts builds started, so a stale one finishing late is not adopted */
+  bool loading;             /* A build is under way */
+  bool failed;              /* The last build failed; wait for the files to change */
+};
+
+/* A build between the loader thread reading its files and the program linking */
+struct PendingProgram {
+  std::string pair;
+  unsigned generation;
+  bool binaries;                         /* Look for a cached binary; decided on the render thread */
+  std::string files[SHADER_STAGES];
+  char *sources[SHADER_STAGES];          /* Filled in by the loader thread; NULL for absent stages */
+  bool missing;                          /* A file could not be read */
+  unsigned long long hash;
+  unsigned int binaryformat;
+  std::vector<char> binary;              /* Empty when there is no cached binary */
+  ShaderProgram p;
+  GLuint shaders[SHADER_STAGES];
+  double start;
+};
+
+/* Programs by source hash, and the files of each pair already seen */
+static std::map<unsigned long long, ShaderProgram> programs;
+static std::map<std::string, ProgramFiles> filepairs;
+static std::vector<PendingProgram *> loaded, building;
+static std::vector<unsigned long long> superseded; /* Programs hot reloads replaced, until deleted */
+static std::map<std::string, bool> watchedfiles;
+static bool binarycache = true, hotreload = false;
+
+static double Seconds(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+char* filetobuf(const char *file) { /* A simple function that will read a file into an allocated char pointer buffer */
+  FILE *fptr;
+  long length;
+  char *buf;
+  fprintf(stderr, "Loading %s\n", file);
+        #pragma warning (disable : 4996)
+  fptr = fopen(file, "rb");   /* Open file for reading */
+  if (!fptr) {   /* Return NULL on failure */
+    fprintf(stderr, "failed to open %s\n", file);
+    return NULL;
+  }
+  fseek(fptr, 0, SEEK_END);   /* Seek to the end of the file */
+  length = ftell(fptr);   /* Find out how many bytes into the file we are */
+  buf = (char*)malloc(length + 1);   /* Allocate a buffer for the entire length of the file and a null terminator */
+  fseek(fptr, 0, SEEK_SET);   /* Go back to the beginning of the file */
+  fread(buf, length, 1, fptr);   /* Read the contents of the file in to the buffer */
+  fclose(fptr);   /* Close the file */
+  buf[length] = 0;   /* Null terminator */
+  return buf;   /* Return the buffer */
+}
+
+/* 64-bit FNV-1a, chained through h so several strings can be hashed in sequence */
+static unsigned long long Hash(const char *s, unsigned long long h){
+  for(; *s; s++){
+    h ^= (unsigned char)*s;
+    h *= 0x100000001b3ULL;
+  }
+  h ^= 0xff; /* Separator, so "ab"+"c" and "a"+"bc" differ */
+  h *= 0x100000001b3ULL;
+  return h;
+}
+
+/* Binaries only load on the driver that produced them, so the driver is part of every key */
+static unsigned long long DriverHash(){
+  static unsigned long long hash = 0;
+  if(!hash){
+    hash = 0xcbf29ce484222325ULL;
+    hash = Hash((const char*)glGetString(GL_RENDERER), hash);
+    hash = Hash((const char*)glGetString(GL_VERSION), hash);
+  }
+  return hash;
+}
+
+void CheckShader(int sp, const char *x){
+  int length;
+  char text[1001];
+  glGetProgramInfoLog(sp, 1000, &length, text);   // Check for errors
+  if(length > 0) {
+    fprintf(stderr, "Validate Shader Program\nMessage from:%s\n%s\n", x, text );
+    exit(1);
+  }
+}
+
+/* Read each stage's file; false, with whatever was read freed, if one is missing */
+static bool ReadSources(const std::string files[SHADER_STAGES], char *sources[SHADER_STAGES]){
+  bool ok = true;
+  for(int i = 0; i<SHADER_STAGES; i++){
+    sources[i] = files[i].empty() ? NULL : filetobuf(files[i].c_str());
+    ok = ok && (files[i].empty() || sources[i]);
+  }
+  if(!ok)
+    for(int i = 0; i<SHADER_STAGES; i++){
+      free(sources[i]);
+      sources[i] = NULL;
+    }
+  return ok;
+}
+
+/* The sources in stage order, so a vertex and fragment program hashes as it always has */
+static unsigned long long HashSources(char *const sources[SHADER_STAGES], unsigned long long driver){
+  unsigned long long hash = driver;
+  for(int i = 0; i<SHADER_STAGES; i++)
+    if(sources[i])
+      hash = Hash(sources[i], hash);
+  return hash;
+}
+
+static void FreeSources(char *sources[SHADER_STAGES]){
+  for(int i = 0; i<SHADER_STAGES; i++){
+    free(sources[i]);
+    sources[i] = NULL;
+  }
+}
+
+static GLuint CompileShader(GLenum type, const char *source, const char *name){
+  GLint status;
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, (const GLchar**)&source, 0);
+  glCompileShader(shader);
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if(!status){
+    char text[1001];
+    glGetShaderInfoLog(shader, 1000, NULL, text);
+    fprintf(stderr, "Failed to compile %s\n%s\n", name, text);
+    exit(1);
+  }
+  return shader;
+}
+
+static bool BinariesSupported(){
+#ifndef __APPLE__
+  if(!GLEW_ARB_get_program_binary)
+    return false;
+#endif
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+static void BinaryPath(unsigned long long hash, char *path, size_t size){
+  snprintf(path, size, "shadercache-%016llx.bin", hash);
+}
+
+/* Read a binary saved by an earlier run. Fails quietly when the file is missing or damaged.
+   Makes no GL calls, so the loader thread can do it. */
+static bool ReadBinary(unsigned long long hash, unsigned int *format, std::vector<char> &binary){
+  char path[64];
+  BinaryPath(hash, path, sizeof(path));
+  FILE *f = fopen(path, "rb");
+  if(!f)
+    return false;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned int header[3]; /* magic, format, length */
+  bool ok = fread(header, sizeof(header), 1, f) == 1 && header[0] == binarymagic;
+  /* Check the length against the file before allocating it, so a damaged one is just a miss */
+  ok = ok && header[2] > 0 && size >= (long)sizeof(header) && header[2] <= (unsigned long)(size - sizeof(header));
+  if(ok){
+    binary.resize(header[2]);
+    ok = fread(binary.data(), header[2], 1, f) == 1;
+    *format = header[1];
+  }
+  fclose(f);
+  if(!ok)
+    binary.clear();
+  return ok;
+}
+
+/* Create the program from a binary, or fail when the driver rejects it, in which case the caller
+   compiles from source.
+ */
+static bool ProgramFromBinary(ShaderProgram *p, unsigned int format, const std::vector<char> &binary){
+  GLint status;
+  p->program = glCreateProgram();
+  glProgramBinary(p->program, format, binary.data(), binary.size());
+  glGetProgramiv(p->program, GL_LINK_STATUS, &status);
+  if(!status){
+    char path[64];
+    BinaryPath(p->hash, path, sizeof(path));
+    fprintf(stderr, "Discarding stale program binary %s\n", path);
+    glDeleteProgram(p->program);
+    return false;
+  }
+  return true;
+}
+
+static bool LoadBinary(ShaderProgram *p){
+  unsigned int format;
+  std::vector<char> binary;
+  return ReadBinary(p->hash, &format, binary) && ProgramFromBinary(p, format, binary);
+}
+
+static void SaveBinary(const ShaderProgram *p){
+  GLint length = 0;
+  GLenum format;
+  glGetProgramiv(p->program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if(length <= 0)
+    return;
+  std::vector<char> binary(length);
+  glGetProgramBinary(p->program, length, NULL, &format, binary.data());
+  char path[64];
+  BinaryPath(p->hash, path, sizeof(path));
+  FILE *f = fopen(path, "wb");
+  if(!f)
+    return;
+  unsigned int header[3] = {binarymagic, format, (unsigned int)length};
+  fwrite(header, sizeof(header), 1, f);
+  fwrite(binary.data(), length, 1, f);
+  fclose(f);
+}
+
+/* Attribute locations and hints every program is linked with */
+static void BindAttributes(GLuint program){
+  glBindAttribLocation(program, 0, "in_Position");   /* Bind attribute 0 (coordinates) to in_Position and attribute 1 (colors) to in_Color */
+  glBindAttribLocation(program, 1, "in_Color");
+  glBindAttribLocation(program, 2, "in_Model");   /* Instanced shaders only; a mat4 takes attributes 2 to 5 */
+  glBindAttribLocation(program, NORMAL_ATTRIBUTE, "in_Normal");
+  if(binarycache && BinariesSupported())
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+static void ResolveUniforms(ShaderProgram *p){
+  for(int i = 0; i<UNIFORM_COUNT; i++)
+    p->uniforms[i] = glGetUniformLocation(p->program, uniformnames[i]);
+}
+
+static void BuildProgram(ShaderProgram *p, char *const sources[SHADER_STAGES], const char *name){
+  double start = Seconds();
+  GLuint shaders[SHADER_STAGES];
+  int i;
+  for(i = 0; i<SHADER_STAGES; i++)
+    shaders[i] = sources[i] ? CompileShader(stagetypes[i], sources[i], name) : 0;
+  double compiled = Seconds();
+  p->program = glCreateProgram();
+  for(i = 0; i<SHADER_STAGES; i++)  /* Attach our shaders to our program */
+    if(shaders[i])
+      glAttachShader(p->program, shaders[i]);
+  BindAttributes(p->program);
+  glLinkProgram(p->program);
+  CheckShader(p->program, name);
+  /* The program keeps its own copy of the code, so the shader objects can go */
+  for(i = 0; i<SHADER_STAGES; i++)
+    if(shaders[i]){
+      glDetachShader(p->program, shaders[i]);
+      glDeleteShader(shaders[i]);
+    }
+  p->compileseconds = compiled - start;
+  p->linkseconds = Seconds() - compiled;
+}
+
+static void Reload(const std::string &file);
+
+/* The entry for a set of stage files (NULL for absent stages), created (and its files watched)
+   on first use */
+static ProgramFiles &FilePair(const char *const stagefiles[SHADER_STAGES], std::string &pair){
+  int i;
+  pair.clear();
+  for(i = 0; i<SHADER_STAGES; i++)
+    if(stagefiles[i])
+      pair += (pair.empty() ? "" : "+") + std::string(stagefiles[i]);
+  std::map<std::string, ProgramFiles>::iterator known = filepairs.find(pair);
+  if(known != filepairs.end())
+    return known->second;
+  ProgramFiles &files = filepairs[pair];
+  for(i = 0; i<SHADER_STAGES; i++)
+    files.files[i] = stagefiles[i] ? stagefiles[i] : "";
+  files.hash = 0;
+  files.generation = 0;
+  files.loading = files.failed = false;
+  if(hotreload)
+    for(i = 0; i<SHADER_STAGES; i++)
+      if(!files.files[i].empty() && !watchedfiles[files.files[i]]){
+        std::string file = files.files[i];
+        watchedfiles[file] = true;
+        WatchFile(file.c_str(), [file]{ Reload(file); });
+      }
+  return files;
+}
+
+/* Make hash the program of files. True when it replaces a different program. */
+static bool Adopt(ProgramFiles &files, unsigned long long hash){
+  bool replaced = files.hash && files.hash != hash;
+  files.hash = hash;
+  files.loading = files.failed = false;
+  return replaced;
+}
+
+static const ShaderProgram *GetProgram(const char *const stagefiles[SHADER_STAGES]){
+  std::string pair;
+  ProgramFiles &files = FilePair(stagefiles, pair);
+  if(files.hash)
+    return &programs[files.hash];
+
+  char *sources[SHADER_STAGES];
+  if(!ReadSources(files.files, sources)){
+    fprintf(stderr, "Cannot build program %s\n", pair.c_str());
+    exit(1);
+  }
+  unsigned long long hash = HashSources(sources, DriverHash());
+  files.generation++; /* Supersedes any asynchronous build of the same pair */
+  Adopt(files, hash);
+
+  if(programs.count(hash)){
+    FreeSources(sources);
+    return &programs[hash];
+  }
+
+  ShaderProgram &p = programs[hash];
+  p.hash = hash;
+  p.compileseconds = 0;
+  double start = Seconds();
+  p.frombinary = binarycache && BinariesSupported() && LoadBinary(&p);
+  if(p.frombinary){
+    p.linkseconds = Seconds() - start;
+    printf("Loaded program %s from binary cache in %.2f ms\n", pair.c_str(), p.linkseconds * 1000);
+  } else {
+    BuildProgram(&p, sources, pair.c_str());
+    printf("Built program %s: compile %.2f ms, link %.2f ms\n", pair.c_str(), p.compileseconds * 1000, p.linkseconds * 1000);
+    if(binarycache && BinariesSupported())
+      SaveBinary(&p);
+  }
+  FreeSources(sources);
+  ResolveUniforms(&p);
+  return &p;
+}
+
+const ShaderProgram *GetShaderProgram(const char *vertexfile, const char *fragmentfile){
+  const char *stagefiles[SHADER_STAGES] = {vertexfile, NULL, NULL, fragmentfile};
+  return GetProgram(stagefiles);
+}
+
+const ShaderProgram *GetTessellationProgram(const char *vertexfile, const char *controlfile, const char *evaluationfile, const char *fragmentfile){
+  const char *stagefiles[SHADER_STAGES] = {vertexfile, controlfile, evaluationfile, fragmentfile};
+  return GetProgram(stagefiles);
+}
+
+/* Read the files of pair on the loader thread and queue the build for UpdateShaderPrograms */
+static void StartLoad(const std::string &pair, ProgramFiles &files){
+  PendingProgram *b = new PendingProgram;
+  b->pair = pair;
+  b->generation = ++files.generation;
+  b->binaries = binarycache && BinariesSupported();
+  for(int i = 0; i<SHADER_STAGES; i++){
+    b->files[i] = files.files[i];
+    b->sources[i] = NULL;
+    b->shaders[i] = 0;
+  }
+  b->missing = false;
+  b->hash = 0;
+  b->p.program = 0;
+  unsigned long long driver = DriverHash();
+  files.loading = true;
+  RunAsync([b, driver]{
+    b->missing = !ReadSources(b->files, b->sources);
+    if(b->missing)
+      return;
+    b->hash = HashSources(b->sources, driver);
+    if(b->binaries)
+      ReadBinary(b->hash, &b->binaryformat, b->binary);
+  }, [b]{ loaded.push_back(b); });
+}
+
+static void Reload(const std::string &file){
+  for(std::map<std::string, ProgramFiles>::iterator it = filepairs.begin(); it != filepairs.end(); ++it){
+    ProgramFiles &files = it->second;
+    bool uses = false;
+    for(int i = 0; i<SHADER_STAGES; i++)
+      uses = uses || files.files[i] == file;
+    if((files.hash || files.failed) && uses){
+      printf("Reloading %s for %s\n", file.c_str(), it->first.c_str());
+      StartLoad(it->first, files);
+    }
+  }
+}
+
+static const ShaderProgram *RequestProgram(const char *const stagefiles[SHADER_STAGES]){
+  std::string pair;
+  ProgramFiles &files = FilePair(stagefiles, pair);
+  if(files.hash)
+    return &programs[files.hash];
+  if(!files.loading && !files.failed)
+    StartLoad(pair, files);
+  return NULL;
+}
+
+const ShaderProgram *RequestShaderProgram(const char *vertexfile, const char *fragmentfile){
+  const char *stagefiles[SHADER_STAGES] = {vertexfile, NULL, NULL, fragmentfile};
+  return RequestProgram(stagefiles);
+}
+
+const ShaderProgram *RequestTessellationProgram(const char *vertexfile, const char *controlfile, const char *evaluationfile, const char *fragmentfile){
+  const char *stagefiles[SHADER_STAGES] = {vertexfile, controlfile, evaluationfile, fragmentfile};
+  return RequestProgram(stagefiles);
+}
+
+static bool ParallelCompileSupported(){
+#ifdef __APPLE__
+  return false;
+#else
+  return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+#endif
+}
+
+/* Submit the compile and link without asking for their status, which would wait for them */
+static void StartBuild(PendingProgram *b){
+#ifndef __APPLE__
+  static bool threads = false;
+  if(!threads && ParallelCompileSupported()){ /* As many compiler threads as the driver likes */
+    if(GLEW_KHR_parallel_shader_compile)
+      glMaxShaderCompilerThreadsKHR(0xffffffff);
+    else
+      glMaxShaderCompilerThreadsARB(0xffffffff);
+    threads = true;
+  }
+#endif
+  b->start = Seconds();
+  for(int i = 0; i<SHADER_STAGES; i++)
+    if(b->sources[i]){
+      b->shaders[i] = glCreateShader(stagetypes[i]);
+      glShaderSource(b->shaders[i], 1, (const GLchar**)&b->sources[i], 0);
+      glCompileShader(b->shaders[i]);
+    }
+  b->p.program = glCreateProgram();
+  for(int i = 0; i<SHADER_STAGES; i++)
+    if(b->shaders[i])
+      glAttachShader(b->p.program, b->shaders[i]);
+  BindAttributes(b->p.program);
+  glLinkProgram(b->p.program);
+}
+
+static bool BuildDone(PendingProgram *b){
+#ifndef __APPLE__
+  if(ParallelCompileSupported()){
+    GLint done = GL_TRUE;
+    glGetProgramiv(b->p.program, GL_COMPLETION_STATUS_KHR, &done);
+    return done;
+  }
+#endif
+  return true;
+}
+
+/* Check the link, reporting any compile errors instead of exiting as GetShaderProgram does */
+static bool FinishBuild(PendingProgram *b){
+  GLint status;
+  glGetProgramiv(b->p.program, GL_LINK_STATUS, &status);
+  if(!status){
+    char text[1001];
+    for(int i = 0; i<SHADER_STAGES; i++){
+      if(!b->shaders[i])
+        continue;
+      glGetShaderiv(b->shaders[i], GL_COMPILE_STATUS, &status);
+      if(!status){
+        glGetShaderInfoLog(b->shaders[i], 1000, NULL, text);
+        fprintf(stderr, "Failed to compile %s\n%s\n", b->files[i].c_str(), text);
+      }
+    }
+    glGetProgramInfoLog(b->p.program, 1000, NULL, text);
+    fprintf(stderr, "Failed to link %s\n%s\n", b->pair.c_str(), text);
+    glDeleteProgram(b->p.program);
+    status = GL_FALSE;
+  }
+  for(int i = 0; i<SHADER_STAGES; i++)
+    if(b->shaders[i]){
+      if(status)
+        glDetachShader(b->p.program, b->shaders[i]);
+      glDeleteShader(b->shaders[i]);
+      b->shaders[i] = 0;
+    }
+  return status != 0;
+}
+
+/* Record the outcome of b and free it. True when a program in use was replaced. */
+static bool EndLoad(PendingProgram *b, bool built){
+  ProgramFiles &files = filepairs[b->pair];
+  bool current = b->generation == files.generation;
+  bool replaced = false;
+  if(built && b->p.program){
+    if(programs.count(b->hash)) /* Another build of the same sources got there first */
+      glDeleteProgram(b->p.program);
+    else {
+      ShaderProgram &p = programs[b->hash];
+      p = b->p;
+      ResolveUniforms(&p);
+    }
+  }
+  if(current){
+    if(built){
+      unsigned long long old = files.hash;
+      replaced = Adopt(files, b->hash);
+      if(replaced)
+        superseded.push_back(old);
+    } else {
+      files.loading = false;
+      files.failed = true;
+      if(files.hash)
+        fprintf(stderr, "Keeping the previous program for %s\n", b->pair.c_str());
+    }
+  }
+  FreeSources(b->sources);
+  delete b;
+  return replaced;
+}
+
+bool UpdateShaderPrograms(){
+  bool replaced = false;
+  size_t i, n;
+  for(i = 0; i<loaded.size(); i++){
+    PendingProgram *b = loaded[i];
+    if(b->missing){
+      fprintf(stderr, "Cannot build program %s\n", b->pair.c_str());
+      replaced |= EndLoad(b, false);
+      continue;
+    }
+    if(programs.count(b->hash)){ /* Unchanged sources, or the same as another pair */
+      replaced |= EndLoad(b, true);
+      continue;
+    }
+    b->p.hash = b->hash;
+    b->p.compileseconds = 0;
+    double start = Seconds();
+    b->p.frombinary = !b->binary.empty() && ProgramFromBinary(&b->p, b->binaryformat, b->binary);
+    if(b->p.frombinary){
+      b->p.linkseconds = Seconds() - start;
+      printf("Loaded program %s from binary cache in %.2f ms\n", b->pair.c_str(), b->p.linkseconds * 1000);
+      replaced |= EndLoad(b, true);
+      continue;
+    }
+    StartBuild(b);
+    building.push_back(b);
+  }
+  loaded.clear();
+
+  /* Without KHR_parallel_shader_compile every build is done by now, at the cost of this frame */
+  for(i = 0, n = 0; i<building.size(); i++){
+    PendingProgram *b = building[i];
+    if(!BuildDone(b)){
+      building[n++] = b;
+      continue;
+    }
+    bool built = FinishBuild(b);
+    if(built){
+      b->p.linkseconds = Seconds() - b->start;
+      printf("Built program %s in %.2f ms\n", b->pair.c_str(), b->p.linkseconds * 1000);
+      if(binarycache && BinariesSupported())
+        SaveBinary(&b->p);
+    }
+    replaced |= EndLoad(b, built);
+  }
+  building.resize(n);
+  return replaced;
+}
+
+void ReleaseSupersededPrograms(const ShaderProgram *const *inuse, int count){
+  size_t i, n;
+  for(i = 0, n = 0; i<superseded.size(); i++){
+    unsigned long long hash = superseded[i];
+    std::map<unsigned long long, ShaderProgram>::iterator it = programs.find(hash);
+    if(it == programs.end())
+      continue;
+    bool used = false;
+    for(int k = 0; k<count && !used; k++)
+      used = inuse[k] == &it->second;
+    for(std::map<std::string, ProgramFiles>::iterator f = filepairs.begin(); f != filepairs.end() && !used; ++f)
+      used = f->second.hash == hash; /* Another pair builds the same sources, or this one went back to them */
+    if(used){
+      superseded[n++] = hash;
+      continue;
+    }
+    glDeleteProgram(it->second.program);
+    programs.erase(it);
+  }
+  superseded.resize(n);
+}
+
+void SetShaderHotReload(bool enabled){
+  hotreload = enabled;
+}
+
+void SetProgramBinaryCache(bool enabled){
+  binarycache = enabled;
+}
+
+void ReleaseShaderPrograms(){
+  for(std::map<unsigned long long, ShaderProgram>::iterator it = programs.begin(); it != programs.end(); ++it)
+    glDeleteProgram(it->second.program);
+  for(size_t i = 0; i<loaded.size(); i++){
+    FreeSources(loaded[i]->sources);
+    delete loaded[i];
+  }
+  for(size_t i = 0; i<building.size(); i++){
+    glDeleteProgram(building[i]->p.program);
+    for(int s = 0; s<SHADER_STAGES; s++)
+      if(building[i]->shaders[s])
+        glDeleteShader(building[i]->shaders[s]);
+    FreeSources(building[i]->sources);
+    delete building[i];
+  }
+  loaded.clear();
+  building.clear();
+  superseded.clear();
+  programs.clear();
+  filepairs.clear();
+}
@@ -0,0 +1,65 @@
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+/*
+   Shader program cache. Programs are keyed by a hash of their sources (and the GL driver), built
+   once per run, and persisted with glGetProgramBinary so a warm start skips compilation. Uniform
+   locations are resolved once at link time instead of before every draw.
+
+   RequestShaderProgram builds without stalling a frame: the files are read and hashed on the
+   AsyncLoader thread, and UpdateShaderPrograms loads or compiles the program at the next frame
+   boundary, leaving the compile to the driver's own threads where KHR_parallel_shader_compile
+   is supported. With hot reload on, rewriting a shader file rebuilds every program that uses it
+   the same way; the old program stays in use until the new one links, and one that fails to
+   compile is reported and dropped.
+ */
+#include "Platform.h"
+
+/* Uniforms the shaders may declare; locations are -1 for the ones a program does not use */
+enum Uniform {
+  UNIFORM_MVPMATRIX,
+  UNIFORM_VIEWPROJECTION,
+  UNIFORM_VIEW,
+  UNIFORM_PROJECTION,
+  UNIFORM_AXIS,        /* These three are set for patches.tesc and patches.tese */
+  UNIFORM_VIEWPORT,    /* clustered.frag uses it too */
+  UNIFORM_EDGEPIXELS,
+  UNIFORM_MODELVIEW,
+  UNIFORM_CLUSTERS,    /* These six are set for clustered.frag by BindLightClusters */
+  UNIFORM_LIGHTINDICES,
+  UNIFORM_LIGHTS,
+  UNIFORM_CLUSTERGRID,
+  UNIFORM_CLUSTERDEPTH,
+  UNIFORM_ALLLIGHTS,
+  UNIFORM_COUNT
+};
+
+struct ShaderProgram {
+  GLuint program;
+  GLint uniforms[UNIFORM_COUNT];
+  unsigned long long hash;
+  bool frombinary;        /* Loaded from the on-disk cache rather than compiled */
+  double compileseconds;  /* Zero when loaded from a binary */
+  double linkseconds;     /* Time to link, or to load the binary */
+};
+
+/* Return the program built from the two shader files, compiling it only on a cache miss */
+const ShaderProgram *GetShaderProgram(const char *vertexfile, const char *fragmentfile);
+/* As GetShaderProgram, but a miss starts an asynchronous build and returns NULL until it is done */
+const ShaderProgram *RequestShaderProgram(const char *vertexfile, const char *fragmentfile);
+/* The same for a program with tessellation control and evaluation shaders between the vertex and
+   fragment stages (GL 4.0 or ARB_tessellation_shader) */
+const ShaderProgram *GetTessellationProgram(const char *vertexfile, const char *controlfile, const char *evaluationfile, const char *fragmentfile);
+const ShaderProgram *RequestTessellationProgram(const char *vertexfile, const char *controlfile, const char *evaluationfile, const char *fragmentfile);
+/* Finish the builds whose files have been read. Call once per frame, after PollAsyncLoads.
+   Returns true when a hot reload replaced a program, so callers should request theirs again. */
+bool UpdateShaderPrograms();
+/* Delete the programs hot reloads have replaced, except those still in inuse or built by another
+   pair of files. Their ShaderProgram pointers become invalid. */
+void ReleaseSupersededPrograms(const ShaderProgram *const *inuse, int count);
+/* Watch the files of the programs built from now on and rebuild them when they change */
+void SetShaderHotReload(bool enabled);
+/* Turn the on-disk binary cache on or off, for instance to measure a cold start */
+void SetProgramBinaryCache(bool enabled);
+void ReleaseShaderPrograms();
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "Simulation.h"
+#include "TripleBuffer.h"
+
+#define SIM_STEP (1.0 / SIM_HZ)
+
+static TripleBuffer<SceneSnapshot> snapshots;
+static std::thread simthread;
+static std::atomic<bool> quit(false);
+static bool running = false;
+static SceneStepper stepper;
+static double simorigin;
+static SceneState last;  /* The simulation thread's newest state */
+
+/* Kept by the simulation thread and read once it has stopped */
+static struct {
+  unsigned steps, late, skips;
+  double stepms, maxstepms;
+} stepstats;
+/* Kept by the render thread */
+static struct {
+  unsigned frames, fresh;
+  double latencyms, maxlatencyms;
+} readstats;
+
+static double Seconds(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void SleepUntil(double seconds){
+  std::chrono::duration<double> d(seconds);
+  std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(d)));
+}
+
+static void StepTo(unsigned tick){
+  stepper(tick * SIM_STEP, &last);
+  last.time = tick * SIM_STEP;
+}
+
+/* Step to tick and publish it with the state before. After a skip last is older than that, so
+   the state before is stepped again first. */
+static void Step(unsigned tick, bool contiguous){
+  SceneSnapshot &s = snapshots.Back();
+  if(!contiguous)
+    StepTo(tick - 1);
+  s.from = last;
+  double start = Seconds();
+  StepTo(tick);
+  double end = Seconds();
+  s.to = last;
+  s.tick = tick;
+  s.stepms = (end - start) * 1000;
+  s.published = Seconds();
+  snapshots.Publish();
+  stepstats.steps++;
+  stepstats.stepms += s.stepms;
+  if(s.stepms > stepstats.maxstepms)
+    stepstats.maxstepms = s.stepms;
+}
+
+/* Each step is made once the clock reaches the step before it, so the render thread always has
+   the state on either side of now. A step made after its own time is late; one so late that the
+   clock is SIM_MAX_LATE_TICKS steps ahead skips to the present instead of catching up. */
+static void Run(unsigned tick){
+  bool contiguous = true;
+  while(!quit){
+    double due = simorigin + (tick - 1) * SIM_STEP;
+    double now = Seconds();
+    if(now < due){
+      SleepUntil(due);
+      continue;
+    }
+    if(now - due > SIM_MAX_LATE_TICKS * SIM_STEP){
+      tick = (unsigned)((now - simorigin) * SIM_HZ) + 1;
+      contiguous = false;
+      stepstats.skips++;
+    } else if(now - due > SIM_STEP)
+      stepstats.late++;
+    Step(tick++, contiguous);
+    contiguous = true;
+  }
+}
+
+void StartSimulation(SceneStepper step, double origin){
+  if(running)
+    return;
+  stepper = step;
+  simorigin = origin;
+  quit = false;
+  unsigned tick = (unsigned)((Seconds() - origin) * SIM_HZ) + 1;
+  Step(tick, false);
+  simthread = std::thread(Run, tick + 1);
+  running = true;
+}
+
+bool SimulationRunning(){
+  return running;
+}
+
+const SceneSnapshot *LatestSnapshot(double now){
+  if(!running)
+    return NULL;
+  readstats.frames++;
+  if(snapshots.Update())
+    readstats.fresh++;
+  const SceneSnapshot &s = snapshots.Front();
+  double latency = (now - s.published) * 1000;
+  readstats.latencyms += latency;
+  if(latency > readstats.maxlatencyms)
+    readstats.maxlatencyms = latency;
+  return &s;
+}
+
+float SnapshotAlpha(const SceneSnapshot &snapshot, double time){
+  double a = (time - snapshot.from.time) / (snapshot.to.time - snapshot.from.time);
+  return a < 0 ? 0.f : (a > 1 ? 1.f : (float)a);
+}
+
+void StopSimulation(){
+  if(!running)
+    return;
+  quit = true;
+  simthread.join();
+  running = false;
+}
+
+void PrintSimulationStats(){
+  if(!stepstats.steps)
+    return;
+  printf("Simulation: %u steps at %d Hz, %.3f ms mean, %.3f ms max, %u late, %u skips\n", stepstats.steps, SIM_HZ,
+         stepstats.stepms / stepstats.steps, stepstats.maxstepms, stepstats.late, stepstats.skips);
+  if(readstats.frames)
+    printf("Snapshots: %u frames, %u with a new snapshot, latency %.2f ms mean, %.2f ms max\n", readstats.frames,
+           readstats.fresh, readstats.latencyms / readstats.frames, readstats.maxlatencyms);
+}
@@ -0,0 +1,53 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+/*
+   Scene update on its own thread. The simulation thread steps the animation at a fixed SIM_HZ,
+   one step ahead of the wall clock, and publishes each step as an immutable SceneSnapshot
+   through a TripleBuffer. The render thread takes the newest snapshot at the start of each frame
+   and interpolates between its two states for the moment it is drawing, so frames come out
+   smooth at any frame rate while the per-vertex and per-light work runs on another core.
+
+   The stepper must only read state that stays fixed while the thread runs, or that it is told
+   about through atomics. The profiler is main-thread only, so steps are not zoned; their times
+   are in the snapshots and PrintSimulationStats instead.
+ */
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+#define SIM_HZ 60
+#define SIM_MAX_LATE_TICKS 5  /* Steps behind the clock after which the thread skips ahead */
+
+/* What the scene looks like at one moment */
+struct SceneState {
+  double time;                    /* Seconds since the animation started */
+  int mode;                       /* The mode the step was for; the parts of other modes are empty */
+  std::vector<Vertex> deformed;   /* Mode 3: three vertices per facet of the deformed sphere */
+  std::vector<glm::vec3> lights;  /* Mode 1: where each point light is */
+};
+
+/* Two consecutive steps, 1/SIM_HZ s apart, to interpolate between */
+struct SceneSnapshot {
+  SceneState from, to;
+  unsigned tick;      /* Step number of to */
+  double published;   /* Clock seconds when it was handed over */
+  double stepms;      /* Time the step to took */
+};
+
+/* Fill in state, apart from its time, for the animation at time */
+typedef void (*SceneStepper)(double time, SceneState *state);
+
+/* Start stepping with step, with animation time 0 at clock seconds origin. The first snapshot
+   is made before this returns. */
+void StartSimulation(SceneStepper step, double origin);
+bool SimulationRunning();
+/* The newest snapshot, or NULL when the thread is not running. It stays valid until the next
+   call. now is the caller's clock, to measure how old the snapshot is. Render thread only. */
+const SceneSnapshot *LatestSnapshot(double now);
+/* How far between snapshot's from and to the animation time time is, in [0, 1] */
+float SnapshotAlpha(const SceneSnapshot &snapshot, double time);
+void StopSimulation();
+/* Steps made, their times, steps late, and how many frames found a new snapshot */
+void PrintSimulationStats();
+
+#endif
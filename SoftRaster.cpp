@@ -0,0 +1,486 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "SoftRaster.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "MeshOptimise.h"
+
+#define SUBPIXEL_BITS 8
+#define BIN_GRAIN 2048   /* Primitives per binning chunk; each chunk keeps its own tile lists */
+
+struct DrawCommand {
+  const MeshData *mesh;
+  GLfloat mvp[16];
+  bool wireframe;
+  SoftShading shading;
+  size_t firstvertex;      /* Into clipvertices */
+  size_t firstprimitive;   /* Into the numbering binning walks */
+  size_t primitives;
+};
+
+/* A vertex after the vertex "shader": clip-space position and the varying the shading uses */
+struct ClipVertex {
+  float x, y, z, w;
+  float v[3];
+};
+
+/* A triangle or line ready to rasterize. Triangles keep fixed-point window coordinates and
+   varyings divided by w for perspective-correct interpolation; lines interpolate linearly. */
+struct SetupPrim {
+  bool line;
+  SoftShading shading;
+  float x[3], y[3], z[3], iw[3];
+  float v[3][3];
+  long long fx[3], fy[3];
+  long long area;
+};
+
+struct BinChunk {
+  std::vector<SetupPrim> prims;
+  std::vector<std::vector<unsigned> > tiles;
+};
+
+static int width, height, tilesx, tilesy;
+static std::vector<unsigned char> colour;
+static std::vector<float> depth;
+static GLfloat clearcolour[3];
+static bool wireframe;
+static SoftShading shading;
+static std::vector<DrawCommand> draws;
+static std::vector<ClipVertex> clipvertices;
+static std::vector<BinChunk> chunks;
+
+void SoftResize(int w, int h){
+  width = w;
+  height = h;
+  tilesx = (w + TILE_SIZE - 1) / TILE_SIZE;
+  tilesy = (h + TILE_SIZE - 1) / TILE_SIZE;
+  colour.assign((size_t)w * h * 4, 0);
+  depth.assign((size_t)w * h, 1.f);
+  chunks.clear();
+}
+
+void SoftClear(const GLfloat c[3]){
+  memcpy(clearcolour, c, sizeof(clearcolour));
+  draws.clear();
+}
+
+void SoftPolygonMode(GLenum mode){
+  wireframe = mode == GL_LINE;
+}
+
+void SoftShade(SoftShading s){
+  shading = s;
+}
+
+static size_t PrimitiveCount(GLenum primitive, size_t n){
+  switch(primitive){
+  case GL_TRIANGLES: return n / 3;
+  case GL_TRIANGLE_FAN:
+  case GL_TRIANGLE_STRIP: return n > 2 ? n - 2 : 0;
+  case GL_LINES: return n / 2;
+  case GL_LINE_STRIP: return n > 1 ? n - 1 : 0;
+  case GL_LINE_LOOP: return n > 1 ? n : 0;
+  }
+  return 0; /* Points are not drawn */
+}
+
+/* Element numbers of primitive i, in the order GL would assemble them */
+static int PrimitiveElements(GLenum primitive, size_t i, size_t n, size_t out[3]){
+  switch(primitive){
+  case GL_TRIANGLES: out[0] = 3 * i; out[1] = 3 * i + 1; out[2] = 3 * i + 2; return 3;
+  case GL_TRIANGLE_FAN: out[0] = 0; out[1] = i + 1; out[2] = i + 2; return 3;
+  case GL_TRIANGLE_STRIP:
+    out[0] = i + (i & 1); out[1] = i + 1 - (i & 1); out[2] = i + 2;
+    return 3;
+  case GL_LINES: out[0] = 2 * i; out[1] = 2 * i + 1; return 2;
+  case GL_LINE_STRIP: out[0] = i; out[1] = i + 1; return 2;
+  case GL_LINE_LOOP: out[0] = i; out[1] = (i + 1) % n; return 2;
+  }
+  return 0;
+}
+
+void SoftDraw(const MeshData *mesh, const GLfloat *mvp){
+  DrawCommand draw;
+  size_t n = mesh->indices.empty() ? mesh->vertices.size() : mesh->indices.size();
+  draw.mesh = mesh;
+  memcpy(draw.mvp, mvp, sizeof(draw.mvp));
+  draw.wireframe = wireframe;
+  draw.shading = shading;
+  draw.primitives = PrimitiveCount(mesh->primitive, n);
+  draws.push_back(draw);
+  framestats.drawcalls++;
+  framestats.vertices += n;
+  if(mesh->primitive != GL_LINES && mesh->primitive != GL_LINE_STRIP && mesh->primitive != GL_LINE_LOOP)
+    framestats.triangles += draw.primitives;
+}
+
+/* The vertex stage of mode1_mode3.vert and mode2.vert, including the mode2 rule that a mesh
+   without normals uses its position */
+static void TransformVertices(const DrawCommand &draw, size_t begin, size_t end, ClipVertex *out){
+  const MeshData &mesh = *draw.mesh;
+  const GLfloat *m = draw.mvp;
+  bool normals = draw.shading == SOFT_SHADE_LAMBERT && !mesh.normals.empty();
+  for(size_t i = begin; i<end; i++){
+    const GLfloat *p = mesh.vertices[i].position;
+    ClipVertex &c = out[i];
+    c.x = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+    c.y = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+    c.z = m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14];
+    c.w = m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15];
+    const GLfloat *v = draw.shading == SOFT_SHADE_COLOUR ? mesh.vertices[i].color : normals ? &mesh.normals[3 * i] : p;
+    c.v[0] = v[0];
+    c.v[1] = v[1];
+    c.v[2] = v[2];
+  }
+}
+
+/* Signed distance to each of the six clip planes: w+x, w-x, w+y, w-y, w+z, w-z */
+static float PlaneDistance(const ClipVertex &c, int plane){
+  float coord = plane < 2 ? c.x : plane < 4 ? c.y : c.z;
+  return plane & 1 ? c.w - coord : c.w + coord;
+}
+
+static unsigned Outcode(const ClipVertex &c){
+  unsigned code = 0;
+  for(int plane = 0; plane<6; plane++)
+    if(PlaneDistance(c, plane) < 0)
+      code |= 1 << plane;
+  return code;
+}
+
+static ClipVertex Lerp(const ClipVertex &a, const ClipVertex &b, float t){
+  ClipVertex c;
+  c.x = a.x + (b.x - a.x) * t;
+  c.y = a.y + (b.y - a.y) * t;
+  c.z = a.z + (b.z - a.z) * t;
+  c.w = a.w + (b.w - a.w) * t;
+  for(int k = 0; k<3; k++)
+    c.v[k] = a.v[k] + (b.v[k] - a.v[k]) * t;
+  return c;
+}
+
+/* Sutherland-Hodgman against the planes in mask. polygon needs room for count + 6 vertices. */
+static int ClipPolygon(ClipVertex *polygon, int count, unsigned mask){
+  ClipVertex scratch[9];
+  for(int plane = 0; plane<6 && count; plane++){
+    if(!(mask & (1 << plane)))
+      continue;
+    int out = 0;
+    for(int i = 0; i<count; i++){
+      const ClipVertex &a = polygon[i], &b = polygon[(i + 1) % count];
+      float da = PlaneDistance(a, plane), db = PlaneDistance(b, plane);
+      if(da >= 0)
+        scratch[out++] = a;
+      if((da >= 0) != (db >= 0))
+        scratch[out++] = Lerp(a, b, da / (da - db));
+    }
+    memcpy(polygon, scratch, out * sizeof(ClipVertex));
+    count = out;
+  }
+  return count;
+}
+
+static void ToWindow(const ClipVertex &c, SetupPrim &prim, int k){
+  float iw = 1.f / c.w;
+  prim.x[k] = (c.x * iw * 0.5f + 0.5f) * width;
+  prim.y[k] = (c.y * iw * 0.5f + 0.5f) * height;
+  prim.z[k] = c.z * iw * 0.5f + 0.5f;
+  prim.iw[k] = iw;
+  for(int j = 0; j<3; j++)
+    prim.v[k][j] = prim.line ? c.v[j] : c.v[j] * iw;
+}
+
+static void Bin(BinChunk &chunk, const SetupPrim &prim){
+  float minx = prim.x[0], maxx = prim.x[0], miny = prim.y[0], maxy = prim.y[0];
+  int corners = prim.line ? 2 : 3;
+  for(int k = 1; k<corners; k++){
+    minx = std::min(minx, prim.x[k]);
+    maxx = std::max(maxx, prim.x[k]);
+    miny = std::min(miny, prim.y[k]);
+    maxy = std::max(maxy, prim.y[k]);
+  }
+  int tx0 = std::max(0, (int)floorf(minx - 0.5f) / TILE_SIZE), tx1 = std::min(tilesx - 1, (int)(maxx + 0.5f) / TILE_SIZE);
+  int ty0 = std::max(0, (int)floorf(miny - 0.5f) / TILE_SIZE), ty1 = std::min(tilesy - 1, (int)(maxy + 0.5f) / TILE_SIZE);
+  if(tx0 > tx1 || ty0 > ty1)
+    return;
+  unsigned index = chunk.prims.size();
+  chunk.prims.push_back(prim);
+  for(int ty = ty0; ty<=ty1; ty++)
+    for(int tx = tx0; tx<=tx1; tx++)
+      chunk.tiles[ty * tilesx + tx].push_back(index);
+}
+
+static void SetupTriangle(BinChunk &chunk, const ClipVertex &a, const ClipVertex &b, const ClipVertex &c, SoftShading shade){
+  SetupPrim prim;
+  prim.line = false;
+  prim.shading = shade;
+  ToWindow(a, prim, 0);
+  ToWindow(b, prim, 1);
+  ToWindow(c, prim, 2);
+  for(int k = 0; k<3; k++){
+    prim.fx[k] = llrintf(prim.x[k] * (1 << SUBPIXEL_BITS));
+    prim.fy[k] = llrintf(prim.y[k] * (1 << SUBPIXEL_BITS));
+  }
+  prim.area = (prim.fx[1] - prim.fx[0]) * (prim.fy[2] - prim.fy[0]) - (prim.fy[1] - prim.fy[0]) * (prim.fx[2] - prim.fx[0]);
+  if(prim.area == 0)
+    return;
+  if(prim.area < 0){ /* No culling, so make every triangle counter-clockwise */
+    std::swap(prim.x[1], prim.x[2]);
+    std::swap(prim.y[1], prim.y[2]);
+    std::swap(prim.z[1], prim.z[2]);
+    std::swap(prim.iw[1], prim.iw[2]);
+    std::swap(prim.fx[1], prim.fx[2]);
+    std::swap(prim.fy[1], prim.fy[2]);
+    for(int j = 0; j<3; j++)
+      std::swap(prim.v[1][j], prim.v[2][j]);
+    prim.area = -prim.area;
+  }
+  Bin(chunk, prim);
+}
+
+static void SetupLine(BinChunk &chunk, ClipVertex a, ClipVertex b, SoftShading shade){
+  /* Liang-Barsky against the six planes */
+  float t0 = 0, t1 = 1;
+  for(int plane = 0; plane<6; plane++){
+    float da = PlaneDistance(a, plane), db = PlaneDistance(b, plane);
+    if(da < 0 && db < 0)
+      return;
+    if(da < 0)
+      t0 = std::max(t0, da / (da - db));
+    else if(db < 0)
+      t1 = std::min(t1, da / (da - db));
+  }
+  if(t0 > t1)
+    return;
+  ClipVertex ca = t0 > 0 ? Lerp(a, b, t0) : a, cb = t1 < 1 ? Lerp(a, b, t1) : b;
+  SetupPrim prim;
+  prim.line = true;
+  prim.shading = shade;
+  ToWindow(ca, prim, 0);
+  ToWindow(cb, prim, 1);
+  Bin(chunk, prim);
+}
+
+static void SetupTriangleClipped(BinChunk &chunk, const ClipVertex &a, const ClipVertex &b, const ClipVertex &c, SoftShading shade){
+  unsigned ca = Outcode(a), cb = Outcode(b), cc = Outcode(c);
+  if(ca & cb & cc)
+    return;
+  if(!(ca | cb | cc)){
+    SetupTriangle(chunk, a, b, c, shade);
+    return;
+  }
+  ClipVertex polygon[9] = {a, b, c};
+  int count = ClipPolygon(polygon, 3, ca | cb | cc);
+  for(int i = 2; i<count; i++)
+    SetupTriangle(chunk, polygon[0], polygon[i - 1], polygon[i], shade);
+}
+
+/* Assemble, clip and bin primitives [begin, end) of the frame into chunk */
+static void BinPrimitives(size_t begin, size_t end, BinChunk &chunk){
+  size_t d = std::upper_bound(draws.begin(), draws.end(), begin,
+                              [](size_t p, const DrawCommand &draw){ return p < draw.firstprimitive; }) - draws.begin() - 1;
+  for(size_t p = begin; p<end; p++){
+    while(p >= draws[d].firstprimitive + draws[d].primitives)
+      d++;
+    const DrawCommand &draw = draws[d];
+    const MeshData &mesh = *draw.mesh;
+    size_t n = mesh.indices.empty() ? mesh.vertices.size() : mesh.indices.size();
+    size_t elements[3];
+    int corners = PrimitiveElements(mesh.primitive, p - draw.firstprimitive, n, elements);
+    const ClipVertex *v[3];
+    int k;
+    for(k = 0; k<corners; k++){
+      GLuint index = mesh.indices.empty() ? elements[k] : mesh.indices[elements[k]];
+      if(!mesh.indices.empty() && index == MESH_RESTART_INDEX)
+        break;
+      v[k] = &clipvertices[draw.firstvertex + index];
+    }
+    if(k < corners) /* Straddles the end of one of a strip's runs */
+      continue;
+    if(corners == 2)
+      SetupLine(chunk, *v[0], *v[1], draw.shading);
+    else if(draw.wireframe){
+      for(int k = 0; k<3; k++)
+        SetupLine(chunk, *v[k], *v[(k + 1) % 3], draw.shading);
+    } else
+      SetupTriangleClipped(chunk, *v[0], *v[1], *v[2], draw.shading);
+  }
+}
+
+static void Shade(const SetupPrim &prim, const float *v, unsigned char *out){
+  float c[3];
+  if(prim.shading == SOFT_SHADE_LAMBERT){
+    /* mode2.frag: ambient (0.1,0.1,0) plus green times the cosine to a light along +z */
+    float theta = std::min(std::max(v[2], 0.f), 1.f);
+    c[0] = 0.1f;
+    c[1] = 0.1f + theta;
+    c[2] = 0.f;
+  } else {
+    c[0] = v[0];
+    c[1] = v[1];
+    c[2] = v[2];
+  }
+  for(int k = 0; k<3; k++)
+    out[k] = (unsigned char)(std::min(std::max(c[k], 0.f), 1.f) * 255.f + 0.5f);
+  out[3] = 255;
+}
+
+static void RasterTriangle(const SetupPrim &prim, int x0, int y0, int x1, int y1){
+  const long long one = 1 << SUBPIXEL_BITS, half = one / 2;
+  long long minx = std::min(prim.fx[0], std::min(prim.fx[1], prim.fx[2]));
+  long long maxx = std::max(prim.fx[0], std::max(prim.fx[1], prim.fx[2]));
+  long long miny = std::min(prim.fy[0], std::min(prim.fy[1], prim.fy[2]));
+  long long maxy = std::max(prim.fy[0], std::max(prim.fy[1], prim.fy[2]));
+  x0 = std::max(x0, (int)((minx - half) >> SUBPIXEL_BITS));
+  x1 = std::min(x1, (int)((maxx - half) >> SUBPIXEL_BITS) + 1);
+  y0 = std::max(y0, (int)((miny - half) >> SUBPIXEL_BITS));
+  y1 = std::min(y1, (int)((maxy - half) >> SUBPIXEL_BITS) + 1);
+  if(x0 >= x1 || y0 >= y1)
+    return;
+  /* Edge k runs from vertex k+1 to vertex k+2 and is positive inside. Pixels exactly on an edge
+     belong to the triangle only if it is a top or left edge, so shared edges are drawn once. */
+  long long dx[3], dy[3], bias[3], row[3];
+  long long px = ((long long)x0 << SUBPIXEL_BITS) + half, py = ((long long)y0 << SUBPIXEL_BITS) + half;
+  for(int k = 0; k<3; k++){
+    int a = (k + 1) % 3, b = (k + 2) % 3;
+    dx[k] = prim.fx[b] - prim.fx[a];
+    dy[k] = prim.fy[b] - prim.fy[a];
+    bias[k] = dy[k] < 0 || (dy[k] == 0 && dx[k] < 0) ? 0 : -1;
+    row[k] = dx[k] * (py - prim.fy[a]) - dy[k] * (px - prim.fx[a]) + bias[k];
+  }
+  float inverse = 1.f / prim.area;
+  for(int y = y0; y<y1; y++){
+    long long e[3] = {row[0], row[1], row[2]};
+    float *zrow = &depth[(size_t)y * width];
+    unsigned char *crow = &colour[(size_t)y * width * 4];
+    for(int x = x0; x<x1; x++){
+      if((e[0] | e[1] | e[2]) >= 0){
+        float l0 = (e[0] - bias[0]) * inverse, l1 = (e[1] - bias[1]) * inverse, l2 = (e[2] - bias[2]) * inverse;
+        float z = l0 * prim.z[0] + l1 * prim.z[1] + l2 * prim.z[2];
+        if(z < zrow[x]){
+          zrow[x] = z;
+          float w = 1.f / (l0 * prim.iw[0] + l1 * prim.iw[1] + l2 * prim.iw[2]);
+          float v[3];
+          for(int j = 0; j<3; j++)
+            v[j] = (l0 * prim.v[0][j] + l1 * prim.v[1][j] + l2 * prim.v[2][j]) * w;
+          Shade(prim, v, &crow[x * 4]);
+        }
+      }
+      for(int k = 0; k<3; k++)
+        e[k] -= dy[k] << SUBPIXEL_BITS;
+    }
+    for(int k = 0; k<3; k++)
+      row[k] += dx[k] << SUBPIXEL_BITS;
+  }
+}
+
+/* Lines light one pixel per step along their major axis, at pixel centres the line covers */
+static void RasterLine(const SetupPrim &prim, int x0, int y0, int x1, int y1){
+  float dx = prim.x[1] - prim.x[0], dy = prim.y[1] - prim.y[0];
+  bool xmajor = fabsf(dx) >= fabsf(dy);
+  float start = xmajor ? prim.x[0] : prim.y[0], delta = xmajor ? dx : dy;
+  if(delta == 0)
+    return;
+  float lo = std::min(start, start + delta), hi = std::max(start, start + delta);
+  int first = (int)ceilf(lo - 0.5f), last = (int)ceilf(hi - 0.5f);
+  first = std::max(first, xmajor ? x0 : y0);
+  last = std::min(last, xmajor ? x1 : y1);
+  for(int i = first; i<last; i++){
+    float t = (i + 0.5f - start) / delta;
+    int j = (int)floorf(xmajor ? prim.y[0] + t * dy : prim.x[0] + t * dx);
+    int x = xmajor ? i : j, y = xmajor ? j : i;
+    if(x < x0 || x >= x1 || y < y0 || y >= y1)
+      continue;
+    size_t pixel = (size_t)y * width + x;
+    float z = prim.z[0] + (prim.z[1] - prim.z[0]) * t;
+    if(z < depth[pixel]){
+      depth[pixel] = z;
+      float v[3];
+      for(int k = 0; k<3; k++)
+        v[k] = prim.v[0][k] + (prim.v[1][k] - prim.v[0][k]) * t;
+      Shade(prim, v, &colour[pixel * 4]);
+    }
+  }
+}
+
+static void RasterTile(int tile, size_t nchunks){
+  int x0 = (tile % tilesx) * TILE_SIZE, y0 = (tile / tilesx) * TILE_SIZE;
+  int x1 = std::min(x0 + TILE_SIZE, width), y1 = std::min(y0 + TILE_SIZE, height);
+  unsigned char clear[4];
+  for(int k = 0; k<3; k++)
+    clear[k] = (unsigned char)(std::min(std::max(clearcolour[k], 0.f), 1.f) * 255.f + 0.5f);
+  clear[3] = 255;
+  for(int y = y0; y<y1; y++)
+    for(int x = x0; x<x1; x++){
+      memcpy(&colour[((size_t)y * width + x) * 4], clear, 4);
+      depth[(size_t)y * width + x] = 1.f;
+    }
+  for(size_t c = 0; c<nchunks; c++){
+    const BinChunk &chunk = chunks[c];
+    const std::vector<unsigned> &list = chunk.tiles[tile];
+    for(size_t i = 0; i<list.size(); i++){
+      const SetupPrim &prim = chunk.prims[list[i]];
+      if(prim.line)
+        RasterLine(prim, x0, y0, x1, y1);
+      else
+        RasterTriangle(prim, x0, y0, x1, y1);
+    }
+  }
+}
+
+size_t SoftFinish(){
+  size_t vertices = 0, primitives = 0;
+  for(size_t d = 0; d<draws.size(); d++){
+    draws[d].firstvertex = vertices;
+    draws[d].firstprimitive = primitives;
+    vertices += draws[d].mesh->vertices.size();
+    primitives += draws[d].primitives;
+  }
+  clipvertices.resize(vertices);
+  {
+    PROFILE_ZONE("SoftTransform");
+    ParallelFor(vertices, 4096, [](size_t begin, size_t end){
+      size_t d = std::upper_bound(draws.begin(), draws.end(), begin,
+                                  [](size_t v, const DrawCommand &draw){ return v < draw.firstvertex; }) - draws.begin() - 1;
+      for(; d<draws.size() && draws[d].firstvertex < end; d++){
+        size_t first = draws[d].firstvertex, count = draws[d].mesh->vertices.size();
+        size_t b = std::max(begin, first) - first, e = std::min(end, first + count) - first;
+        TransformVertices(draws[d], b, e, &clipvertices[first]);
+      }
+    });
+  }
+  size_t nchunks = (primitives + BIN_GRAIN - 1) / BIN_GRAIN;
+  if(chunks.size() < nchunks)
+    chunks.resize(nchunks);
+  {
+    PROFILE_ZONE("SoftBin");
+    ParallelFor(primitives, BIN_GRAIN, [](size_t begin, size_t end){
+      /* Chunk c always holds primitives [c * BIN_GRAIN, (c + 1) * BIN_GRAIN), however the loop is split */
+      for(size_t first = begin; first<end; first += BIN_GRAIN){
+        BinChunk &chunk = chunks[first / BIN_GRAIN];
+        chunk.prims.clear();
+        chunk.tiles.resize(tilesx * tilesy);
+        for(size_t t = 0; t<chunk.tiles.size(); t++)
+          chunk.tiles[t].clear();
+        BinPrimitives(first, std::min(first + BIN_GRAIN, end), chunk);
+      }
+    });
+  }
+  {
+    PROFILE_ZONE("SoftRaster");
+    ParallelFor(tilesx * tilesy, 1, [nchunks](size_t begin, size_t end){
+      for(size_t t = begin; t<end; t++)
+        RasterTile(t, nchunks);
+    });
+  }
+  draws.clear();
+  return primitives;
+}
+
+const unsigned char *SoftPixels(){
+  return colour.data();
+}
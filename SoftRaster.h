@@ -0,0 +1,37 @@
+#ifndef SOFTRASTER_H
+#define SOFTRASTER_H
+/*
+   Software rasterizer for machines without a GPU. It draws the same MeshData the generators
+   produce into an in-memory RGBA framebuffer with a depth buffer, following the GL state the
+   demo uses: glPolygonMode fill or line, depth test GL_LESS, and the shading of
+   mode1_mode3.frag (interpolated vertex colour) or mode2.frag (lambert from the normal).
+
+   SoftDraw only queues work. SoftFinish transforms the queued vertices, bins the primitives into
+   TILE_SIZE square screen tiles and rasterizes the tiles in parallel on the ThreadPool. Each
+   tile is drawn by one thread in submission order, so the image is the same for any number of
+   threads.
+ */
+#include <stddef.h>
+#include "Mesh.h"
+
+#define TILE_SIZE 64
+
+enum SoftShading {
+  SOFT_SHADE_COLOUR,   /* mode1_mode3.frag */
+  SOFT_SHADE_LAMBERT   /* mode2.frag */
+};
+
+void SoftResize(int width, int height);
+/* Start a frame: the framebuffer will be cleared to colour and the depth buffer to 1 */
+void SoftClear(const GLfloat colour[3]);
+/* GL_FILL or GL_LINE, as glPolygonMode */
+void SoftPolygonMode(GLenum mode);
+void SoftShade(SoftShading shading);
+/* Queue mesh with a column-major model-view-projection matrix. mesh must live until SoftFinish. */
+void SoftDraw(const MeshData *mesh, const GLfloat *mvp);
+/* Draw everything queued since SoftClear. Returns the number of triangles and lines processed. */
+size_t SoftFinish();
+/* RGBA8 rows, bottom row first like glReadPixels */
+const unsigned char *SoftPixels();
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "StreamBuffer.h"
+#include "FrameStats.h"
+
+static StreamStats stats;
+static double firstframe = -1;
+
+static double Seconds(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool PersistentSupported(){
+#ifdef __APPLE__
+  return false;
+#else
+  return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+#endif
+}
+
+void CreateStreamBuffer(StreamBuffer *s, GLsizeiptr framebytes){
+  s->framebytes = (framebytes + 255) & ~(GLsizeiptr)255; /* Keep every region aligned for any use */
+  s->frame = STREAM_FRAMES - 1; /* StreamBeginFrame moves on to region 0 */
+  s->used = s->mapoffset = s->mapbytes = 0;
+  memset(s->fences, 0, sizeof(s->fences));
+  glGenBuffers(1, &s->buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, s->buffer);
+#ifndef __APPLE__
+  if(PersistentSupported()){
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, s->framebytes * STREAM_FRAMES, NULL, flags);
+    s->mapped = (unsigned char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, s->framebytes * STREAM_FRAMES, flags);
+    if(s->mapped){
+      printf("Stream buffer: %d x %d bytes, persistently mapped\n", STREAM_FRAMES, (int)s->framebytes);
+      return;
+    }
+    /* Immutable storage cannot be respecified, so the fallback needs a buffer of its own */
+    glDeleteBuffers(1, &s->buffer);
+    glGenBuffers(1, &s->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, s->buffer);
+  }
+#endif
+  s->mapped = NULL;
+  s->staging.resize(s->framebytes);
+  glBufferData(GL_ARRAY_BUFFER, s->framebytes, NULL, GL_STREAM_DRAW);
+  printf("Stream buffer: %d bytes, orphaned every frame\n", (int)s->framebytes);
+}
+
+void StreamBeginFrame(StreamBuffer *s){
+  if(firstframe < 0)
+    firstframe = Seconds();
+  stats.frames++;
+  s->used = 0;
+  if(!s->mapped){
+    /* A fresh store each frame; the driver keeps the old one alive until the GPU is done with it */
+    glBindBuffer(GL_ARRAY_BUFFER, s->buffer);
+    glBufferData(GL_ARRAY_BUFFER, s->framebytes, NULL, GL_STREAM_DRAW);
+    return;
+  }
+  s->frame = (s->frame + 1) % STREAM_FRAMES;
+  GLsync fence = s->fences[s->frame];
+  if(!fence)
+    return;
+  if(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED){
+    double start = Seconds();
+    stats.fencewaits++;
+    framestats.fencewaits++;
+    while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+      ;
+    stats.waitseconds += Seconds() - start;
+  }
+  glDeleteSync(fence);
+  s->fences[s->frame] = 0;
+}
+
+void *StreamMap(StreamBuffer *s, GLsizeiptr bytes, GLintptr *offset){
+  GLsizeiptr start = (s->used + 15) & ~(GLsizeiptr)15;
+  if(start + bytes > s->framebytes)
+    return NULL;
+  s->used = start + bytes;
+  s->mapbytes = bytes;
+  stats.bytes += bytes;
+  framestats.bytesuploaded += bytes;
+  if(!s->mapped){
+    s->mapoffset = *offset = start;
+    return s->staging.data() + start;
+  }
+  s->mapoffset = *offset = s->frame * s->framebytes + start;
+  return s->mapped + s->mapoffset;
+}
+
+void StreamUnmap(StreamBuffer *s){
+  /* Coherent writes are already visible to the GPU; only the fallback has anything to send */
+  if(s->mapped){
+    GLTRACE_MAPPED_WRITE(s->buffer, s->mapoffset, s->mapbytes, s->mapped + s->mapoffset);
+    return;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, s->buffer);
+  glBufferSubData(GL_ARRAY_BUFFER, s->mapoffset, s->mapbytes, s->staging.data() + s->mapoffset);
+}
+
+void StreamEndFrame(StreamBuffer *s){
+  if(s->mapped)
+    s->fences[s->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void DestroyStreamBuffer(StreamBuffer *s){
+  for(int i = 0; i<STREAM_FRAMES; i++)
+    if(s->fences[i])
+      glDeleteSync(s->fences[i]);
+  memset(s->fences, 0, sizeof(s->fences));
+  if(s->mapped){
+    glBindBuffer(GL_ARRAY_BUFFER, s->buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    s->mapped = NULL;
+  }
+  glDeleteBuffers(1, &s->buffer);
+  s->buffer = 0;
+  s->staging.clear();
+}
+
+StreamStats GetStreamStats(){
+  return stats;
+}
+
+void PrintStreamStats(){
+  if(!stats.frames)
+    return;
+  double seconds = Seconds() - firstframe;
+  printf("Streamed %.1f MB/s over %llu frames (%.1f KB/frame), %llu fence waits totalling %.2f ms\n",
+         stats.bytes / seconds / 1e6, stats.frames, stats.bytes / 1024.0 / stats.frames,
+         stats.fencewaits, stats.waitseconds * 1000);
+}
@@ -0,0 +1,54 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+/*
+   Ring buffer for geometry rewritten every frame. The buffer holds STREAM_FRAMES regions of
+   framebytes each. It is created with glBufferStorage and mapped once, persistent and coherent,
+   so the CPU writes straight into the memory the GPU reads from: while the GPU draws from the
+   region of frame N the CPU fills the region of frame N+2, and a fence per region is the only
+   synchronisation. The CPU waits on a fence only when it has got a whole ring ahead.
+
+   Without ARB_buffer_storage (OS X tops out at GL 4.1) the same calls stage the data in memory
+   and upload it with glBufferSubData, orphaning the buffer at the start of each frame so the
+   driver never has to wait for the GPU either.
+ */
+#include <stddef.h>
+#include <vector>
+#include "Platform.h"
+
+#define STREAM_FRAMES 3
+
+struct StreamBuffer {
+  GLuint buffer;
+  GLsizeiptr framebytes;            /* Size of one frame's region */
+  unsigned char *mapped;            /* The whole persistent mapping, or NULL when orphaning */
+  std::vector<unsigned char> staging; /* One frame of data waiting for glBufferSubData */
+  GLsync fences[STREAM_FRAMES];
+  int frame;                        /* Region being written */
+  GLsizeiptr used;                  /* Bytes handed out in it so far */
+  GLintptr mapoffset;               /* Start of the block from the last StreamMap */
+  GLsizeiptr mapbytes;
+};
+
+struct StreamStats {
+  unsigned long long frames;
+  unsigned long long bytes;         /* Bytes written through StreamMap */
+  unsigned long long fencewaits;    /* Frames that found their region still in use by the GPU */
+  double waitseconds;               /* Time spent waiting on those fences */
+};
+
+/* Create a ring of STREAM_FRAMES regions of framebytes each */
+void CreateStreamBuffer(StreamBuffer *s, GLsizeiptr framebytes);
+/* Move to the next region, waiting first if the GPU still reads it */
+void StreamBeginFrame(StreamBuffer *s);
+/* Return bytes of write-only memory in the current region and its offset in the buffer, or NULL
+   when the region is full. Write all of it before StreamUnmap. */
+void *StreamMap(StreamBuffer *s, GLsizeiptr bytes, GLintptr *offset);
+void StreamUnmap(StreamBuffer *s);
+/* Fence the region once the frame's draws that read it have been issued */
+void StreamEndFrame(StreamBuffer *s);
+void DestroyStreamBuffer(StreamBuffer *s);
+StreamStats GetStreamStats();
+/* Print bytes streamed per second and fence waits since the first StreamBeginFrame */
+void PrintStreamStats();
+
+#endif
@@ -0,0 +1,189 @@
+#include <math.h>
+#include <stdio.h>
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#include "Subdivide.h"
+#include "ThreadPool.h"
+
+/* Work is handed out in chunks that are a multiple of the widest SIMD batch, so whether an item
+   takes the vector or the scalar path depends only on its position, never on the thread count */
+static const size_t grain = 4096;
+
+void NormaliseBatch(GLfloat *x, GLfloat *y, GLfloat *z, size_t begin, size_t end){
+  size_t i = begin;
+#if defined(__AVX__)
+  const __m256 zero = _mm256_setzero_ps();
+  for(; i + 8 <= end; i += 8){
+    __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+    __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py)), _mm256_mul_ps(pz, pz)));
+    __m256 nonzero = _mm256_cmp_ps(length, zero, _CMP_NEQ_OQ);
+    _mm256_storeu_ps(x + i, _mm256_and_ps(_mm256_div_ps(px, length), nonzero));
+    _mm256_storeu_ps(y + i, _mm256_and_ps(_mm256_div_ps(py, length), nonzero));
+    _mm256_storeu_ps(z + i, _mm256_and_ps(_mm256_div_ps(pz, length), nonzero));
+  }
+#elif defined(__SSE2__)
+  const __m128 zero = _mm_setzero_ps();
+  for(; i + 4 <= end; i += 4){
+    __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz)));
+    __m128 nonzero = _mm_cmpneq_ps(length, zero);
+    _mm_storeu_ps(x + i, _mm_and_ps(_mm_div_ps(px, length), nonzero));
+    _mm_storeu_ps(y + i, _mm_and_ps(_mm_div_ps(py, length), nonzero));
+    _mm_storeu_ps(z + i, _mm_and_ps(_mm_div_ps(pz, length), nonzero));
+  }
+#elif defined(__aarch64__)
+  const float32x4_t zero = vdupq_n_f32(0);
+  for(; i + 4 <= end; i += 4){
+    float32x4_t px = vld1q_f32(x + i), py = vld1q_f32(y + i), pz = vld1q_f32(z + i);
+    float32x4_t length = vsqrtq_f32(vaddq_f32(vaddq_f32(vmulq_f32(px, px), vmulq_f32(py, py)), vmulq_f32(pz, pz)));
+    uint32x4_t nonzero = vmvnq_u32(vceqq_f32(length, zero));
+    vst1q_f32(x + i, vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vdivq_f32(px, length)), nonzero)));
+    vst1q_f32(y + i, vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vdivq_f32(py, length)), nonzero)));
+    vst1q_f32(z + i, vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vdivq_f32(pz, length)), nonzero)));
+  }
+#endif
+  for(; i<end; i++){
+    GLfloat length = sqrtf(x[i]*x[i] + y[i]*y[i] + z[i]*z[i]);
+    if(length != 0){
+      x[i] /= length;
+      y[i] /= length;
+      z[i] /= length;
+    } else
+      x[i] = y[i] = z[i] = 0;
+  }
+}
+
+/*
+   Each level keeps, per facet, its three vertices and the ids of its three edges (a-b, b-c, c-a),
+   and per edge its two end vertices. Splitting a level then needs no lookups:
+     - edge e gets the midpoint vertex V + e, and becomes child edges 2e (first end to
+       midpoint) and 2e + 1 (midpoint to second end);
+     - facet t gets three interior edges 2E + 3t + 0..2 and four children 4t + 0..3.
+   Every slot is computed from its parent's slot, so threads never share an output.
+ */
+size_t SubdivideSphere(int iterations, SubdividedSphere *sphere, bool keeplevels){
+  static const GLfloat octahedron[6][3] = {{0,0,1}, {0,0,-1}, {-1,-1,0}, {1,-1,0}, {1,1,0}, {-1,1,0}};
+  static const GLuint seed[24] = {0,3,4, 0,4,5, 0,5,2, 0,2,3, 1,4,3, 1,5,4, 1,2,5, 1,3,2};
+  if(iterations < 1)
+    iterations = 1;
+  if(iterations > MAX_SUBDIVIDE_ITERATIONS){
+    fprintf(stderr, "SubdivideSphere: %d iterations is more than 32-bit indices can address, using %d\n",
+            iterations, MAX_SUBDIVIDE_ITERATIONS);
+    iterations = MAX_SUBDIVIDE_ITERATIONS;
+  }
+
+  size_t nfacets = 8, nvertices = 6, nedges = 12, level;
+  size_t finalfacets = UnitSphereFacets(iterations), finalvertices = UnitSphereVertices(iterations);
+  std::vector<GLfloat> &x = sphere->x, &y = sphere->y, &z = sphere->z;
+  std::vector<GLuint> &facets = sphere->indices;
+  x.resize(finalvertices); y.resize(finalvertices); z.resize(finalvertices);
+  facets.resize(finalfacets * 3);
+
+  /* The seed is tiny, so its edges are found serially */
+  std::vector<GLuint> edges, facetedges(nfacets * 3), newfacets, newedges, newfacetedges;
+  for(size_t i = 0; i<6; i++){
+    x[i] = octahedron[i][0]; y[i] = octahedron[i][1]; z[i] = octahedron[i][2];
+  }
+  NormaliseBatch(x.data(), y.data(), z.data(), 0, 6);
+  std::vector<GLuint> current(seed, seed + 24);
+  for(size_t t = 0; t<nfacets; t++)
+    for(int k = 0; k<3; k++){
+      GLuint a = current[t*3 + k], b = current[t*3 + (k + 1) % 3];
+      size_t e;
+      for(e = 0; e<edges.size(); e += 2)
+        if((edges[e] == a && edges[e + 1] == b) || (edges[e] == b && edges[e + 1] == a))
+          break;
+      if(e == edges.size()){
+        edges.push_back(a);
+        edges.push_back(b);
+      }
+      facetedges[t*3 + k] = e / 2;
+    }
+
+  sphere->coarser.clear();
+  sphere->coarservertices.clear();
+  for(level = 1; level<(size_t)iterations; level++){
+    /* Vertices are only ever appended, so the level about to be split keeps its numbering */
+    if(keeplevels){
+      sphere->coarser.push_back(current);
+      sphere->coarservertices.push_back(nvertices);
+    }
+    bool last = level + 1 == (size_t)iterations;
+    const GLuint *oldedges = edges.data(), *oldfacets = current.data(), *oldfacetedges = facetedges.data();
+    GLfloat *px = x.data(), *py = y.data(), *pz = z.data();
+    size_t V = nvertices, E = nedges;
+    GLuint *outfacets, *outedges = NULL, *outfacetedges = NULL;
+    if(last)
+      outfacets = facets.data();
+    else {
+      newfacets.resize(nfacets * 4 * 3);
+      newedges.resize((2*E + 3*nfacets) * 2);
+      newfacetedges.resize(nfacets * 4 * 3);
+      outfacets = newfacets.data();
+      outedges = newedges.data();
+      outfacetedges = newfacetedges.data();
+    }
+
+    /* Midpoints and split edges */
+    ParallelFor(E, grain, [=](size_t begin, size_t end){
+      for(size_t e = begin; e<end; e++){
+        GLuint a = oldedges[e*2], b = oldedges[e*2 + 1], m = V + e;
+        px[m] = (px[a] + px[b]) / 2;
+        py[m] = (py[a] + py[b]) / 2;
+        pz[m] = (pz[a] + pz[b]) / 2;
+        if(outedges){
+          outedges[e*4] = a;     outedges[e*4 + 1] = m;
+          outedges[e*4 + 2] = m; outedges[e*4 + 3] = b;
+        }
+      }
+    });
+
+    /* Child facets and interior edges */
+    ParallelFor(nfacets, grain, [=](size_t begin, size_t end){
+      for(size_t t = begin; t<end; t++){
+        const GLuint *f = oldfacets + t*3, *fe = oldfacetedges + t*3;
+        GLuint a = f[0], b = f[1], c = f[2];
+        GLuint m1 = V + fe[0], m2 = V + fe[1], m3 = V + fe[2];
+        GLuint *g = outfacets + t*12;
+        g[0] = a;  g[1] = m1;  g[2] = m3;
+        g[3] = m1; g[4] = b;   g[5] = m2;
+        g[6] = m3; g[7] = m2;  g[8] = c;
+        g[9] = m1; g[10] = m2; g[11] = m3;
+        if(!outedges)
+          continue;
+        /* Half of edge e that touches vertex v */
+        #define HALF(e, v) (GLuint)(oldedges[(e)*2] == (v) ? 2*(e) : 2*(e) + 1)
+        GLuint i0 = 2*E + 3*t, i1 = i0 + 1, i2 = i0 + 2;
+        outedges[i0*2] = m1; outedges[i0*2 + 1] = m3;
+        outedges[i1*2] = m1; outedges[i1*2 + 1] = m2;
+        outedges[i2*2] = m2; outedges[i2*2 + 1] = m3;
+        GLuint *ge = outfacetedges + t*12;
+        ge[0] = HALF(fe[0], a);  ge[1] = i0;             ge[2] = HALF(fe[2], a);
+        ge[3] = HALF(fe[0], b);  ge[4] = HALF(fe[1], b);  ge[5] = i1;
+        ge[6] = i2;              ge[7] = HALF(fe[1], c);  ge[8] = HALF(fe[2], c);
+        ge[9] = i1;              ge[10] = i2;             ge[11] = i0;
+        #undef HALF
+      }
+    });
+
+    nvertices += E;
+    nfacets *= 4;
+    nedges = 2*E + 3*(nfacets / 4);
+    if(!last){
+      current.swap(newfacets);
+      edges.swap(newedges);
+      facetedges.swap(newfacetedges);
+    }
+  }
+  if(iterations == 1)
+    facets = current;
+
+  GLfloat *px = x.data(), *py = y.data(), *pz = z.data();
+  ParallelFor(nvertices, grain, [=](size_t begin, size_t end){
+    NormaliseBatch(px, py, pz, begin, end);
+  });
+  return nfacets;
+}
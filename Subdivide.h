@@ -0,0 +1,41 @@
+#ifndef SUBDIVIDE_H
+#define SUBDIVIDE_H
+/*
+   Parallel sphere subdivision. Positions are kept as structure-of-arrays so normalisation runs
+   in SIMD batches, and every level is split across the thread pool. Each vertex, edge and facet
+   of a level has a fixed slot derived from its parent, so the output is bit-for-bit the same
+   for any number of threads.
+ */
+#include <stddef.h>
+#include <vector>
+#include "Platform.h"
+
+struct SubdividedSphere {
+  std::vector<GLfloat> x, y, z;   /* Unit-sphere positions */
+  std::vector<GLuint> indices;    /* Three per facet */
+  /* With keeplevels, the facets of every coarser level on the way up: coarser[k] holds those of
+     iterations k + 1. Each level's vertices are the first coarservertices[k] of x, y and z. */
+  std::vector<std::vector<GLuint> > coarser;
+  std::vector<size_t> coarservertices;
+};
+
+/* Largest iteration count whose vertices can still be addressed with 32-bit indices */
+#define MAX_SUBDIVIDE_ITERATIONS 15
+
+/* Facets and distinct vertices of the octahedron subdivided iterations times, known to the compiler
+   when iterations is */
+constexpr size_t UnitSphereFacets(int iterations) { return (size_t)8 << (2 * (iterations - 1)); }
+constexpr size_t UnitSphereVertices(int iterations) { return ((size_t)4 << (2 * (iterations - 1))) + 2; }
+static_assert(UnitSphereVertices(5) == 1026 && UnitSphereFacets(5) == 2048, "Level 5 is the demo's default sphere");
+
+/* Subdivide the octahedron used by CreateUnitSphere. iterations counts the same way, so 1 gives
+   the 8 octahedron facets and n gives 8 * 4^(n-1). Returns the number of facets. With keeplevels
+   the facets of the levels below are kept as well, which costs a copy of each and nothing else.
+ */
+size_t SubdivideSphere(int iterations, SubdividedSphere *sphere, bool keeplevels = false);
+/* Normalise positions [begin, end) onto the unit sphere, eight or four at a time where the
+   target has AVX, SSE2 or NEON. Zero-length vectors become zero.
+ */
+void NormaliseBatch(GLfloat *x, GLfloat *y, GLfloat *z, size_t begin, size_t end);
+
+#endif
@@ -0,0 +1,180 @@
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ThreadPool.h"
+
+static std::vector<std::thread> workers;
+static std::mutex lock;
+static std::condition_variable wake, done;
+static bool quit = false;
+
+/* One thread's share of the current loop's chunks: the run [front, back), packed into one word
+   so that the owner taking from the front and thieves taking from the back settle every race
+   with a single compare-and-swap. Padded to a cache line so owners do not slow each other. */
+struct ChunkQueue {
+  std::atomic<uint64_t> range;
+  char padding[64 - sizeof(std::atomic<uint64_t>)];
+};
+
+static uint64_t Pack(size_t front, size_t back){
+  return (uint64_t)front << 32 | (uint64_t)back;
+}
+
+/* The loop currently being run. generation changes for each new loop, and ParallelFor waits
+   until every worker has finished with it, so no worker can still be looking at a loop once
+   the next one is posted. */
+static const std::function<void(size_t, size_t)> *job;
+static size_t jobcount, jobgrain;
+static std::unique_ptr<ChunkQueue[]> queues;
+static std::atomic<unsigned long long> steals(0);
+static unsigned generation = 0;
+static size_t pending = 0;
+static int threadcount = 0;
+static std::mutex running; /* Held by the thread whose loop the pool is running */
+static thread_local int threadindex = 0;
+
+/* Take the front chunk of the thread's own run */
+static bool TakeOwn(int thread, size_t *chunk){
+  std::atomic<uint64_t> &range = queues[thread].range;
+  uint64_t r = range.load(std::memory_order_relaxed);
+  for(;;){
+    size_t front = r >> 32, back = r & 0xffffffff;
+    if(front >= back)
+      return false;
+    if(range.compare_exchange_weak(r, Pack(front + 1, back), std::memory_order_relaxed)){
+      *chunk = front;
+      return true;
+    }
+  }
+}
+
+/* Take the back half of another thread's run, keep its first chunk to run now and make the rest
+   the thief's own run. Only an empty run is ever replaced, and a thief that read it empty fails
+   its swap, so nobody can steal from a run while it is being refilled. */
+static bool Steal(int thread, size_t *chunk){
+  for(int i = 1; i<threadcount; i++){
+    std::atomic<uint64_t> &range = queues[(thread + i) % threadcount].range;
+    uint64_t r = range.load(std::memory_order_relaxed);
+    for(;;){
+      size_t front = r >> 32, back = r & 0xffffffff;
+      if(front >= back)
+        break;
+      size_t middle = front + (back - front) / 2;
+      if(range.compare_exchange_weak(r, Pack(front, middle), std::memory_order_relaxed)){
+        queues[thread].range.store(Pack(middle + 1, back), std::memory_order_relaxed);
+        *chunk = middle;
+        steals++;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static void RunChunks(int thread){
+  size_t chunk;
+  while(TakeOwn(thread, &chunk) || Steal(thread, &chunk)){
+    size_t begin = chunk * jobgrain;
+    size_t end = begin + jobgrain < jobcount ? begin + jobgrain : jobcount;
+    (*job)(begin, end);
+  }
+}
+
+static void Worker(int index){
+  unsigned seen = 0;
+  threadindex = index;
+  std::unique_lock<std::mutex> guard(lock);
+  for(;;){
+    wake.wait(guard, [&]{ return quit || generation != seen; });
+    if(quit)
+      return;
+    seen = generation;
+    guard.unlock();
+    RunChunks(index);
+    guard.lock();
+    if(--pending == 0)
+      done.notify_one();
+  }
+}
+
+static void StopWorkers(){
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    quit = true;
+  }
+  wake.notify_all();
+  for(size_t i = 0; i<workers.size(); i++)
+    workers[i].join();
+  workers.clear();
+  quit = false;
+}
+
+/* Join the workers before the statics above are destroyed at exit */
+static struct Shutdown {
+  ~Shutdown() { StopWorkers(); }
+} poolshutdown;
+
+void SetThreadCount(int threads){
+  if(threads <= 0)
+    threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+  if(threads == threadcount)
+    return;
+  StopWorkers();
+  threadcount = threads;
+  queues.reset(new ChunkQueue[threads]);
+  for(int i = 0; i<threads; i++)
+    queues[i].range = 0;
+  for(int i = 1; i<threads; i++)
+    workers.push_back(std::thread(Worker, i));
+}
+
+int GetThreadCount(){
+  if(!threadcount)
+    SetThreadCount(0);
+  return threadcount;
+}
+
+int ThreadIndex(){
+  return threadindex;
+}
+
+unsigned long long GetStealCount(){
+  return steals;
+}
+
+void ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &fn){
+  if(!count)
+    return;
+  if(!grain)
+    grain = 1;
+  if(GetThreadCount() == 1 || count <= grain){
+    fn(0, count);
+    return;
+  }
+  /* The pool runs one loop at a time; a second thread's loop runs on that thread alone */
+  std::unique_lock<std::mutex> owner(running, std::try_to_lock);
+  if(!owner.owns_lock()){
+    fn(0, count);
+    return;
+  }
+  size_t chunks = (count + grain - 1) / grain;
+  std::unique_lock<std::mutex> guard(lock);
+  job = &fn;
+  jobcount = count;
+  jobgrain = grain;
+  /* Each thread starts on its own contiguous share, so neighbouring chunks stay on one core */
+  for(int i = 0; i<threadcount; i++)
+    queues[i].range = Pack(chunks * i / threadcount, chunks * (i + 1) / threadcount);
+  pending = workers.size();
+  generation++;
+  guard.unlock();
+  wake.notify_all();
+  RunChunks(0);
+  guard.lock();
+  /* Workers that wake late steal what is left, or find nothing and finish straight away */
+  done.wait(guard, []{ return pending == 0; });
+}
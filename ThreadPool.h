@@ -0,0 +1,79 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+/*
+   A small pool of worker threads for data-parallel loops. ParallelFor splits [0, count) into
+   chunks of grain items and gives each thread, the caller included, an equal contiguous run of
+   them. A thread that finishes its run steals the back half of another's, so a few slow chunks
+   do not leave the other cores idle. Which thread runs a chunk varies from run to run, so
+   callers must write each chunk's results to a fixed place, or through ThreadBuffers, if they
+   need the output to be the same for any number of threads.
+
+   Any thread may call ParallelFor, but the pool runs one loop at a time: a loop started while
+   another thread's is running runs serially on its own thread instead of waiting. ThreadIndex is
+   0 there too, so ThreadBuffers must not be shared between loops of different threads.
+ */
+#include <stddef.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+/* Set the number of threads, including the caller, that ParallelFor uses. 0 means one per core. */
+void SetThreadCount(int threads);
+int GetThreadCount();
+void ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &fn);
+/* The pool thread running the calling code: 0 for the thread that called ParallelFor, up to
+   GetThreadCount() - 1 for the workers */
+int ThreadIndex();
+/* Runs of chunks taken from another thread since the program started */
+unsigned long long GetStealCount();
+
+/* Output of a ParallelFor gathered per thread. Each chunk appends to its thread's own vector,
+   so there are no locks and no shared cache lines, and notes where its items went; Merge then
+   joins the runs in chunk order, which gives the same result as a serial loop for any number
+   of threads and whatever was stolen. Everything keeps its capacity from frame to frame.
+ */
+template<class T> struct ThreadBuffers {
+  struct Run {
+    size_t chunk, begin, end;
+    bool operator<(const Run &o) const { return chunk < o.chunk; }
+  };
+  std::vector<std::vector<T> > items;
+  std::vector<std::vector<Run> > runs;
+  std::vector<std::pair<Run, int> > order;
+
+  /* Empty every thread's buffer; call before the ParallelFor */
+  void Reset(){
+    items.resize(GetThreadCount());
+    runs.resize(items.size());
+    for(size_t t = 0; t<items.size(); t++){
+      items[t].clear();
+      runs[t].clear();
+    }
+  }
+  /* The calling thread's buffer, to append chunk's items to */
+  std::vector<T> &Begin(size_t chunk){
+    int t = ThreadIndex();
+    Run run = {chunk, items[t].size(), items[t].size()};
+    runs[t].push_back(run);
+    return items[t];
+  }
+  /* Close the run opened by the calling thread's last Begin */
+  void End(){
+    int t = ThreadIndex();
+    runs[t].back().end = items[t].size();
+  }
+  /* Append every run to out in chunk order */
+  void Merge(std::vector<T> &out){
+    order.clear();
+    for(size_t t = 0; t<runs.size(); t++)
+      for(size_t r = 0; r<runs[t].size(); r++)
+        order.push_back(std::make_pair(runs[t][r], (int)t));
+    std::sort(order.begin(), order.end());
+    for(size_t i = 0; i<order.size(); i++){
+      const std::vector<T> &from = items[order[i].second];
+      out.insert(out.end(), from.begin() + order[i].first.begin, from.begin() + order[i].first.end);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+/*
+   Lock-free hand-over of whole objects from one writer thread to one reader thread. Of the three
+   slots the writer owns one (back), the reader owns one (front), and the third sits between them.
+   Publish swaps the back slot into the middle; Update swaps the middle into the front, but only
+   when the writer has put something new there since. Each swap is a single atomic exchange, so
+   neither side ever waits for the other, and the reader always gets the newest complete object:
+   older ones the writer replaced before the reader looked are simply skipped.
+
+   Slots are reused, so a T that holds vectors keeps their capacity and steady state allocates
+   nothing.
+ */
+#include <atomic>
+
+#define TRIPLE_BUFFER_FRESH 4  /* Set in middle when the writer put its slot there */
+
+template<class T> struct TripleBuffer {
+  T slots[3];
+  std::atomic<unsigned> middle;  /* Slot index, with TRIPLE_BUFFER_FRESH */
+  unsigned back, front;          /* Touched only by the writer and the reader respectively */
+
+  TripleBuffer(): middle(1), back(0), front(2) {}
+
+  /* The slot the writer fills next */
+  T &Back() { return slots[back]; }
+  /* Hand the back slot to the reader and take the old middle one to fill next */
+  void Publish(){
+    back = middle.exchange(back | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel) & 3;
+  }
+  /* Take the newest published slot, if the reader has not had it yet. Returns whether it did. */
+  bool Update(){
+    if(!(middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH))
+      return false;
+    front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+    return true;
+  }
+  /* The reader's slot; it stays put until the next Update */
+  const T &Front() const { return slots[front]; }
+};
+
+#endif
@@ -0,0 +1,53 @@
+#version 400
+precision highp float;
+in vec3 vNormal;  // View space
+in vec3 vPosition;  // View space
+out vec4 FragColor;
+
+uniform usamplerBuffer clusters;  // Per cluster: first entry in lightindices, number of entries
+uniform usamplerBuffer lightindices;
+uniform samplerBuffer lights;  // Per light: view-space position and range, then colour
+uniform vec2 viewport;  // In pixels
+uniform vec3 clustergrid;  // Tiles across, tiles down, depth slices
+uniform vec2 clusterdepth;  // Near plane, and slices per unit of log depth
+uniform int alllights;  // Above 0, light with that many lights and ignore the clusters
+
+// What light i adds to a point at position with normal N: diffuse, falling smoothly to nothing at its range
+vec3 PointLight(int i, vec3 position, vec3 N) {
+    vec4 light = texelFetch(lights, 2 * i);
+    vec3 L = light.xyz - position;
+    float d2 = dot(L, L);
+    float falloff = clamp(1.0 - d2 / (light.w * light.w), 0., 1.);
+    if(falloff == 0.0)
+        return vec3(0.0);
+    float theta = max(dot(N, L * inversesqrt(d2)), 0.);
+    return texelFetch(lights, 2 * i + 1).rgb * falloff * falloff * theta;
+}
+
+void main(void) {
+    // The lighting of mode2.frag, with the normal in view space
+    vec3 uAmbient = vec3(0.1,0.1,0.0);
+    vec3 uSurfaceColour = vec3(0.5,1.0,0.5);
+    vec3 uLightColour = vec3(1.0);
+    vec3 uLightDirection = vec3(0.,0.,1.);
+    vec3 N = normalize(vNormal);
+    vec3 LightDirection = normalize(uLightDirection);
+    float CosTheta = dot(LightDirection, N);
+    float theta = clamp(CosTheta, 0., 1.);
+    vec3 light = theta * uLightColour;
+
+    if(alllights > 0) {
+        for(int i = 0; i < alllights; i++)
+            light += PointLight(i, vPosition, N);
+    } else {
+        // Find this fragment's cluster from its pixel and its depth
+        ivec2 tile = ivec2(gl_FragCoord.xy / viewport * clustergrid.xy);
+        int slice = int(log(max(-vPosition.z / clusterdepth.x, 1.0)) * clusterdepth.y);
+        ivec3 cell = min(ivec3(tile, slice), ivec3(clustergrid) - 1);
+        int cluster = (cell.z * int(clustergrid.y) + cell.y) * int(clustergrid.x) + cell.x;
+        uvec2 run = texelFetch(clusters, cluster).rg;
+        for(uint k = 0u; k < run.y; k++)
+            light += PointLight(int(texelFetch(lightindices, int(run.x + k)).r), vPosition, N);
+    }
+    FragColor = vec4(uAmbient + uSurfaceColour * light,1.0);
+}
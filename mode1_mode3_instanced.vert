@@ -0,0 +1,18 @@
+#version 400
+
+precision highp float;
+
+in vec3 in_Position;
+in vec3 in_Color;
+in mat4 in_Model;  // Per-instance model matrix, read from the mesh's instance buffer
+
+
+uniform mat4 viewprojection;  // viewprojection is the result of multiplying the view and projection matrices
+
+out vec3 ex_Color;
+void main(void) {
+
+    gl_Position = viewprojection * in_Model * vec4(in_Position, 1.0); // Apply this instance's model matrix, then the shared view and projection
+    
+    ex_Color = in_Color;
+}
@@ -0,0 +1,26 @@
+#version 400
+
+precision highp float;
+
+in vec3 in_Position;
+in vec3 in_Color;
+in vec3 in_Normal;  // Octahedral-encoded normal in xy, or (0,0,1) when the mesh has no normals
+in mat4 in_Model;  // Per-instance model matrix, read from the mesh's instance buffer
+
+
+uniform mat4 viewprojection;  // viewprojection is the result of multiplying the view and projection matrices
+
+out vec3 vNormal;
+
+vec3 OctDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main(void) {
+
+    gl_Position = viewprojection * in_Model * vec4(in_Position, 1.0); // Apply this instance's model matrix, then the shared view and projection
+    vNormal = in_Normal.z > 0.5 ? in_Position : OctDecode(in_Normal.xy); // On the unit sphere the position is the normal
+}
@@ -0,0 +1,20 @@
+#version 400
+
+precision highp float;
+
+in vec3 in_Position;
+in vec3 in_Color;
+
+
+uniform mat4 mvpmatrix;  // mvpmatrix is the result of multiplying the model, view, and projection matrices
+
+out vec3 vPosition;  // Control points stay in model space until the evaluation shader places them
+out vec3 vColor;
+out mat4 vMVP;
+
+void main(void) {
+
+    vPosition = in_Position;
+    vColor = in_Color;
+    vMVP = mvpmatrix;
+}
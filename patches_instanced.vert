@@ -0,0 +1,21 @@
+#version 400
+
+precision highp float;
+
+in vec3 in_Position;
+in vec3 in_Color;
+in mat4 in_Model;  // Per-instance model matrix, read from the mesh's instance buffer
+
+
+uniform mat4 viewprojection;  // viewprojection is the result of multiplying the view and projection matrices
+
+out vec3 vPosition;  // Control points stay in model space until the evaluation shader places them
+out vec3 vColor;
+out mat4 vMVP;
+
+void main(void) {
+
+    vPosition = in_Position;
+    vColor = in_Color;
+    vMVP = viewprojection * in_Model;
+}
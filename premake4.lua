@@ -1,11 +1,47 @@
 --
 -- Building my cone exanple with msys2
 --
+newoption {
+   trigger = 'profiler',
+   description = 'Compile in the PROFILE_ZONE instrumentation (see Profiler.h)'
+}
+newoption {
+   trigger = 'gltrace',
+   description = 'Compile in the GL call capture behind --trace (see GLTrace.h)'
+}
+newoption {
+   trigger = 'alloccount',
+   description = 'Count heap allocations for --bench-generators (see Allocations.h)'
+}
+
 solution ('Tutorial')
    configurations { 'Release' }
       language 'C++'
     project ('Demo')
             kind 'ConsoleApp'
-            links{'glew32', 'glfw3', 'opengl32'}
             files {'*.cpp'}
             buildoptions{'-Wno-write-strings'}
+            if _OPTIONS['profiler'] then
+               defines{'PROFILER'}
+            end
+            if _OPTIONS['gltrace'] then
+               defines{'GLTRACE'}
+            end
+            if _OPTIONS['alloccount'] then
+               defines{'ALLOCCOUNT'}
+            end
+            configuration 'windows'
+               links{'glew32', 'glfw3', 'opengl32'}
+            configuration 'linux'
+               -- EGL is for --headless
+               links{'GLEW', 'glfw', 'GL', 'EGL', 'pthread'}
+    -- Plays back the traces the demo writes with --trace (see replay/Replay.cpp)
+    project ('Replay')
+            kind 'ConsoleApp'
+            files {'replay/*.cpp', 'Headless.cpp'}
+            includedirs {'.'}
+            buildoptions{'-Wno-write-strings'}
+            configuration 'windows'
+               links{'glew32', 'opengl32'}
+            configuration 'linux'
+               links{'GLEW', 'GL', 'EGL'}
@@ -0,0 +1,668 @@
+/*
+   Plays back a trace written by the demo's --trace (GLTrace.cpp) to find where Render wastes GL
+   calls and to time it reproducibly. Every record is replayed against a headless context as fast
+   as it will go, with a glFinish at the end of each frame so each frame's time is its own. With
+   --no-gl nothing is replayed and only the counts are made.
+
+   Either way every frame's calls are counted, and the calls that change nothing are picked out:
+   binds of what is already bound, state set to the value it has, a bind of 0 followed by a bind of
+   what was bound before it, uniforms set to the value they hold or at location -1, and
+   glGetUniformLocation inside a frame. --output writes the counts and times per frame as CSV so
+   two runs can be diffed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "Platform.h"
+#include "Headless.h"
+#include "GLTraceFormat.h"
+
+struct Record {
+  TraceOp op;
+  unsigned words[TRACE_MAX_WORDS];
+  const unsigned char *payload;
+  unsigned bytes;
+};
+
+struct FrameCounts {
+  unsigned long long calls, draws, statechanges, redundant, rebinds, sameuniforms, deaduniforms, lookups, bytes;
+  double ms;
+};
+
+static std::vector<unsigned char> file;
+static std::vector<Record> records;
+static TraceHeader header;
+
+static double Seconds(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static float Float(unsigned bits){
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+/* Read the whole trace into memory, so replaying it never waits on the disk */
+static void ReadTrace(const char *path){
+  FILE *in = fopen(path, "rb");
+  if(!in){
+    fprintf(stderr, "Cannot read %s\n", path);
+    exit( EXIT_FAILURE );
+  }
+  fseek(in, 0, SEEK_END);
+  file.resize(ftell(in));
+  fseek(in, 0, SEEK_SET);
+  if(fread(file.data(), 1, file.size(), in) != file.size() || file.size() < sizeof(header)){
+    fprintf(stderr, "Cannot read %s\n", path);
+    exit( EXIT_FAILURE );
+  }
+  fclose(in);
+  memcpy(&header, file.data(), sizeof(header));
+  if(strcmp(header.magic, GLTRACE_MAGIC) || header.version != GLTRACE_VERSION){
+    fprintf(stderr, "%s is not a version %d GL trace\n", path, GLTRACE_VERSION);
+    exit( EXIT_FAILURE );
+  }
+  size_t at = sizeof(header);
+  while(at < file.size()){
+    Record r;
+    memset(&r, 0, sizeof(r));
+    if(file[at] >= TRACE_OPS){
+      fprintf(stderr, "Unknown record %d at byte %zu of %s\n", file[at], at, path);
+      exit( EXIT_FAILURE );
+    }
+    r.op = (TraceOp)file[at++];
+    const TraceOpInfo &info = traceops[r.op];
+    size_t need = info.words * 4 + (info.payload ? 4 : 0);
+    if(at + need > file.size())
+      break;
+    memcpy(r.words, &file[at], info.words * 4);
+    at += info.words * 4;
+    if(info.payload){
+      memcpy(&r.bytes, &file[at], 4);
+      at += 4;
+      if(at + r.bytes > file.size())
+        break;
+      r.payload = &file[at];
+      at += r.bytes;
+    }
+    records.push_back(r);
+  }
+  if(at < file.size())
+    printf("%s ends in the middle of a record; replaying what comes before it\n", path);
+}
+
+/* What is bound to one binding point, and what was bound before the last bind of 0 */
+struct Binding {
+  unsigned current, beforeunbind;
+  bool unbound;
+};
+
+/* The GL state as the trace leaves it, to tell the calls that change it from the ones that do not */
+static Binding vertexarray, program;
+static std::unordered_map<unsigned, Binding> buffers;   /* By target */
+static std::unordered_map<unsigned long long, Binding> textures; /* By unit and target */
+static std::unordered_map<unsigned long long, std::vector<unsigned> > state; /* By op and first word */
+static std::unordered_map<unsigned long long, std::string> uniforms; /* By program and location */
+static unsigned activetexture = GL_TEXTURE0;
+static unsigned long long redundantbyop[TRACE_OPS], rebindsbyop[TRACE_OPS];
+
+static void Bind(Binding *b, unsigned value, TraceOp op, FrameCounts *counts){
+  if(value == b->current){
+    counts->redundant++;
+    redundantbyop[op]++;
+    return;
+  }
+  counts->statechanges++;
+  if(value && !b->current && b->unbound && b->beforeunbind == value){
+    counts->rebinds++;
+    rebindsbyop[op]++;
+  }
+  b->unbound = !value;
+  if(!value)
+    b->beforeunbind = b->current;
+  b->current = value;
+}
+
+/* Set the state keyed by key to value */
+static void SetState(const Record &r, unsigned long long key, const std::vector<unsigned> &value, FrameCounts *counts){
+  auto found = state.find(key);
+  if(found != state.end() && found->second == value){
+    counts->redundant++;
+    redundantbyop[r.op]++;
+    return;
+  }
+  counts->statechanges++;
+  state[key] = value;
+}
+
+static void SetUniform(const Record &r, FrameCounts *counts){
+  if(r.words[0] == (unsigned)-1){
+    counts->deaduniforms++;
+    return;
+  }
+  std::string value((const char *)r.words + 4, (traceops[r.op].words - 1) * 4);
+  if(r.payload)
+    value.append((const char *)r.payload, r.bytes);
+  value += (char)r.op;
+  unsigned long long key = (unsigned long long)program.current << 32 | r.words[0];
+  auto found = uniforms.find(key);
+  if(found != uniforms.end() && found->second == value){
+    counts->sameuniforms++;
+    return;
+  }
+  uniforms[key] = value;
+}
+
+static void Count(const Record &r, bool inframe, FrameCounts *counts){
+  counts->calls++;
+  counts->bytes += r.bytes;
+  switch(r.op){
+  case TRACE_BIND_BUFFER:
+    Bind(&buffers[r.words[0]], r.words[1], r.op, counts);
+    break;
+  case TRACE_BIND_VERTEX_ARRAY:
+    Bind(&vertexarray, r.words[0], r.op, counts);
+    break;
+  case TRACE_USE_PROGRAM:
+    Bind(&program, r.words[0], r.op, counts);
+    break;
+  case TRACE_BIND_TEXTURE:
+    Bind(&textures[(unsigned long long)activetexture << 32 | r.words[0]], r.words[1], r.op, counts);
+    break;
+  case TRACE_ACTIVE_TEXTURE:
+    if(r.words[0] == activetexture){
+      counts->redundant++;
+      redundantbyop[r.op]++;
+    } else
+      counts->statechanges++;
+    activetexture = r.words[0];
+    break;
+  case TRACE_POLYGON_MODE:
+  case TRACE_PATCH_PARAMETERI:
+    SetState(r, (unsigned long long)r.op << 32 | r.words[0], std::vector<unsigned>(r.words + 1, r.words + traceops[r.op].words), counts);
+    break;
+  case TRACE_ENABLE:
+  case TRACE_DISABLE:
+    SetState(r, (unsigned long long)TRACE_ENABLE << 32 | r.words[0], std::vector<unsigned>(1, r.op), counts);
+    break;
+  case TRACE_PRIMITIVE_RESTART_INDEX:
+  case TRACE_VIEWPORT:
+  case TRACE_CLEAR_COLOR:
+    SetState(r, (unsigned long long)r.op << 32, std::vector<unsigned>(r.words, r.words + traceops[r.op].words), counts);
+    break;
+  case TRACE_UNIFORM_1I:
+  case TRACE_UNIFORM_1F:
+  case TRACE_UNIFORM_2F:
+  case TRACE_UNIFORM_3F:
+  case TRACE_UNIFORM_3FV:
+  case TRACE_UNIFORM_MATRIX_4FV:
+    SetUniform(r, counts);
+    break;
+  case TRACE_GET_UNIFORM_LOCATION:
+    if(inframe)
+      counts->lookups++;
+    break;
+  case TRACE_DRAW_ARRAYS:
+  case TRACE_DRAW_ELEMENTS:
+  case TRACE_DRAW_ELEMENTS_BASE_VERTEX:
+  case TRACE_DRAW_ARRAYS_INSTANCED:
+  case TRACE_DRAW_ELEMENTS_INSTANCED:
+  case TRACE_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX:
+  case TRACE_MULTI_DRAW_ARRAYS_INDIRECT:
+  case TRACE_MULTI_DRAW_ELEMENTS_INDIRECT:
+    counts->draws++;
+    break;
+  case TRACE_DELETE_PROGRAM:
+  case TRACE_LINK_PROGRAM:
+  case TRACE_PROGRAM_BINARY:
+    /* Linking resets a program's uniforms */
+    for(auto u = uniforms.begin(); u != uniforms.end();)
+      if(u->first >> 32 == r.words[0])
+        u = uniforms.erase(u);
+      else
+        ++u;
+    break;
+  default:
+    break;
+  }
+}
+
+/* The replaying context's names for the capture's objects */
+static std::unordered_map<unsigned, GLuint> buffernames, arraynames, texturenames, shadernames, programnames;
+static std::unordered_map<unsigned long long, GLint> locations; /* By capture program and location */
+static std::unordered_map<unsigned, GLsync> syncs;
+static std::unordered_map<unsigned, GLuint> boundbuffers;     /* By target, replay names */
+struct Mapping {
+  unsigned char *pointer;
+  unsigned offset;
+};
+static std::unordered_map<GLuint, Mapping> mappings;          /* By replay buffer */
+static unsigned currentprogram;                               /* Capture name */
+static int unknownnames, failedprograms;
+
+static GLuint Name(std::unordered_map<unsigned, GLuint> &names, unsigned name){
+  if(!name)
+    return 0;
+  auto found = names.find(name);
+  if(found == names.end()){
+    unknownnames++;
+    return 0;
+  }
+  return found->second;
+}
+
+static void GenNames(const Record &r, std::unordered_map<unsigned, GLuint> &names, void (*gen)(GLsizei, GLuint *)){
+  GLsizei n = r.bytes / sizeof(GLuint);
+  std::vector<GLuint> made(n);
+  gen(n, made.data());
+  for(GLsizei i = 0; i<n; i++){
+    unsigned name;
+    memcpy(&name, r.payload + i * sizeof(GLuint), sizeof(name));
+    names[name] = made[i];
+  }
+}
+
+static void DeleteNames(const Record &r, std::unordered_map<unsigned, GLuint> &names, void (*del)(GLsizei, const GLuint *)){
+  GLsizei n = r.bytes / sizeof(GLuint);
+  for(GLsizei i = 0; i<n; i++){
+    unsigned name;
+    memcpy(&name, r.payload + i * sizeof(GLuint), sizeof(name));
+    GLuint replayname = Name(names, name);
+    del(1, &replayname);
+    names.erase(name);
+  }
+}
+
+/* glGen* and glDelete* may be macros for function pointers, so these wrap them */
+static void GenBuffers(GLsizei n, GLuint *names) { glGenBuffers(n, names); }
+static void DeleteBuffers(GLsizei n, const GLuint *names) { glDeleteBuffers(n, names); }
+static void GenVertexArrays(GLsizei n, GLuint *names) { glGenVertexArrays(n, names); }
+static void DeleteVertexArrays(GLsizei n, const GLuint *names) { glDeleteVertexArrays(n, names); }
+static void GenTextures(GLsizei n, GLuint *names) { glGenTextures(n, names); }
+static void DeleteTextures(GLsizei n, const GLuint *names) { glDeleteTextures(n, names); }
+
+static void CheckLink(unsigned program){
+  GLint linked = GL_FALSE;
+  glGetProgramiv(Name(programnames, program), GL_LINK_STATUS, &linked);
+  if(!linked && !failedprograms++)
+    printf("Program %u failed to link; a program binary only loads on the driver that made it\n", program);
+}
+
+static GLint Location(unsigned location){
+  if(location == (unsigned)-1)
+    return -1;
+  auto found = locations.find((unsigned long long)currentprogram << 32 | location);
+  return found == locations.end() ? -1 : found->second;
+}
+
+static const void *Offset(unsigned offset){
+  return (const void *)(size_t)offset;
+}
+
+static void Replay(const Record &r){
+  const unsigned *w = r.words;
+  switch(r.op){
+  case TRACE_FRAME:
+    break;
+  case TRACE_GEN_BUFFERS:
+    GenNames(r, buffernames, GenBuffers);
+    break;
+  case TRACE_DELETE_BUFFERS:
+    DeleteNames(r, buffernames, DeleteBuffers);
+    break;
+  case TRACE_BIND_BUFFER:
+    boundbuffers[w[0]] = Name(buffernames, w[1]);
+    glBindBuffer(w[0], boundbuffers[w[0]]);
+    break;
+  case TRACE_BUFFER_DATA:
+    glBufferData(w[0], w[1], r.bytes ? r.payload : NULL, w[2]);
+    break;
+  case TRACE_BUFFER_SUB_DATA:
+    glBufferSubData(w[0], w[1], r.bytes, r.payload);
+    break;
+  case TRACE_BUFFER_STORAGE:
+    glBufferStorage(w[0], w[1], r.bytes ? r.payload : NULL, w[2]);
+    break;
+  case TRACE_MAP_BUFFER_RANGE: {
+    Mapping mapping = {(unsigned char *)glMapBufferRange(w[0], w[1], w[2], w[3]), w[1]};
+    mappings[boundbuffers[w[0]]] = mapping;
+    break;
+  }
+  case TRACE_UNMAP_BUFFER:
+    mappings.erase(boundbuffers[w[0]]);
+    glUnmapBuffer(w[0]);
+    break;
+  case TRACE_MAPPED_WRITE: {
+    GLuint buffer = Name(buffernames, w[0]);
+    auto found = mappings.find(buffer);
+    if(found != mappings.end() && found->second.pointer)
+      memcpy(found->second.pointer + (w[1] - found->second.offset), r.payload, r.bytes);
+    else {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, w[1], r.bytes, r.payload);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, boundbuffers[GL_COPY_WRITE_BUFFER]);
+    }
+    break;
+  }
+  case TRACE_COPY_BUFFER_SUB_DATA:
+    glCopyBufferSubData(w[0], w[1], w[2], w[3], w[4]);
+    break;
+  case TRACE_GEN_VERTEX_ARRAYS:
+    GenNames(r, arraynames, GenVertexArrays);
+    break;
+  case TRACE_DELETE_VERTEX_ARRAYS:
+    DeleteNames(r, arraynames, DeleteVertexArrays);
+    break;
+  case TRACE_BIND_VERTEX_ARRAY:
+    glBindVertexArray(Name(arraynames, w[0]));
+    break;
+  case TRACE_VERTEX_ATTRIB_POINTER:
+    glVertexAttribPointer(w[0], w[1], w[2], w[3], w[4], Offset(w[5]));
+    break;
+  case TRACE_ENABLE_VERTEX_ATTRIB_ARRAY:
+    glEnableVertexAttribArray(w[0]);
+    break;
+  case TRACE_VERTEX_ATTRIB_DIVISOR:
+    glVertexAttribDivisor(w[0], w[1]);
+    break;
+  case TRACE_VERTEX_ATTRIB_3F:
+    glVertexAttrib3f(w[0], Float(w[1]), Float(w[2]), Float(w[3]));
+    break;
+  case TRACE_GEN_TEXTURES:
+    GenNames(r, texturenames, GenTextures);
+    break;
+  case TRACE_DELETE_TEXTURES:
+    DeleteNames(r, texturenames, DeleteTextures);
+    break;
+  case TRACE_ACTIVE_TEXTURE:
+    glActiveTexture(w[0]);
+    break;
+  case TRACE_BIND_TEXTURE:
+    glBindTexture(w[0], Name(texturenames, w[1]));
+    break;
+  case TRACE_TEX_BUFFER:
+    glTexBuffer(w[0], w[1], Name(buffernames, w[2]));
+    break;
+  case TRACE_CREATE_SHADER:
+    shadernames[w[1]] = glCreateShader(w[0]);
+    break;
+  case TRACE_SHADER_SOURCE: {
+    const GLchar *source = (const GLchar *)r.payload;
+    GLint length = r.bytes;
+    glShaderSource(Name(shadernames, w[0]), 1, &source, &length);
+    break;
+  }
+  case TRACE_COMPILE_SHADER:
+    glCompileShader(Name(shadernames, w[0]));
+    break;
+  case TRACE_DELETE_SHADER:
+    glDeleteShader(Name(shadernames, w[0]));
+    shadernames.erase(w[0]);
+    break;
+  case TRACE_CREATE_PROGRAM:
+    programnames[w[0]] = glCreateProgram();
+    break;
+  case TRACE_ATTACH_SHADER:
+    glAttachShader(Name(programnames, w[0]), Name(shadernames, w[1]));
+    break;
+  case TRACE_DETACH_SHADER:
+    glDetachShader(Name(programnames, w[0]), Name(shadernames, w[1]));
+    break;
+  case TRACE_BIND_ATTRIB_LOCATION:
+    glBindAttribLocation(Name(programnames, w[0]), w[1], std::string((const char *)r.payload, r.bytes).c_str());
+    break;
+  case TRACE_PROGRAM_PARAMETERI:
+    glProgramParameteri(Name(programnames, w[0]), w[1], w[2]);
+    break;
+  case TRACE_LINK_PROGRAM:
+    glLinkProgram(Name(programnames, w[0]));
+    CheckLink(w[0]);
+    break;
+  case TRACE_PROGRAM_BINARY:
+    glProgramBinary(Name(programnames, w[0]), w[1], r.payload, r.bytes);
+    CheckLink(w[0]);
+    break;
+  case TRACE_DELETE_PROGRAM:
+    glDeleteProgram(Name(programnames, w[0]));
+    programnames.erase(w[0]);
+    break;
+  case TRACE_GET_UNIFORM_LOCATION:
+    locations[(unsigned long long)w[0] << 32 | w[1]] =
+      glGetUniformLocation(Name(programnames, w[0]), std::string((const char *)r.payload, r.bytes).c_str());
+    break;
+  case TRACE_USE_PROGRAM:
+    currentprogram = w[0];
+    glUseProgram(Name(programnames, w[0]));
+    break;
+  case TRACE_UNIFORM_1I:
+    glUniform1i(Location(w[0]), w[1]);
+    break;
+  case TRACE_UNIFORM_1F:
+    glUniform1f(Location(w[0]), Float(w[1]));
+    break;
+  case TRACE_UNIFORM_2F:
+    glUniform2f(Location(w[0]), Float(w[1]), Float(w[2]));
+    break;
+  case TRACE_UNIFORM_3F:
+    glUniform3f(Location(w[0]), Float(w[1]), Float(w[2]), Float(w[3]));
+    break;
+  case TRACE_UNIFORM_3FV:
+    glUniform3fv(Location(w[0]), w[1], (const GLfloat *)r.payload);
+    break;
+  case TRACE_UNIFORM_MATRIX_4FV:
+    glUniformMatrix4fv(Location(w[0]), w[1], w[2], (const GLfloat *)r.payload);
+    break;
+  case TRACE_POLYGON_MODE:
+    glPolygonMode(w[0], w[1]);
+    break;
+  case TRACE_ENABLE:
+    glEnable(w[0]);
+    break;
+  case TRACE_DISABLE:
+    glDisable(w[0]);
+    break;
+  case TRACE_PRIMITIVE_RESTART_INDEX:
+    glPrimitiveRestartIndex(w[0]);
+    break;
+  case TRACE_PATCH_PARAMETERI:
+    glPatchParameteri(w[0], w[1]);
+    break;
+  case TRACE_VIEWPORT:
+    glViewport(w[0], w[1], w[2], w[3]);
+    break;
+  case TRACE_CLEAR_COLOR:
+    glClearColor(Float(w[0]), Float(w[1]), Float(w[2]), Float(w[3]));
+    break;
+  case TRACE_CLEAR:
+    glClear(w[0]);
+    break;
+  case TRACE_DRAW_ARRAYS:
+    glDrawArrays(w[0], w[1], w[2]);
+    break;
+  case TRACE_DRAW_ELEMENTS:
+    glDrawElements(w[0], w[1], w[2], Offset(w[3]));
+    break;
+  case TRACE_DRAW_ELEMENTS_BASE_VERTEX:
+    glDrawElementsBaseVertex(w[0], w[1], w[2], Offset(w[3]), w[4]);
+    break;
+  case TRACE_DRAW_ARRAYS_INSTANCED:
+    glDrawArraysInstanced(w[0], w[1], w[2], w[3]);
+    break;
+  case TRACE_DRAW_ELEMENTS_INSTANCED:
+    glDrawElementsInstanced(w[0], w[1], w[2], Offset(w[3]), w[4]);
+    break;
+  case TRACE_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX:
+    glDrawElementsInstancedBaseVertex(w[0], w[1], w[2], Offset(w[3]), w[4], w[5]);
+    break;
+  case TRACE_MULTI_DRAW_ARRAYS_INDIRECT:
+    glMultiDrawArraysIndirect(w[0], Offset(w[1]), w[2], w[3]);
+    break;
+  case TRACE_MULTI_DRAW_ELEMENTS_INDIRECT:
+    glMultiDrawElementsIndirect(w[0], w[1], Offset(w[2]), w[3], w[4]);
+    break;
+  case TRACE_FENCE_SYNC:
+    syncs[w[0]] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    break;
+  case TRACE_CLIENT_WAIT_SYNC: {
+    /* The capture went on only once the wait succeeded, however many tries that took */
+    auto found = syncs.find(w[0]);
+    if(found != syncs.end())
+      while(glClientWaitSync(found->second, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+        ;
+    break;
+  }
+  case TRACE_DELETE_SYNC: {
+    auto found = syncs.find(w[0]);
+    if(found != syncs.end()){
+      glDeleteSync(found->second);
+      syncs.erase(found);
+    }
+    break;
+  }
+  case TRACE_OPS:
+    break;
+  }
+}
+
+/* The ops that account for most of some waste, most first */
+static void PrintTopOps(const unsigned long long *byop, size_t frames){
+  std::vector<int> ops;
+  for(int op = 0; op<TRACE_OPS; op++)
+    if(byop[op])
+      ops.push_back(op);
+  std::sort(ops.begin(), ops.end(), [&](int a, int b){ return byop[a] > byop[b]; });
+  for(size_t i = 0; i<ops.size() && i<4; i++)
+    printf("    %-34s %10.1f per frame\n", traceops[ops[i]].name, (double)byop[ops[i]] / frames);
+  if(ops.empty())
+    printf("    none\n");
+}
+
+static void Usage(const char *name){
+  printf("Usage: %s trace.gltrace [--no-gl] [--output frames.csv] [--dump frame.ppm]\n", name);
+  exit( EXIT_FAILURE );
+}
+
+int main(int argc, char **argv){
+  const char *path = NULL, *output = NULL, *dump = NULL;
+  bool gl = true;
+  for(int i = 1; i<argc; i++){
+    if(!strcmp(argv[i], "--no-gl"))
+      gl = false;
+    else if(!strcmp(argv[i], "--output") && i + 1 < argc)
+      output = argv[++i];
+    else if(!strcmp(argv[i], "--dump") && i + 1 < argc)
+      dump = argv[++i];
+    else if(argv[i][0] != '-' && !path)
+      path = argv[i];
+    else
+      Usage(argv[0]);
+  }
+  if(!path)
+    Usage(argv[0]);
+  ReadTrace(path);
+  if(gl && !CreateHeadlessContext(header.width, header.height)){
+    printf("No headless context here; use --no-gl to count the calls without replaying them\n");
+    exit( EXIT_FAILURE );
+  }
+
+  /* Frame 0 is the setup before the first frame marker; it is counted but left out of the summary.
+     The counting is a pass of its own so it stays out of the replay's times. */
+  std::vector<FrameCounts> frames(1);
+  memset(&frames[0], 0, sizeof(FrameCounts));
+  for(size_t i = 0; i<records.size(); i++){
+    if(records[i].op == TRACE_FRAME){
+      frames.push_back(FrameCounts());
+      memset(&frames.back(), 0, sizeof(FrameCounts));
+    } else
+      Count(records[i], frames.size() > 1, &frames.back());
+  }
+  if(gl){
+    size_t f = 0;
+    double start = Seconds();
+    for(size_t i = 0; i<records.size(); i++){
+      if(records[i].op != TRACE_FRAME){
+        Replay(records[i]);
+        continue;
+      }
+      glFinish();
+      double now = Seconds();
+      frames[f++].ms = (now - start) * 1000;
+      start = now;
+    }
+  }
+  frames.pop_back(); /* Whatever follows the last marker is teardown */
+  if(gl && dump){
+    std::vector<unsigned char> pixels((size_t)header.width * header.height * 4);
+    glReadPixels(0, 0, header.width, header.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    if(WritePPM(dump, header.width, header.height, pixels.data()))
+      printf("Wrote %s\n", dump);
+  }
+
+  size_t count = frames.size() - 1;
+  FrameCounts total;
+  memset(&total, 0, sizeof(total));
+  std::vector<double> times;
+  for(size_t f = 1; f<frames.size(); f++){
+    const FrameCounts &c = frames[f];
+    total.calls += c.calls;
+    total.draws += c.draws;
+    total.statechanges += c.statechanges;
+    total.redundant += c.redundant;
+    total.rebinds += c.rebinds;
+    total.sameuniforms += c.sameuniforms;
+    total.deaduniforms += c.deaduniforms;
+    total.lookups += c.lookups;
+    total.bytes += c.bytes;
+    times.push_back(c.ms);
+  }
+  printf("%s: %zu frames at %ux%u, %llu setup calls (%.1f MB) before the first\n", path, count, header.width, header.height,
+         frames[0].calls, frames[0].bytes / 1e6);
+  if(!count)
+    exit( EXIT_SUCCESS );
+  double n = count;
+  printf("Per frame: %.1f calls, %.1f draws, %.1f state changes, %.1f KB of data\n", total.calls / n, total.draws / n,
+         total.statechanges / n, total.bytes / n / 1024);
+  printf("Waste per frame:\n");
+  printf("  %10.1f binds or state set to what it already was\n", total.redundant / n);
+  PrintTopOps(redundantbyop, count);
+  printf("  %10.1f binds of 0 undone by binding the same object again\n", total.rebinds / n);
+  PrintTopOps(rebindsbyop, count);
+  printf("  %10.1f uniforms set to the value they had\n", total.sameuniforms / n);
+  printf("  %10.1f uniforms set at location -1, which the program does not have\n", total.deaduniforms / n);
+  printf("  %10.1f glGetUniformLocation calls\n", total.lookups / n);
+  if(gl){
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0;
+    for(double t : times)
+      sum += t;
+    printf("Replayed setup in %.2f ms, frames in %.3f ms mean, %.3f min, %.3f median, %.3f max\n", frames[0].ms, sum / n,
+           sorted.front(), sorted[sorted.size() / 2], sorted.back());
+    if(unknownnames)
+      printf("%d calls named objects the trace never made; was it started after they were?\n", unknownnames);
+  }
+  if(output){
+    FILE *out = fopen(output, "w");
+    if(!out){
+      fprintf(stderr, "Cannot write %s\n", output);
+      exit( EXIT_FAILURE );
+    }
+    fprintf(out, "frame,ms,calls,draws,state_changes,redundant,rebinds,same_uniforms,dead_uniforms,uniform_lookups,bytes\n");
+    for(size_t f = 1; f<frames.size(); f++){
+      const FrameCounts &c = frames[f];
+      fprintf(out, "%zu,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n", f, gl ? c.ms : 0.0, c.calls, c.draws,
+              c.statechanges, c.redundant, c.rebinds, c.sameuniforms, c.deaduniforms, c.lookups, c.bytes);
+    }
+    fclose(out);
+    printf("Wrote %s\n", output);
+  }
+  if(gl)
+    DestroyHeadlessContext();
+  exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,39 @@
+#version 400
+#ifdef GL_ARB_conservative_depth
+#extension GL_ARB_conservative_depth : enable
+// The front of the sphere is always nearer than the quad through its centre, so the depth
+// test can still reject fragments early against the quad's own depth
+layout(depth_less) out float gl_FragDepth;
+#endif
+precision highp float;
+in vec3 vPoint;
+flat in vec3 vCentre;
+flat in float vRadius;
+
+uniform mat4 projection;
+
+out vec4 FragColor;
+
+void main(void) {
+    // Intersect the ray from the eye through this fragment with the sphere
+    vec3 ray = normalize(vPoint);
+    float b = dot(ray, vCentre);
+    float discriminant = b * b - dot(vCentre, vCentre) + vRadius * vRadius;
+    if(discriminant < 0.0)
+        discard;
+    vec3 hit = ray * (b - sqrt(discriminant));
+    vec4 clip = projection * vec4(hit, 1.0);
+    gl_FragDepth = 0.5 * (gl_DepthRange.diff * clip.z / clip.w + gl_DepthRange.near + gl_DepthRange.far);
+    vec3 vNormal = (hit - vCentre) / vRadius;
+
+    // The lighting of mode2.frag, with the normal in view space
+    vec3 uAmbient = vec3(0.1,0.1,0.0);
+    vec3 uSurfaceColour = vec3(0.0,1.0,0.0);
+    vec3 uLightColour = vec3(1.0);
+    vec3 uLightDirection = vec3(0.,0.,1.);
+    vec3 LightDirection = normalize(uLightDirection);
+    float CosTheta = dot(LightDirection, vNormal);
+    float theta = clamp(CosTheta, 0., 1.);
+    vec3 diffuse = uSurfaceColour * theta * uLightColour;
+    FragColor = vec4(uAmbient + diffuse,1.0);
+}
@@ -0,0 +1,33 @@
+#version 400
+
+precision highp float;
+
+in vec3 in_Position;  // Corner of the impostor quad, (+-1, +-1, 0)
+in mat4 in_Model;  // Per-instance model matrix of a unit sphere; it may only scale uniformly
+
+
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec3 vPoint;  // View-space point on the quad, which the fragment shader casts a ray through
+flat out vec3 vCentre;
+flat out float vRadius;
+
+void main(void) {
+
+    mat4 modelview = view * in_Model;
+    vec3 centre = modelview[3].xyz;
+    float radius = length(modelview[0].xyz);
+    float range = length(centre);
+    // A square facing the eye through the centre. Seen from a distance d the silhouette of a sphere
+    // of radius r covers a circle of radius r*d/sqrt(d*d - r*r) in that plane, so the square is
+    // as small as it can be while holding all of it. From inside the sphere nothing is drawn.
+    vec3 w = -centre / range;
+    vec3 u = normalize(cross(abs(w.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), w));
+    vec3 v = cross(w, u);
+    float extent = range > radius ? radius * range / sqrt(range * range - radius * radius) : 0.0;
+    vPoint = centre + extent * (in_Position.x * u + in_Position.y * v);
+    vCentre = centre;
+    vRadius = radius;
+    gl_Position = projection * vec4(vPoint, 1.0);
+}